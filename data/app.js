@@ -25,6 +25,10 @@ const TRANSLATIONS = {
     footerText: "v1.2",
     btn_read: "Leer Info",
     btn_dynamic: "Leer Voltajes",
+    btn_live: "En vivo",
+    btn_live_stop: "Detener",
+    lbl_bay: "Bahia",
+    log_live_ended: "Sesion en vivo finalizada",
     btn_clear_err: "Resetear Errores",
     btn_led_test: "Test LED",
     msg_wait: "Por favor, espere...",
@@ -40,6 +44,7 @@ const TRANSLATIONS = {
     mfg_date: "Fecha fabricacion",
     capacity: "Capacidad",
     rom_id: "ID ROM",
+    static_raw: "Tabla 0xAA",
     sum_total: "Voltaje Total",
     sum_diff: "Diferencia",
     log_waiting: "Esperando conexion...",
@@ -99,6 +104,7 @@ const TRANSLATIONS = {
     hdr_cycles: "Ciclos",
     hdr_soh: "SOH",
     hdr_readings: "Lecturas",
+    lbl_export: "Exportar",
     hdr_last_seen: "Ultimo",
     hdr_last_v: "Voltaje",
     msg_no_history: "Sin historial registrado.",
@@ -118,6 +124,10 @@ const TRANSLATIONS = {
     footerText: "v1.2",
     btn_read: "Read Info",
     btn_dynamic: "Read Voltages",
+    btn_live: "Live",
+    btn_live_stop: "Stop Live",
+    lbl_bay: "Bay",
+    log_live_ended: "Live session ended",
     btn_clear_err: "Reset Errors",
     btn_led_test: "Test LED",
     msg_wait: "Please wait...",
@@ -133,6 +143,7 @@ const TRANSLATIONS = {
     mfg_date: "Mfg Date",
     capacity: "Capacity",
     rom_id: "ROM ID",
+    static_raw: "0xAA table",
     sum_total: "Total Voltage",
     sum_diff: "Difference",
     log_waiting: "Waiting for connection...",
@@ -192,6 +203,7 @@ const TRANSLATIONS = {
     hdr_cycles: "Cycles",
     hdr_soh: "SOH",
     hdr_readings: "Readings",
+    lbl_export: "Export",
     hdr_last_seen: "Last Seen",
     hdr_last_v: "Voltage",
     msg_no_history: "No battery history recorded yet.",
@@ -211,7 +223,18 @@ let socket;
 let isConnected = false;
 let lastData = null;
 let lastPresence = false;
+let liveActive = false;
+let liveKeepaliveTimer = null;
+const LIVE_KEEPALIVE_MS = 5000;  // firmware closes the session after 30s without one
+// Multi-bay: every command is addressed to currentBay; bay-tagged messages for other
+// bays are kept (latest per type) and replayed when the user switches bays.
+let currentBay = 0;
+let bayCount = 1;
+let bayMessages = {};
+const BAY_REPLAY = ['presence', 'static_data', 'dynamic_data', 'live_status'];
 let historyChart = null;
+const HISTORY_POINTS = 100;
+let batteryList = [];  // the device downsamples the whole history to this many points
 let batteryHistoryChart = null;
 const MAX_HISTORY = 40;
 let historyData = {
@@ -460,12 +483,15 @@ function connect() {
 
   try {
     socket = new WebSocket(`ws://${window.location.host}/ws`);
+    socket.binaryType = 'arraybuffer';
 
     socket.onopen = () => {
       isConnected = true;
       reconnectAttempts = 0;
+      bayMessages = {};
       log("WebSocket connected.");
       refreshStatus();
+      sendCommand('set_binary', { enabled: true });
       sendCommand('presence');
       sendCommand('get_config');
       // Sync browser clock to ESP32 (fallback when no NTP)
@@ -478,6 +504,7 @@ function connect() {
 
     socket.onclose = () => {
       isConnected = false;
+      setLiveState(false);
       refreshStatus();
       if (reconnectAttempts < MAX_RECONNECT) {
         const delay = Math.min(2000 + reconnectAttempts * 1000, 10000);
@@ -490,8 +517,8 @@ function connect() {
     };
 
     socket.onmessage = (event) => {
-      const msg = JSON.parse(event.data);
-      handleMessage(msg);
+      const msg = (event.data instanceof ArrayBuffer) ? decodeTelemetry(event.data) : JSON.parse(event.data);
+      if (msg) handleMessage(msg);
     };
 
     socket.onerror = () => { log(t('log_ws_error')); };
@@ -503,8 +530,76 @@ function connect() {
 
 // No simulation mode - always connect to real hardware
 
+// Binary dynamic update (TelemetryFrame / delta frame in main.cpp, little-endian), turned
+// into the same shape as a dynamic_data JSON message
+const TELEMETRY_DYNAMIC = 0x01;
+const TELEMETRY_DELTA = 0x02;
+const TELEMETRY_FRAME_LEN = 22;
+const DYN_PACK = 0x01, DYN_CELLS = 0x02, DYN_DIFF = 0x04, DYN_TEMP1 = 0x08, DYN_TEMP2 = 0x10;
+
+function decodeTelemetry(buf) {
+  const v = new DataView(buf);
+  if (buf.byteLength < 2 || v.getUint8(1) !== 1) return null;
+  if (v.getUint8(0) === TELEMETRY_DELTA) return decodeDelta(v);
+  if (v.getUint8(0) !== TELEMETRY_DYNAMIC || buf.byteLength < TELEMETRY_FRAME_LEN) return null;
+  const cellCount = Math.min(v.getUint8(3), 5);
+  const cells = [];
+  for (let i = 0; i < cellCount; i++) cells.push(v.getUint16(6 + i * 2, true) / 1000);
+  return {
+    type: 'dynamic_data',
+    bay: v.getUint8(2),
+    data: {
+      pack_voltage: v.getUint16(4, true) / 1000,
+      cell_voltages: cells,
+      cell_diff: v.getUint16(16, true) / 1000,
+      temp1: v.getInt16(18, true) / 100,
+      temp2: v.getInt16(20, true) / 100
+    }
+  };
+}
+
+// Only the groups in the mask are present, in DYN_* order
+function decodeDelta(v) {
+  if (v.byteLength < 5) return null;
+  const fields = v.getUint8(3);
+  const cellCount = Math.min(v.getUint8(4), 5);
+  const data = {};
+  let off = 5;
+  const next = (signed) => {
+    const val = signed ? v.getInt16(off, true) : v.getUint16(off, true);
+    off += 2;
+    return val;
+  };
+  try {
+    if (fields & DYN_PACK) data.pack_voltage = next() / 1000;
+    if (fields & DYN_CELLS) {
+      data.cell_voltages = [];
+      for (let i = 0; i < cellCount; i++) data.cell_voltages.push(next() / 1000);
+    }
+    if (fields & DYN_DIFF) data.cell_diff = next() / 1000;
+    if (fields & DYN_TEMP1) data.temp1 = next(true) / 100;
+    if (fields & DYN_TEMP2) data.temp2 = next(true) / 100;
+  } catch (e) {
+    return null;  // truncated frame
+  }
+  return { type: 'dynamic_data', bay: v.getUint8(2), delta: true, data };
+}
+
 function handleMessage(msg) {
-  if (msg.type === 'static_data') {
+  if (msg.bay !== undefined) {
+    const bm = bayMessages[msg.bay] = bayMessages[msg.bay] || {};
+    if (msg.type === 'static_data') delete bm.dynamic_data;
+    if (msg.type === 'dynamic_data' && msg.delta && bm.dynamic_data) {
+      // Keep the stored update complete: fold the delta into it
+      bm.dynamic_data = { ...msg, data: { ...bm.dynamic_data.data, ...msg.data } };
+    } else if (BAY_REPLAY.includes(msg.type)) {
+      bm[msg.type] = msg;
+    }
+    if (msg.bay !== currentBay) return;
+  }
+  if (msg.type === 'bays') {
+    renderBaySelect(msg.count);
+  } else if (msg.type === 'static_data') {
     lastData = msg.data;
     renderStaticTable(msg.data);
     renderCells(msg.data);
@@ -517,7 +612,7 @@ function handleMessage(msg) {
     if (msg.data.cell_voltages) updateChart(msg.data.cell_voltages);
     // Auto-load long-term history for connected battery
     if (msg.data.rom_id) {
-      sendCommand('get_history', { rom_id: msg.data.rom_id });
+      sendCommand('get_history', { rom_id: msg.data.rom_id, points: HISTORY_POINTS });
     }
   } else if (msg.type === 'dynamic_data') {
     if (lastData && msg.data) {
@@ -531,12 +626,17 @@ function handleMessage(msg) {
       renderStaticTable(lastData);
       if (msg.data.cell_voltages) updateChart(msg.data.cell_voltages);
     }
+  } else if (msg.type === 'live_status') {
+    setLiveState(msg.active);
+    if (!msg.active && msg.reason) log(`${t('log_live_ended')} (${msg.reason})`);
   } else if (msg.type === 'presence') {
     updatePresence(msg.present);
   } else if (msg.type === 'success' || msg.type === 'error') {
     showNotification(msg.message, msg.type === 'success' ? 'success' : 'danger');
   } else if (msg.type === 'debug') {
     log(msg.message);
+  } else if (msg.type === 'log_batch') {
+    (msg.lines || []).forEach(line => log(line));
   } else if (msg.type === 'config') {
     if (msg.lang && msg.lang !== currentLang) {
       currentLang = msg.lang;
@@ -546,7 +646,10 @@ function handleMessage(msg) {
   } else if (msg.type === 'wifi_status') {
     renderWifiStatus(msg);
   } else if (msg.type === 'battery_list') {
-    renderBatteryList(msg.data);
+    // Long lists arrive in pages (offset/total); the first page starts a new list
+    if (!msg.offset) batteryList = [];
+    batteryList = batteryList.concat(msg.data || []);
+    renderBatteryList(batteryList);
     // Show battery list panel when no battery connected and not in Settings
     if (el('overviewCard').classList.contains('hidden') && el('systemSection').classList.contains('hidden')) {
       el('batteryListPanel').classList.remove('hidden');
@@ -577,7 +680,34 @@ function handleMessage(msg) {
 
 function sendCommand(cmd, params = {}) {
   if (!isConnected) return;
-  socket.send(JSON.stringify({ command: cmd, ...params }));
+  socket.send(JSON.stringify({ command: cmd, bay: currentBay, ...params }));
+}
+
+// ── Bays ──
+function renderBaySelect(count) {
+  bayCount = count || 1;
+  const sel = el('baySelect');
+  if (!sel) return;
+  sel.innerHTML = '';
+  for (let i = 0; i < bayCount; i++) {
+    const opt = document.createElement('option');
+    opt.value = i;
+    opt.textContent = `${t('lbl_bay')} ${i + 1}`;
+    sel.appendChild(opt);
+  }
+  if (currentBay >= bayCount) currentBay = 0;
+  sel.value = currentBay;
+  sel.classList.toggle('hidden', bayCount < 2);
+}
+
+function selectBay(bay) {
+  currentBay = bay;
+  // Clear the dashboard, then rebuild it from the bay's latest messages
+  lastData = null;
+  updatePresence(false);
+  const bm = bayMessages[bay] || {};
+  // Snapshot first: replaying static_data drops the stored dynamic_data
+  BAY_REPLAY.map(type => bm[type]).filter(Boolean).forEach(handleMessage);
 }
 
 // ── Render ──
@@ -594,6 +724,9 @@ function renderStaticTable(d) {
     [t('lbl_total_voltage'), d.pack_voltage.toFixed(2) + " V"],
     [t('rom_id'), `<span style="font-family:monospace;font-size:11px">${d.rom_id}</span>`]
   ];
+  if (d.static_raw) {
+    rows.push([t('static_raw'), `<span style="font-family:monospace;font-size:11px;word-break:break-all">${d.static_raw}</span>`]);
+  }
 
   table.innerHTML = rows.map(r => `
     <div class="kv-row">
@@ -777,9 +910,27 @@ function updateButtonStates(f) {
   el('btnReadDynamic').disabled = !f.read_dynamic;
   el('btnClearErrors').disabled = !f.clear_errors;
   el('btnLed').disabled = !f.led_test;
+  el('btnLive').disabled = !f.live_session;
   el('serviceActions').classList.toggle('hidden', !(f.clear_errors || f.led_test));
 }
 
+// Live session: the firmware keeps the BMS powered and streams dynamic_data
+function setLiveState(active) {
+  liveActive = active;
+  const b = el('btnLive');
+  if (b) {
+    b.setAttribute('data-i18n', active ? 'btn_live_stop' : 'btn_live');
+    b.textContent = t(active ? 'btn_live_stop' : 'btn_live');
+    b.classList.toggle('primary', active);
+  }
+  if (active && !liveKeepaliveTimer) {
+    liveKeepaliveTimer = setInterval(() => sendCommand('live_keepalive'), LIVE_KEEPALIVE_MS);
+  } else if (!active && liveKeepaliveTimer) {
+    clearInterval(liveKeepaliveTimer);
+    liveKeepaliveTimer = null;
+  }
+}
+
 function toggleAutoDetect(active) {
   savePref('auto', active);
   sendCommand('set_auto_detect', { enabled: active });
@@ -805,6 +956,8 @@ function updatePresence(present) {
     el('overviewCard').classList.add('hidden');
     el('connectedHistoryPanel').classList.add('hidden');
     el('serviceActions').classList.add('hidden');
+    el('btnLive').disabled = true;
+    setLiveState(false);
     lastData = null;
     // Clean up connected history chart
     if (batteryHistoryChart) {
@@ -853,6 +1006,18 @@ function setupEventListeners() {
   if (bDynamic) bDynamic.addEventListener('click', () => { log(t('log_req_dynamic')); sendCommand('read_dynamic'); });
   if (bClear) bClear.addEventListener('click', () => { if (confirm(t('log_clear_confirm'))) sendCommand('clear_errors'); });
 
+  const bLive = el('btnLive');
+  if (bLive) bLive.addEventListener('click', () => {
+    if (liveActive) sendCommand('live_stop');
+    else sendCommand('live_start', { rate_hz: parseInt(el('liveRate').value, 10) });
+  });
+  const sBay = el('baySelect');
+  if (sBay) sBay.addEventListener('change', () => selectBay(parseInt(sBay.value, 10)));
+  const sRate = el('liveRate');
+  if (sRate) sRate.addEventListener('change', () => {
+    if (liveActive) sendCommand('live_start', { rate_hz: parseInt(sRate.value, 10) });
+  });
+
   let ledOn = false;
   if (bLed) bLed.addEventListener('click', () => { ledOn = !ledOn; sendCommand(ledOn ? 'led_on' : 'led_off'); });
 
@@ -1047,7 +1212,7 @@ function renderBatteryList(data) {
     row.addEventListener('click', (e) => {
       if (e.target.classList.contains('btn-delete')) return;
       const rid = row.dataset.rom;
-      sendCommand('get_history', { rom_id: rid });
+      sendCommand('get_history', { rom_id: rid, points: HISTORY_POINTS });
     });
   });
 
@@ -1086,9 +1251,14 @@ function renderBatteryHistory(msg) {
     infoEl.innerHTML =
       `<span>${t('model')}: <strong>${msg.model || '?'}</strong></span>` +
       `<span>${t('rom_id')}: <strong style="font-family:monospace;font-size:11px">${msg.rom_id}</strong></span>` +
-      `<span>${t('hdr_readings')}: <strong>${msg.data.length}</strong></span>` +
+      `<span>${t('hdr_readings')}: <strong>${msg.total != null ? msg.total : msg.data.length}</strong></span>` +
       `<span>${t('cycles')}: <strong>${cyclesStr}</strong></span>` +
       `<span>${t('lbl_soh')}: <strong>${sohStr}</strong></span>`;
+    // Full history, streamed by the device (the chart only gets the latest records)
+    const rom = encodeURIComponent(msg.rom_id || '');
+    infoEl.innerHTML +=
+      `<span>${t('lbl_export')}: <a href="/history?rom=${rom}&format=csv" download>CSV</a> · ` +
+      `<a href="/history?rom=${rom}&format=ndjson" download>NDJSON</a></span>`;
   }
 
   if (!canvas || typeof Chart === 'undefined') return;
@@ -1117,6 +1287,14 @@ function renderBatteryHistory(msg) {
     fill: false
   }];
 
+  // Downsampled points carry the pack min/max of their bucket: drawn as a band
+  if (msg.data.some(r => r.pack_max != null)) {
+    const band = { label: '', borderWidth: 0, pointRadius: 0, tension: 0.3,
+                   backgroundColor: 'rgba(37,99,235,0.12)' };
+    datasets.push({ ...band, data: msg.data.map(r => r.pack_max / 1000), fill: '+1' });
+    datasets.push({ ...band, data: msg.data.map(r => r.pack_min / 1000), fill: false });
+  }
+
   for (let c = 0; c < cellCount; c++) {
     datasets.push({
       label: `${t('cell')} ${c + 1}`,
@@ -1150,9 +1328,10 @@ function renderBatteryHistory(msg) {
       plugins: {
         legend: {
           display: true,
-          labels: { boxWidth: 10, font: { size: 10 }, color: 'rgba(128,128,128,0.8)' }
+          labels: { boxWidth: 10, font: { size: 10 }, color: 'rgba(128,128,128,0.8)', filter: item => item.text !== '' }
         },
         tooltip: {
+          filter: item => item.dataset.label !== '',
           callbacks: {
             label: ctx => `${ctx.dataset.label}: ${ctx.parsed.y.toFixed(3)}V`
           }
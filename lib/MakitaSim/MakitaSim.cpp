@@ -0,0 +1,260 @@
+// lib/MakitaSim/MakitaSim.cpp - SIMULATED MAKITA BATTERY
+
+#include "MakitaSim.h"
+#include <string.h>
+
+// Preset packs. Indices are used by the "sim" WebSocket command.
+const MakitaSim::Pack MakitaSim::PACKS[] = {
+    // label              controller                      model      S  rom                                                  cells (mV)                          temps        cyc  cap  lock   fresh  batch
+    {"BL1850B 5S",        MakitaSim::Controller::STANDARD, "BL1850B", 5, {0x21, 0x06, 0x15, 0x3A, 0x91, 0x0C, 0x42, 0x07}, {4012, 4008, 4015, 4010, 4011}, {2310, 2290}, 112, 50, false, false, true},
+    {"BL1430 4S",         MakitaSim::Controller::STANDARD, "BL1430",  4, {0x16, 0x11, 0x02, 0x5C, 0x20, 0x1F, 0x88, 0x03}, {3720, 3710, 3735, 3702, 0},    {2150, 2140}, 431, 30, false, false, true},
+    {"BL1860B locked",    MakitaSim::Controller::STANDARD, "BL1860B", 5, {0x19, 0x03, 0x28, 0x77, 0x1A, 0x60, 0x05, 0xE1}, {3301, 2950, 3310, 3305, 3298}, {2400, 2410}, 689, 60, true,  true,  true},
+    {"F0513 BL1815 5S",   MakitaSim::Controller::F0513,    "BL1815",  5, {0x12, 0x09, 0x30, 0x04, 0xB2, 0x41, 0x10, 0x6D}, {3890, 3885, 3902, 3879, 3891}, {2500, 0},    250, 15, false, false, true},
+    {"F0513 BL1415 4S",   MakitaSim::Controller::F0513,    "BL1415",  4, {0x11, 0x04, 0x12, 0x9E, 0x03, 0x77, 0x21, 0x5A}, {3600, 3610, 3590, 3605, 0},    {2210, 0},    802, 15, false, false, false},
+};
+const uint8_t MakitaSim::PACK_COUNT = sizeof(MakitaSim::PACKS) / sizeof(MakitaSim::PACKS[0]);
+
+MakitaSim::MakitaSim(int8_t initial_pack) {
+    if (initial_pack >= 0 && initial_pack < (int8_t)PACK_COUNT) _pack = &PACKS[initial_pack];
+}
+
+void MakitaSim::insert(uint8_t pack_index) {
+    if (pack_index < PACK_COUNT) _req_pack = (int8_t)pack_index;
+}
+
+void MakitaSim::remove() {
+    _req_pack = REQ_REMOVE;
+}
+
+void MakitaSim::setFault(Fault fault, uint16_t after_bytes) {
+    _req_fault_kind = fault;
+    _req_fault_after = after_bytes;
+    _req_fault = true;
+}
+
+/**
+ * Applies scenario changes posted by other tasks (bus task only, between frames).
+ */
+void MakitaSim::applyRequests() {
+    int8_t req = _req_pack;
+    if (req != REQ_NONE) {
+        _req_pack = REQ_NONE;
+        _pack = (req == REQ_REMOVE) ? nullptr : &PACKS[req];
+        _unlocked = false;
+        _f0513_model_armed = false;
+    }
+    if (_req_fault) {
+        _req_fault = false;
+        _fault = _req_fault_kind;
+        _fault_after = _req_fault_after;
+    }
+}
+
+bool MakitaSim::alive() const {
+    return _powered && _pack != nullptr && _fault != Fault::BUS_FF;
+}
+
+void MakitaSim::setPower(bool on) {
+    if (on && !_powered) {
+        applyRequests();
+        _cmds_since_power = 0;
+        _f0513_model_armed = false;
+    }
+    _powered = on;
+    _mode = Mode::IDLE;
+}
+
+bool MakitaSim::reset() {
+    applyRequests();
+    _resets++;
+    _cmd_len = 0;
+    _out_len = _out_pos = 0;
+    if (_fault == Fault::BUS_00) {
+        _mode = Mode::IDLE;
+        return true;                 // a shorted line looks like a presence pulse
+    }
+    if (!alive()) {
+        _mode = Mode::IDLE;
+        return false;
+    }
+    _mode = Mode::CONTROL;
+    return true;
+}
+
+void MakitaSim::write(uint8_t v) {
+    if (!alive() || _fault == Fault::BUS_00) return;
+    switch (_mode) {
+        case Mode::CONTROL:
+            if (v == 0x33) {
+                _mode = Mode::CMD_33;
+                answer(_pack->rom, 8);   // the master reads the ROM ID first
+            } else if (v == 0xCC) {
+                _mode = Mode::CMD_CC;
+            } else if (v == 0x31 && _pack->controller == Controller::F0513 && _f0513_model_armed) {
+                // Second half of the F0513 model query: two model bytes, little-endian
+                const char* m = _pack->model;
+                auto hex = [](char c) -> uint8_t { return (uint8_t)(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10); };
+                uint8_t r[2] = {(uint8_t)((hex(m[4]) << 4) | hex(m[5])), (uint8_t)((hex(m[2]) << 4) | hex(m[3]))};
+                _f0513_model_armed = false;
+                _mode = Mode::IDLE;
+                answer(r, 2);
+            } else {
+                _mode = Mode::IDLE;
+            }
+            break;
+        case Mode::CMD_33:
+        case Mode::CMD_CC:
+            if (_cmd_len < sizeof(_cmd)) _cmd[_cmd_len++] = v;
+            if (_cmd_len == expectedLength(_cmd[0])) {
+                respond();
+                _cmd_len = 0;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+uint8_t MakitaSim::read() {
+    if (_fault == Fault::BUS_00) return 0x00;
+    if (!alive() || _out_pos >= _out_len) return 0xFF;
+    if (_fault == Fault::DISCONNECT) {
+        if (_fault_after == 0) {
+            _pack = nullptr;         // pulled out mid-read
+            _fault = Fault::NONE;
+            return 0xFF;
+        }
+        _fault_after--;
+    }
+    return _out[_out_pos++];
+}
+
+void MakitaSim::writeBytes(const uint8_t* data, uint8_t len, uint16_t) {
+    for (uint8_t i = 0; i < len; i++) write(data[i]);
+}
+
+void MakitaSim::readBytes(uint8_t* data, uint8_t len, uint16_t) {
+    for (uint8_t i = 0; i < len; i++) data[i] = read();
+}
+
+/**
+ * Command lengths by first byte (anything unknown is treated as a one-byte command).
+ */
+uint8_t MakitaSim::expectedLength(uint8_t first) {
+    switch (first) {
+        case 0xAA: return 2;   // static frame
+        case 0xD9: return 3;   // service mode init
+        case 0xDA: return 2;   // LED on/off, clear errors
+        case 0xDC: return 2;   // model query
+        case 0xD7: return 4;   // dynamic read
+        case 0xF0: return 2;   // F0513 clear
+        default:   return 1;   // F0513 0x31..0x35, 0x52, 0x99
+    }
+}
+
+void MakitaSim::respond() {
+    _commands++;
+    if (_mode == Mode::CMD_33) respond33();
+    else respondCC();
+    _cmds_since_power++;
+}
+
+void MakitaSim::respond33() {
+    uint8_t ack[9] = {0x06, 0, 0, 0, 0, 0, 0, 0, 0};
+    switch (_cmd[0]) {
+        case 0xAA: {
+            uint8_t frame[40];
+            buildStaticFrame(frame);
+            answer(frame + 8, 32);
+            break;
+        }
+        case 0xDA:
+            if (_cmd[1] == 0x04 && _pack->locked) _unlocked = true;
+            answer(ack, sizeof(ack));
+            break;
+        case 0xD9:
+            answer(ack, sizeof(ack));
+            break;
+        default:
+            _out_len = _out_pos = 0;
+            break;
+    }
+}
+
+void MakitaSim::respondCC() {
+    const Pack& p = *_pack;
+    _out_len = _out_pos = 0;
+
+    if (p.controller == Controller::STANDARD) {
+        if (_cmd[0] == 0xDC) {
+            if (p.needs_fresh_wake && _cmds_since_power > 0) return;
+            uint8_t m[16];
+            memset(m, 0x20, sizeof(m));
+            memcpy(m, p.model, strnlen(p.model, 7));
+            answer(m, sizeof(m));
+        } else if (_cmd[0] == 0xD7) {
+            uint8_t r[29] = {0};
+            uint32_t pack_mv = 0;
+            for (uint8_t i = 0; i < 5; i++) {
+                // A few mV of movement so live views are not flat
+                uint16_t mv = (i < p.cells) ? (uint16_t)(p.cell_mv[i] + ((_samples + i * 3) % 11) - 5) : 0;
+                pack_mv += mv;
+                r[2 + i * 2] = mv & 0xFF;
+                r[3 + i * 2] = mv >> 8;
+            }
+            r[0] = pack_mv & 0xFF;
+            r[1] = (pack_mv >> 8) & 0xFF;
+            r[14] = p.temp_cdeg[0] & 0xFF; r[15] = (uint16_t)p.temp_cdeg[0] >> 8;
+            r[16] = p.temp_cdeg[1] & 0xFF; r[17] = (uint16_t)p.temp_cdeg[1] >> 8;
+            _samples++;
+            answer(r, sizeof(r));
+        }
+        return;
+    }
+
+    // F0513: one command per power window unless batch_ok
+    bool fresh = (_cmds_since_power == 0) || p.batch_ok;
+    switch (_cmd[0]) {
+        case 0x99:
+            _f0513_model_armed = true;
+            break;
+        case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: {
+            uint8_t i = _cmd[0] - 0x31;
+            answerWord((fresh && i < p.cells) ? (uint16_t)(p.cell_mv[i] + (_samples % 7) - 3) : 0xFFFF);
+            break;
+        }
+        case 0x52:
+            answerWord(fresh ? (uint16_t)p.temp_cdeg[0] : 0xFFFF);
+            _samples++;
+            break;
+        default:
+            break;   // 0xF0 0x00 clear and anything else: no answer
+    }
+}
+
+void MakitaSim::answer(const uint8_t* data, uint8_t len) {
+    if (len > sizeof(_out)) len = sizeof(_out);
+    memcpy(_out, data, len);
+    _out_len = len;
+    _out_pos = 0;
+}
+
+void MakitaSim::answerWord(uint16_t v) {
+    uint8_t r[2] = {(uint8_t)(v & 0xFF), (uint8_t)(v >> 8)};
+    answer(r, 2);
+}
+
+/**
+ * 40-byte 0x33/0xAA frame (ROM ID + 32 data bytes) laid out the way MakitaBMS parses it.
+ */
+void MakitaSim::buildStaticFrame(uint8_t* frame) const {
+    const Pack& p = *_pack;
+    memset(frame, 0, 40);
+    memcpy(frame, p.rom, 8);
+    frame[19] = nibbleSwap(p.controller == Controller::F0513 ? 0x0D : 0x0B);  // battery type
+    frame[24] = nibbleSwap(p.capacity_dah);
+    frame[27] = 0x00;                                                          // status code
+    frame[28] = (p.locked && !_unlocked) ? 0x01 : 0x00;
+    frame[34] = nibbleSwap((uint8_t)((p.cycles >> 8) & 0x0F));
+    frame[35] = nibbleSwap((uint8_t)(p.cycles & 0xFF));
+}
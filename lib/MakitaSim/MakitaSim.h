@@ -0,0 +1,111 @@
+// lib/MakitaSim/MakitaSim.h - SIMULATED MAKITA BATTERY
+
+#ifndef MakitaSim_h
+#define MakitaSim_h
+
+#include <stdint.h>
+#include "MakitaBus.h"
+
+/**
+ * A MakitaBus with a virtual battery behind it. It answers the 0x33 and 0xCC frames
+ * that MakitaBMS sends, for STANDARD and F0513 controllers and 4S/5S packs, and can
+ * inject the failure modes seen on real hardware: an open bus (0xFF), a shorted bus
+ * (0x00) and a pack pulled out in the middle of a read.
+ *
+ * Used by the esp32c3_sim firmware (-DMAKITA_SIMULATED_BMS). No Arduino dependency,
+ * so it also builds on a host. Time is not modelled: every answer is immediate.
+ *
+ * Bus methods run on the bus worker task. insert()/remove()/setFault() may be called
+ * from any task; they only post a request that is applied at the next reset() or
+ * power change, never in the middle of a frame.
+ */
+class MakitaSim : public MakitaBus
+{
+  public:
+    enum class Controller : uint8_t { STANDARD, F0513 };
+    enum class Fault : uint8_t { NONE, BUS_FF, BUS_00, DISCONNECT };
+
+    struct Pack {
+        const char* label;
+        Controller controller;
+        const char* model;          // STANDARD: up to 7 chars; F0513: "BLxxyy" (hex digits on the bus)
+        uint8_t cells;              // 4 or 5
+        uint8_t rom[8];             // rom[0..2] = manufacture yy/mm/dd
+        uint16_t cell_mv[5];
+        int16_t temp_cdeg[2];       // centi-degrees C
+        uint16_t cycles;
+        uint8_t capacity_dah;       // 50 = 5.0 Ah
+        bool locked;
+        bool needs_fresh_wake;      // STANDARD: model query only answered as the first command after power-on
+        bool batch_ok;              // F0513: answers more than one command per power window
+    };
+
+    static const Pack PACKS[];
+    static const uint8_t PACK_COUNT;
+
+    explicit MakitaSim(int8_t initial_pack = 0);
+
+    // Scenario control (deferred, see class comment)
+    void insert(uint8_t pack_index);
+    void remove();
+    // DISCONNECT: the pack disappears after `after_bytes` more bytes have been read
+    void setFault(Fault fault, uint16_t after_bytes = 0);
+
+    // MakitaBus
+    bool begin() override { return true; }
+    const char* name() const override { return "sim"; }
+    bool reset() override;
+    void write(uint8_t v) override;
+    uint8_t read() override;
+    void writeBytes(const uint8_t* data, uint8_t len, uint16_t gap_us) override;
+    void readBytes(uint8_t* data, uint8_t len, uint16_t gap_us) override;
+    void setPower(bool on) override;
+
+    // Counters for diagnostics
+    uint32_t resets() const { return _resets; }
+    uint32_t commands() const { return _commands; }
+    bool inserted() const { return _pack != nullptr; }
+
+  private:
+    enum class Mode : uint8_t { IDLE, CONTROL, CMD_33, CMD_CC };
+
+    static constexpr int8_t REQ_NONE = -2;
+    static constexpr int8_t REQ_REMOVE = -1;
+
+    // Requests from other tasks
+    volatile int8_t _req_pack = REQ_NONE;
+    volatile bool _req_fault = false;
+    volatile Fault _req_fault_kind = Fault::NONE;
+    volatile uint16_t _req_fault_after = 0;
+
+    // Bus-side state
+    const Pack* _pack = nullptr;
+    Fault _fault = Fault::NONE;
+    uint16_t _fault_after = 0;
+    bool _powered = false;
+    Mode _mode = Mode::IDLE;
+    uint8_t _cmd[8];
+    uint8_t _cmd_len = 0;
+    uint8_t _out[40];
+    uint8_t _out_len = 0;
+    uint8_t _out_pos = 0;
+    uint16_t _cmds_since_power = 0;
+    bool _f0513_model_armed = false;
+    bool _unlocked = false;         // clear-errors executed on a locked pack
+    uint32_t _samples = 0;
+    uint32_t _resets = 0;
+    uint32_t _commands = 0;
+
+    void applyRequests();
+    bool alive() const;
+    void respond();
+    void respond33();
+    void respondCC();
+    void answer(const uint8_t* data, uint8_t len);
+    void answerWord(uint16_t v);
+    void buildStaticFrame(uint8_t* frame) const;
+    static uint8_t expectedLength(uint8_t first);
+    static uint8_t nibbleSwap(uint8_t b) { return (uint8_t)((b >> 4) | (b << 4)); }
+};
+
+#endif
@@ -0,0 +1,42 @@
+// lib/OneWireMakita/LatencyHistogram.h - HISTOGRAMA DE LATENCIAS DE CUBETAS FIJAS
+
+#ifndef LatencyHistogram_h
+#define LatencyHistogram_h
+
+#include <stdint.h>
+
+/**
+ * Histograma de duraciones en µs con cubetas logarítmicas fijas: la cubeta i cuenta
+ * las muestras menores de 2^i µs (la 0 solo las de 0 µs) y la última acumula el resto
+ * (>= ~0,5 s). add() es O(1), sin memoria dinámica, apto para el camino caliente del bus.
+ * Sin dependencias de Arduino.
+ *
+ * Lo escribe una sola tarea; los lectores obtienen una instantánea aproximada
+ * (los contadores pueden ir una muestra por delante del total).
+ */
+struct LatencyHistogram {
+    static constexpr uint8_t BUCKETS = 21;
+
+    uint32_t counts[BUCKETS] = {0};
+    uint32_t count = 0;
+    uint32_t max_us = 0;
+    uint64_t total_us = 0;
+
+    void add(uint32_t us) {
+        uint8_t b = 0;
+        for (uint32_t v = us; v && b < BUCKETS - 1; v >>= 1) b++;
+        counts[b]++;
+        count++;
+        total_us += us;
+        if (us > max_us) max_us = us;
+    }
+
+    void clear() { *this = LatencyHistogram(); }
+
+    uint32_t avgUs() const { return count ? (uint32_t)(total_us / count) : 0; }
+
+    // Límite superior (exclusivo) de la cubeta i en µs; 0 = sin límite (última cubeta)
+    static uint32_t bucketLimitUs(uint8_t i) { return (i < BUCKETS - 1) ? (1UL << i) : 0; }
+};
+
+#endif
@@ -0,0 +1,45 @@
+// lib/OneWireMakita/MakitaBus.h - INTERFAZ DEL BUS DE LA BATERÍA (INDEPENDIENTE DEL HARDWARE)
+
+#ifndef MakitaBus_h
+#define MakitaBus_h
+
+#include <stdint.h>
+#include "LatencyHistogram.h"
+
+/**
+ * Todo lo que MakitaBMS necesita del hardware: el bus de datos de un solo hilo y la
+ * línea de alimentación (enable) del BMS. OneWireMakita lo implementa sobre GPIO/RMT;
+ * MakitaSim (lib/MakitaSim) lo implementa con una batería simulada.
+ * Sin dependencias de Arduino para poder compilarse en el host.
+ */
+class MakitaBus
+{
+  public:
+    virtual ~MakitaBus() {}
+
+    // Prepara el hardware. Llamar desde setup(). false si algo no pudo inicializarse.
+    virtual bool begin() = 0;
+
+    // Nombre del motor activo para los logs ("RMT", "bit-bang", "sim"...)
+    virtual const char* name() const = 0;
+
+    // Pulso de reinicio; true si el BMS responde con un pulso de presencia
+    virtual bool reset() = 0;
+
+    virtual void write(uint8_t v) = 0;
+    virtual uint8_t read() = 0;
+
+    // Secuencias de bytes con gap_us de separación tras cada byte
+    virtual void writeBytes(const uint8_t* data, uint8_t len, uint16_t gap_us) = 0;
+    virtual void readBytes(uint8_t* data, uint8_t len, uint16_t gap_us) = 0;
+
+    // Línea de alimentación del BMS. Debe poder llamarse desde la tarea esp_timer (watchdog).
+    virtual void setPower(bool on) = 0;
+
+    // Duración de las secciones críticas (interrupciones deshabilitadas) del motor activo;
+    // nullptr si el motor no las usa
+    virtual const LatencyHistogram* criticalSections() const { return nullptr; }
+    virtual void clearCriticalSections() {}
+};
+
+#endif
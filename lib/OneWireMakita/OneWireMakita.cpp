@@ -1,6 +1,9 @@
 // lib/OneWireMakita/OneWireMakita.cpp - IMPLEMENTACIÓN DE BAJO NIVEL
 
 #include "OneWireMakita.h"
+#include <driver/gpio.h>
+#include <soc/rmt_periph.h>
+#include <esp_rom_gpio.h>
 
 // Mutex para proteger los tiempos críticos en sistemas con múltiples tareas (FreeRTOS)
 // Impide que una interrupción de red afecte a los micro-tiempos del bus.
@@ -11,44 +14,250 @@ static portMUX_TYPE oneWireMux = portMUX_INITIALIZER_UNLOCKED;
  * El pin se configura en modo OUTPUT_OPEN_DRAIN para permitir la comunicación bidireccional
  * sin riesgo de cortocircuito (la línea sube mediante una resistencia de pull-up).
  */
-OneWireMakita::OneWireMakita(uint8_t pin) : _pin((gpio_num_t)pin) {
+OneWireMakita::OneWireMakita(uint8_t pin, uint8_t enable_pin, rmt_channel_t tx_channel, rmt_channel_t rx_channel)
+    : _pin((gpio_num_t)pin), _enable_pin(enable_pin), _rmt_tx(tx_channel), _rmt_rx(rx_channel) {
     pinMode(_pin, INPUT_PULLUP);
     gpio_pullup_en(_pin);             // Asegura pull-up a nivel de hardware ESP32
-    pinMode(_pin, OUTPUT_OPEN_DRAIN); 
-    digitalWrite(_pin, HIGH); 
+    pinMode(_pin, OUTPUT_OPEN_DRAIN);
+    digitalWrite(_pin, HIGH);
+    if (_enable_pin != NO_ENABLE_PIN) {
+        pinMode(_enable_pin, OUTPUT);
+        digitalWrite(_enable_pin, LOW); // Estado inicial: BMS apagado
+    }
 }
 
 /**
- * Implementación del reinicio (reset) del bus.
+ * Selección del motor del bus. El bit-bang siempre está disponible como respaldo.
  */
+OneWireMakita::Backend OneWireMakita::begin(Backend preferred) {
+    _cycles_per_us = ESP.getCpuFreqMHz();
+    if (preferred == Backend::RMT && _backend != Backend::RMT && rmtInit()) {
+        _backend = Backend::RMT;
+    }
+    return _backend;
+}
+
+bool OneWireMakita::begin() {
+#ifdef ONEWIRE_MAKITA_FORCE_BITBANG
+    begin(Backend::BITBANG);
+#else
+    begin(Backend::RMT);
+#endif
+    return true; // el bit-bang siempre está disponible
+}
+
+const char* OneWireMakita::name() const {
+    return (_backend == Backend::RMT) ? "RMT" : "bit-bang";
+}
+
+void OneWireMakita::setPower(bool on) {
+    if (_enable_pin != NO_ENABLE_PIN) digitalWrite(_enable_pin, on ? HIGH : LOW);
+}
+
 bool OneWireMakita::reset(void) {
+    return (_backend == Backend::RMT) ? rmtReset() : bitbangReset();
+}
+
+void OneWireMakita::write(uint8_t v) {
+    if (_backend == Backend::RMT) rmtWrite(&v, 1, 0);
+    else bitbangWrite(v);
+}
+
+uint8_t OneWireMakita::read() {
+    if (_backend == Backend::RMT) {
+        uint8_t v = 0xFF;
+        rmtRead(&v, 1, 0);
+        return v;
+    }
+    return bitbangRead();
+}
+
+void OneWireMakita::writeBytes(const uint8_t* data, uint8_t len, uint16_t gap_us) {
+    if (_backend == Backend::RMT) {
+        rmtWrite(data, len, gap_us);
+        return;
+    }
+    for (uint8_t i = 0; i < len; i++) { bitbangWrite(data[i]); delayMicroseconds(gap_us); }
+}
+
+void OneWireMakita::readBytes(uint8_t* data, uint8_t len, uint16_t gap_us) {
+    if (_backend == Backend::RMT) {
+        rmtRead(data, len, gap_us);
+        return;
+    }
+    for (uint8_t i = 0; i < len; i++) { data[i] = bitbangRead(); delayMicroseconds(gap_us); }
+}
+
+// --- Motor RMT ---
+
+/**
+ * Instala un canal TX y uno RX sobre el mismo pin open-drain.
+ * El TX marca los flancos de bajada (idle en ALTO) y el RX mide cuánto tiempo permanece
+ * la línea en BAJO, que es lo que distingue un '0' (el BMS alarga el pulso) de un '1'.
+ */
+bool OneWireMakita::rmtInit() {
+    rmt_config_t tx = RMT_DEFAULT_CONFIG_TX(_pin, _rmt_tx);
+    tx.clk_div = 80;                                  // APB 80 MHz -> 1 tick = 1 µs
+    tx.mem_block_num = 1;
+    tx.tx_config.carrier_en = false;
+    tx.tx_config.idle_output_en = true;
+    tx.tx_config.idle_level = RMT_IDLE_LEVEL_HIGH;
+    if (rmt_config(&tx) != ESP_OK) return false;
+    if (rmt_driver_install(_rmt_tx, 0, 0) != ESP_OK) return false;
+
+    rmt_config_t rx = RMT_DEFAULT_CONFIG_RX(_pin, _rmt_rx);
+    rx.clk_div = 80;
+    rx.mem_block_num = 1;
+    rx.rx_config.filter_en = true;
+    rx.rx_config.filter_ticks_thresh = RMT_RX_FILTER_TICKS;
+    rx.rx_config.idle_threshold = RMT_RX_IDLE_US;
+    if (rmt_config(&rx) != ESP_OK || rmt_driver_install(_rmt_rx, RMT_RX_RINGBUF_SIZE, 0) != ESP_OK) {
+        rmt_driver_uninstall(_rmt_tx);
+        return false;
+    }
+    if (rmt_get_ringbuf_handle(_rmt_rx, &_rmt_rb) != ESP_OK || _rmt_rb == nullptr) {
+        rmt_driver_uninstall(_rmt_rx);
+        rmt_driver_uninstall(_rmt_tx);
+        return false;
+    }
+
+    // rmt_config() deja el pin en modo salida push-pull: volvemos a open-drain con
+    // entrada habilitada y conectamos ambas señales del RMT a través de la matriz GPIO.
+    gpio_set_direction(_pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_pullup_en(_pin);
+    esp_rom_gpio_connect_out_signal(_pin, rmt_periph_signals.groups[0].channels[_rmt_tx].tx_sig, false, false);
+    esp_rom_gpio_connect_in_signal(_pin, rmt_periph_signals.groups[0].channels[_rmt_rx].rx_sig, false);
+    return true;
+}
+
+/**
+ * Copia count símbolos de _symbols al buffer de items del RMT.
+ */
+size_t OneWireMakita::rmtLoad(size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        _items[i].level0 = 0;
+        _items[i].duration0 = _symbols[i].low_us;
+        _items[i].level1 = 1;
+        _items[i].duration1 = _symbols[i].high_us;
+    }
+    return count;
+}
+
+/**
+ * Emite los count items cargados mientras el canal RX captura la línea.
+ * Devuelve en low_us la duración de cada tramo BAJO observado (incluidos los del BMS).
+ * La tarea queda bloqueada en el ringbuffer, no en un bucle activo.
+ */
+size_t OneWireMakita::rmtCapture(size_t count, uint16_t* low_us, size_t cap) {
+    // Descarta capturas antiguas que hayan quedado en el ringbuffer
+    size_t stale_size = 0;
+    void* stale;
+    while ((stale = xRingbufferReceive(_rmt_rb, &stale_size, 0)) != nullptr) vRingbufferReturnItem(_rmt_rb, stale);
+
+    rmt_rx_start(_rmt_rx, true);
+    rmt_write_items(_rmt_tx, _items, count, true);
+
+    size_t n = 0;
+    size_t rx_size = 0;
+    rmt_item32_t* rx = (rmt_item32_t*)xRingbufferReceive(_rmt_rb, &rx_size, pdMS_TO_TICKS(RMT_RX_TIMEOUT_MS));
+    rmt_rx_stop(_rmt_rx);
+    if (rx == nullptr) return 0;
+
+    size_t items = rx_size / sizeof(rmt_item32_t);
+    for (size_t i = 0; i < items && n < cap; i++) {
+        if (rx[i].level0 == 0) low_us[n++] = rx[i].duration0;
+        else if (rx[i].level1 == 0 && rx[i].duration1 > 0) low_us[n++] = rx[i].duration1;
+    }
+    vRingbufferReturnItem(_rmt_rb, rx);
+    return n;
+}
+
+/**
+ * Reinicio con RMT: el primer tramo BAJO capturado es nuestro propio pulso;
+ * cualquier tramo BAJO posterior dentro de la ventana es el pulso de presencia.
+ */
+bool OneWireMakita::rmtReset() {
+    // 1. Verificación de bus en reposo (debe estar ALTO por el pull-up)
+    if (gpio_get_level(_pin) == 0) return false;
+
+    rmtLoad(OneWireMakitaEncoder::encodeReset(_symbols, 1));
+    uint16_t lows[4];
+    size_t n = rmtCapture(1, lows, 4);
+    bool presence = (n >= 2);
+
+    // 2. Verificación de recuperación: El bus DEBE volver a ALTO.
+    if (gpio_get_level(_pin) == 0) presence = false;
+    return presence;
+}
+
+/**
+ * Escritura con RMT en tramas de hasta RMT_TX_CHUNK_BYTES bytes.
+ * Entre tramas la línea queda en ALTO (idle), lo que solo alarga el tiempo de recuperación.
+ */
+void OneWireMakita::rmtWrite(const uint8_t* data, uint8_t len, uint16_t gap_us) {
+    for (uint8_t off = 0; off < len; off += RMT_TX_CHUNK_BYTES) {
+        uint8_t chunk = (len - off < RMT_TX_CHUNK_BYTES) ? (len - off) : RMT_TX_CHUNK_BYTES;
+        size_t n = OneWireMakitaEncoder::encodeWrite(data + off, chunk, gap_us, _symbols,
+                                                     sizeof(_symbols) / sizeof(_symbols[0]));
+        rmt_write_items(_rmt_tx, _items, rmtLoad(n), true);
+    }
+}
+
+/**
+ * Lectura con RMT en capturas de hasta RMT_RX_CHUNK_BYTES bytes.
+ * Si la captura se pierde, los bytes quedan a 0xFF (igual que un bus en reposo).
+ */
+void OneWireMakita::rmtRead(uint8_t* data, uint8_t len, uint16_t gap_us) {
+    uint16_t lows[OneWireMakitaEncoder::RX_CHUNK_SYMBOLS];
+    for (uint8_t off = 0; off < len; off += RMT_RX_CHUNK_BYTES) {
+        uint8_t chunk = (len - off < RMT_RX_CHUNK_BYTES) ? (len - off) : RMT_RX_CHUNK_BYTES;
+        size_t n = OneWireMakitaEncoder::encodeRead(chunk, gap_us, _symbols,
+                                                    sizeof(_symbols) / sizeof(_symbols[0]));
+        size_t got = rmtCapture(rmtLoad(n), lows, n);
+        memset(data + off, 0xFF, chunk);
+        OneWireMakitaEncoder::decodeRead(lows, got, data + off, chunk);
+    }
+}
+
+// --- Motor bit-bang (respaldo) ---
+
+/**
+ * Implementación del reinicio (reset) del bus.
+ */
+bool OneWireMakita::bitbangReset() {
     // 1. Verificación de bus en reposo (debe estar ALTO por el pull-up)
     pinMode(_pin, INPUT_PULLUP);
     if (digitalRead(_pin) == LOW) {
         // El bus está en corto a tierra o el pin está flotando sin pull-up efectivo
-        return false; 
+        return false;
     }
-    
+
     pinMode(_pin, OUTPUT_OPEN_DRAIN);
-    
+
     portENTER_CRITICAL(&oneWireMux);
-    digitalWrite(_pin, LOW); 
+    uint32_t c0 = ESP.getCycleCount();
+    digitalWrite(_pin, LOW);
+    uint32_t c1 = ESP.getCycleCount();
     portEXIT_CRITICAL(&oneWireMux);
+    noteCritical(c1 - c0);
 
-    delayMicroseconds(TIME_RESET_PULSE); 
+    delayMicroseconds(TIME_RESET_PULSE);
 
     portENTER_CRITICAL(&oneWireMux);
+    c0 = ESP.getCycleCount();
     digitalWrite(_pin, HIGH);           // Soltamos el bus
-    delayMicroseconds(TIME_RESET_WAIT);  
+    delayMicroseconds(TIME_RESET_WAIT);
     bool presence = !digitalRead(_pin);  // Leemos el pulso de presencia
+    c1 = ESP.getCycleCount();
     portEXIT_CRITICAL(&oneWireMux);
+    noteCritical(c1 - c0);
+
+    delayMicroseconds(TIME_RESET_SLOT);
 
-    delayMicroseconds(TIME_RESET_SLOT); 
-    
     // 2. Verificación de recuperación: El bus DEBE volver a ALTO.
     // Si sigue en BAJO después del slot, es un falso positivo por pin flotante.
     if (digitalRead(_pin) == LOW) {
-        presence = false; 
+        presence = false;
     }
 
     return presence;
@@ -57,21 +266,27 @@ bool OneWireMakita::reset(void) {
 /**
  * Envía un byte completo manejando los tiempos críticos de cada bit.
  */
-void OneWireMakita::write(uint8_t v) {
+void OneWireMakita::bitbangWrite(uint8_t v) {
     for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
         if (bitMask & v) { // Escritura de un '1' lógico
             portENTER_CRITICAL(&oneWireMux);
-            digitalWrite(_pin, LOW); 
+            uint32_t c0 = ESP.getCycleCount();
+            digitalWrite(_pin, LOW);
             delayMicroseconds(TIME_WRITE1_LOW); // Pulso corto
             digitalWrite(_pin, HIGH);
+            uint32_t c1 = ESP.getCycleCount();
             portEXIT_CRITICAL(&oneWireMux);
+            noteCritical(c1 - c0);
             delayMicroseconds(TIME_WRITE1_HIGH);
         } else { // Escritura de un '0' lógico
             portENTER_CRITICAL(&oneWireMux);
-            digitalWrite(_pin, LOW); 
+            uint32_t c0 = ESP.getCycleCount();
+            digitalWrite(_pin, LOW);
             delayMicroseconds(TIME_WRITE0_LOW); // Pulso largo
             digitalWrite(_pin, HIGH);
+            uint32_t c1 = ESP.getCycleCount();
             portEXIT_CRITICAL(&oneWireMux);
+            noteCritical(c1 - c0);
             delayMicroseconds(TIME_WRITE0_HIGH);
         }
     }
@@ -80,18 +295,21 @@ void OneWireMakita::write(uint8_t v) {
 /**
  * Lee un byte completo del bus mediante muestreo rápido tras el pulso de inicio.
  */
-uint8_t OneWireMakita::read() {
+uint8_t OneWireMakita::bitbangRead() {
     uint8_t result = 0;
     for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
         portENTER_CRITICAL(&oneWireMux);
-        digitalWrite(_pin, LOW); 
+        uint32_t c0 = ESP.getCycleCount();
+        digitalWrite(_pin, LOW);
         delayMicroseconds(TIME_READ_PULSE); // Generamos el pulso de inicio de lectura
-        digitalWrite(_pin, HIGH); 
+        digitalWrite(_pin, HIGH);
         delayMicroseconds(TIME_READ_SAMPLE); // Esperamos a que el BMS fije el dato
         if (digitalRead(_pin)) {
             result |= bitMask; // El bus está en alto -> bit es '1'
         }
+        uint32_t c1 = ESP.getCycleCount();
         portEXIT_CRITICAL(&oneWireMux);
+        noteCritical(c1 - c0);
         delayMicroseconds(TIME_READ_SLOT); // Completamos el slot de tiempo del bit
     }
     return result;
@@ -4,56 +4,134 @@
 #define OneWireMakita_h
 
 #include <Arduino.h>
+#include <driver/rmt.h>
+#include "OneWireMakitaEncoder.h"
+#include "MakitaBus.h"
+
+// Canales RMT por defecto. En el ESP32-C3 los canales 0-1 solo transmiten y los 2-3 solo reciben.
+#ifndef ONEWIRE_MAKITA_RMT_TX_CHANNEL
+#define ONEWIRE_MAKITA_RMT_TX_CHANNEL RMT_CHANNEL_0
+#endif
+#ifndef ONEWIRE_MAKITA_RMT_RX_CHANNEL
+#define ONEWIRE_MAKITA_RMT_RX_CHANNEL RMT_CHANNEL_2
+#endif
 
 /**
  * Clase para la implementación del protocolo OneWire (Bus de un solo hilo).
  * Ha sido adaptada específicamente para los tiempos y niveles lógicos de las baterías Makita.
+ *
+ * Dispone de dos motores:
+ *  - RMT: el periférico emite y muestrea tramas completas; la CPU queda libre mientras dura.
+ *  - BITBANG: digitalWrite + delayMicroseconds dentro de secciones críticas (respaldo).
+ *
+ * Las constantes TIME_* (heredadas de OneWireMakitaTiming) definen la "física" del bus
+ * para ambos motores.
+ *
+ * También controla la línea de alimentación del BMS (enable), que forma parte de MakitaBus.
  */
-class OneWireMakita
+class OneWireMakita : public MakitaBus, public OneWireMakitaTiming
 {
   public:
-    // --- Constantes de Tiempo (en microsegundos) ---
-    // Estas constantes definen la "física" del bus para que el BMS reconozca la señal.
-    
-    // Tiempos para el ciclo de Reinicio (Reset)
-    static constexpr uint16_t TIME_RESET_PULSE = 750; // Pulso bajo para resetear esclavos
-    static constexpr uint16_t TIME_RESET_WAIT  = 70;  // Espera antes de leer presencia
-    static constexpr uint16_t TIME_RESET_SLOT  = 410; // Tiempo para completar el slot
-    
-    // Tiempos para la escritura de bits
-    static constexpr uint16_t TIME_WRITE1_LOW  = 12;  // Pulso corto para un '1' lógico
-    static constexpr uint16_t TIME_WRITE1_HIGH = 120; // Recuperación tras un '1'
-    static constexpr uint16_t TIME_WRITE0_LOW  = 100; // Pulso largo para un '0' lógico
-    static constexpr uint16_t TIME_WRITE0_HIGH = 30;  // Recuperación tras un '0'
-    
-    // Tiempos para la lectura de bits
-    static constexpr uint16_t TIME_READ_PULSE  = 10;  // Pulso de inicio de lectura
-    static constexpr uint16_t TIME_READ_SAMPLE = 10;  // Espera antes de muestrear el bit
-    static constexpr uint16_t TIME_READ_SLOT   = 53;  // Tiempo para completar el slot de lectura
-
-    /**
-     * Constructor: Inicializa el bus en el pin indicado.
-     */
-    OneWireMakita(uint8_t pin);
-    
+    enum class Backend : uint8_t { BITBANG, RMT };
+
+    static constexpr uint8_t NO_ENABLE_PIN = 0xFF;
+
+    /**
+     * Constructor: Inicializa el bus en el pin indicado (modo bit-bang hasta llamar a begin())
+     * y deja el BMS apagado si se indica el pin de alimentación.
+     */
+    OneWireMakita(uint8_t pin,
+                  uint8_t enable_pin = NO_ENABLE_PIN,
+                  rmt_channel_t tx_channel = ONEWIRE_MAKITA_RMT_TX_CHANNEL,
+                  rmt_channel_t rx_channel = ONEWIRE_MAKITA_RMT_RX_CHANNEL);
+
+    /**
+     * Selecciona el motor del bus. Si el RMT no puede instalarse se queda en bit-bang.
+     * Debe llamarse desde setup() (no desde constructores globales).
+     * @return el motor efectivamente activo.
+     */
+    Backend begin(Backend preferred);
+
+    /**
+     * MakitaBus: RMT salvo que se compile con -DONEWIRE_MAKITA_FORCE_BITBANG.
+     */
+    bool begin() override;
+    const char* name() const override;
+
+    Backend backend() const { return _backend; }
+
     /**
      * Realiza un pulso de reinicio y verifica si hay una batería (Presence Pulse).
      * @return true si se detecta respuesta del BMS.
      */
-    bool reset(void);
+    bool reset(void) override;
 
     /**
      * Envía un byte completo al bus, bit a bit.
      */
-    void write(uint8_t v);
+    void write(uint8_t v) override;
 
     /**
      * Lee un byte completo del bus, bit a bit.
      */
-    uint8_t read(void);
+    uint8_t read(void) override;
+
+    /**
+     * Envía una secuencia de bytes con gap_us de separación tras cada byte.
+     * Con RMT la secuencia se emite como una sola trama.
+     */
+    void writeBytes(const uint8_t* data, uint8_t len, uint16_t gap_us) override;
+
+    /**
+     * Lee una secuencia de bytes con gap_us de separación tras cada byte.
+     */
+    void readBytes(uint8_t* data, uint8_t len, uint16_t gap_us) override;
+
+    /**
+     * Alimentación del BMS (directo, HIGH = encendido).
+     */
+    void setPower(bool on) override;
+
+    /**
+     * Duración de cada sección crítica del bit-bang (contador de ciclos de la CPU).
+     * Con el motor RMT no hay secciones críticas y el histograma queda vacío.
+     */
+    const LatencyHistogram* criticalSections() const override { return &_critical; }
+    void clearCriticalSections() override { _critical.clear(); }
 
   private:
+    // Tamaño de trama TX / captura RX (definidos en OneWireMakitaEncoder, probados en el host)
+    static constexpr uint8_t RMT_TX_CHUNK_BYTES = OneWireMakitaEncoder::TX_CHUNK_BYTES;
+    static constexpr uint8_t RMT_RX_CHUNK_BYTES = OneWireMakitaEncoder::RX_CHUNK_BYTES;
+    static constexpr uint16_t RMT_RX_IDLE_US    = 300;  // Fin de captura: línea en ALTO este tiempo
+    static constexpr uint8_t RMT_RX_FILTER_TICKS = 30;  // Filtro de glitches (ciclos APB)
+    static constexpr size_t RMT_RX_RINGBUF_SIZE = 1024;
+    static constexpr uint32_t RMT_RX_TIMEOUT_MS = 20;
+
     gpio_num_t _pin; // Pin físico configurado en modo Open-Drain
+    uint8_t _enable_pin;
+    Backend _backend = Backend::BITBANG;
+    LatencyHistogram _critical;
+    uint32_t _cycles_per_us = 160;
+
+    // Estado del motor RMT
+    rmt_channel_t _rmt_tx;
+    rmt_channel_t _rmt_rx;
+    RingbufHandle_t _rmt_rb = nullptr;
+    rmt_item32_t _items[OneWireMakitaEncoder::TX_CHUNK_SYMBOLS];
+    OneWireMakitaSymbol _symbols[OneWireMakitaEncoder::TX_CHUNK_SYMBOLS];
+
+    bool rmtInit();
+    size_t rmtLoad(size_t count);
+    size_t rmtCapture(size_t count, uint16_t* low_us, size_t cap);
+    bool rmtReset();
+    void rmtWrite(const uint8_t* data, uint8_t len, uint16_t gap_us);
+    void rmtRead(uint8_t* data, uint8_t len, uint16_t gap_us);
+
+    bool bitbangReset();
+    void bitbangWrite(uint8_t v);
+    uint8_t bitbangRead();
+    void noteCritical(uint32_t cycles) { _critical.add(cycles / _cycles_per_us); }
 };
 
-#endif
\ No newline at end of file
+#endif
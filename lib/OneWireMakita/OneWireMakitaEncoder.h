@@ -0,0 +1,143 @@
+// lib/OneWireMakita/OneWireMakitaEncoder.h - CODIFICACIÓN DE SLOTS (INDEPENDIENTE DEL HARDWARE)
+
+#ifndef OneWireMakitaEncoder_h
+#define OneWireMakitaEncoder_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Tabla de tiempos del bus (en microsegundos).
+ * Vive aquí, sin dependencias de Arduino, para que el codificador pueda compilarse en el host.
+ * OneWireMakita hereda de esta estructura, por lo que OneWireMakita::TIME_* sigue siendo válido.
+ */
+struct OneWireMakitaTiming
+{
+    // Tiempos para el ciclo de Reinicio (Reset)
+    static constexpr uint16_t TIME_RESET_PULSE = 750; // Pulso bajo para resetear esclavos
+    static constexpr uint16_t TIME_RESET_WAIT  = 70;  // Espera antes de leer presencia
+    static constexpr uint16_t TIME_RESET_SLOT  = 410; // Tiempo para completar el slot
+
+    // Tiempos para la escritura de bits
+    static constexpr uint16_t TIME_WRITE1_LOW  = 12;  // Pulso corto para un '1' lógico
+    static constexpr uint16_t TIME_WRITE1_HIGH = 120; // Recuperación tras un '1'
+    static constexpr uint16_t TIME_WRITE0_LOW  = 100; // Pulso largo para un '0' lógico
+    static constexpr uint16_t TIME_WRITE0_HIGH = 30;  // Recuperación tras un '0'
+
+    // Tiempos para la lectura de bits
+    static constexpr uint16_t TIME_READ_PULSE  = 10;  // Pulso de inicio de lectura
+    static constexpr uint16_t TIME_READ_SAMPLE = 10;  // Espera antes de muestrear el bit
+    static constexpr uint16_t TIME_READ_SLOT   = 53;  // Tiempo para completar el slot de lectura
+};
+
+/**
+ * Un símbolo del bus: un tramo en BAJO seguido de un tramo en ALTO.
+ * Corresponde 1:1 con un rmt_item32_t (level0 = 0, level1 = 1) a 1 tick = 1 µs.
+ */
+struct OneWireMakitaSymbol
+{
+    uint16_t low_us;
+    uint16_t high_us;
+};
+
+/**
+ * Genera el flujo de símbolos de una trama completa a partir de la tabla de tiempos.
+ * Es la misma secuencia que produce el modo bit-bang, pero calculada de antemano para
+ * que un periférico (RMT) la emita sin intervención de la CPU.
+ */
+class OneWireMakitaEncoder : public OneWireMakitaTiming
+{
+  public:
+    // Símbolos necesarios para codificar un byte (un slot por bit, LSB primero)
+    static constexpr size_t SYMBOLS_PER_BYTE = 8;
+
+    // Tramas del motor RMT: 8 bytes por escritura (64 símbolos) y 4 bytes por captura
+    // (32 símbolos). Con mem_block_num = 1 el bloque del C3 tiene 48 palabras: la captura
+    // RX cabe entera y el driver TX rellena el bloque sobre la marcha para los 64 símbolos.
+    static constexpr size_t TX_CHUNK_BYTES   = 8;
+    static constexpr size_t RX_CHUNK_BYTES   = 4;
+    static constexpr size_t TX_CHUNK_SYMBOLS = TX_CHUNK_BYTES * SYMBOLS_PER_BYTE;
+    static constexpr size_t RX_CHUNK_SYMBOLS = RX_CHUNK_BYTES * SYMBOLS_PER_BYTE;
+
+    /**
+     * Pulso de reinicio: BAJO durante TIME_RESET_PULSE y ventana de presencia en ALTO.
+     * @return número de símbolos escritos (1) o 0 si no hay espacio.
+     */
+    static size_t encodeReset(OneWireMakitaSymbol* out, size_t cap) {
+        if (cap < 1) return 0;
+        out[0].low_us  = TIME_RESET_PULSE;
+        out[0].high_us = TIME_RESET_WAIT + TIME_RESET_SLOT;
+        return 1;
+    }
+
+    /**
+     * Codifica los bytes a escribir. gap_us se añade al tramo ALTO del último bit de cada
+     * byte (equivale al delayMicroseconds() entre bytes del modo bit-bang).
+     * @return número de símbolos escritos o 0 si el buffer es demasiado pequeño.
+     */
+    static size_t encodeWrite(const uint8_t* data, size_t len, uint16_t gap_us,
+                              OneWireMakitaSymbol* out, size_t cap) {
+        if (len * SYMBOLS_PER_BYTE > cap) return 0;
+        size_t n = 0;
+        for (size_t i = 0; i < len; i++) {
+            for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+                if (data[i] & bitMask) {
+                    out[n].low_us  = TIME_WRITE1_LOW;
+                    out[n].high_us = TIME_WRITE1_HIGH;
+                } else {
+                    out[n].low_us  = TIME_WRITE0_LOW;
+                    out[n].high_us = TIME_WRITE0_HIGH;
+                }
+                n++;
+            }
+            out[n - 1].high_us += gap_us;
+        }
+        return n;
+    }
+
+    /**
+     * Codifica los slots de lectura para len bytes. El BMS alarga el tramo BAJO
+     * cuando responde con un '0'; el tramo ALTO cubre muestreo + fin de slot.
+     */
+    static size_t encodeRead(size_t len, uint16_t gap_us, OneWireMakitaSymbol* out, size_t cap) {
+        if (len * SYMBOLS_PER_BYTE > cap) return 0;
+        size_t n = 0;
+        for (size_t i = 0; i < len; i++) {
+            for (uint8_t b = 0; b < 8; b++) {
+                out[n].low_us  = TIME_READ_PULSE;
+                out[n].high_us = TIME_READ_SAMPLE + TIME_READ_SLOT;
+                n++;
+            }
+            out[n - 1].high_us += gap_us;
+        }
+        return n;
+    }
+
+    /**
+     * Interpreta la duración medida del tramo BAJO de un slot de lectura.
+     * El modo bit-bang muestrea a TIME_READ_PULSE + TIME_READ_SAMPLE del flanco de bajada:
+     * si la línea sigue en BAJO en ese instante, el bit es '0'.
+     */
+    static bool decodeReadBit(uint16_t measured_low_us) {
+        return measured_low_us < (uint16_t)(TIME_READ_PULSE + TIME_READ_SAMPLE);
+    }
+
+    /**
+     * Reconstruye bytes (LSB primero) a partir de las duraciones BAJAS medidas.
+     * @return número de bytes completos decodificados.
+     */
+    static size_t decodeRead(const uint16_t* measured_low_us, size_t count, uint8_t* out, size_t len) {
+        size_t bytes = count / SYMBOLS_PER_BYTE;
+        if (bytes > len) bytes = len;
+        for (size_t i = 0; i < bytes; i++) {
+            uint8_t v = 0;
+            for (uint8_t b = 0; b < 8; b++) {
+                if (decodeReadBit(measured_low_us[i * SYMBOLS_PER_BYTE + b])) v |= (uint8_t)(1 << b);
+            }
+            out[i] = v;
+        }
+        return bytes;
+    }
+};
+
+#endif
@@ -0,0 +1,499 @@
+// src/BMSWorker.cpp - DEDICATED BUS TASK
+
+#include "BMSWorker.h"
+
+const char* commandName(BMSCommand cmd) {
+    switch (cmd) {
+        case BMSCommand::PRESENCE:     return "presence";
+        case BMSCommand::READ_STATIC:  return "read_static";
+        case BMSCommand::READ_DYNAMIC: return "read_dynamic";
+        case BMSCommand::LED_ON:       return "led_on";
+        case BMSCommand::LED_OFF:      return "led_off";
+        case BMSCommand::CLEAR_ERRORS: return "clear_errors";
+        case BMSCommand::AUTO_DETECT:  return "auto_detect";
+        case BMSCommand::AUTO_POLL:    return "auto_poll";
+        case BMSCommand::LIVE_START:   return "live_start";
+        case BMSCommand::LIVE_STOP:    return "live_stop";
+        case BMSCommand::LIVE_SAMPLE:  return "live_sample";
+        default: return "unknown";
+    }
+}
+
+const char* liveStopReasonName(LiveStopReason reason) {
+    switch (reason) {
+        case LiveStopReason::REQUESTED:    return "requested";
+        case LiveStopReason::IDLE_TIMEOUT: return "idle_timeout";
+        case LiveStopReason::MAX_DURATION: return "max_duration";
+        case LiveStopReason::WATCHDOG:     return "watchdog";
+        case LiveStopReason::FAILURES:     return "failures";
+        case LiveStopReason::PREEMPTED:    return "preempted";
+        default: return "unknown";
+    }
+}
+
+// Reads that return the same data, so one can answer the others (0 = not shareable)
+static uint8_t readClass(BMSCommand cmd) {
+    switch (cmd) {
+        case BMSCommand::READ_DYNAMIC:
+        case BMSCommand::AUTO_POLL:
+        case BMSCommand::LIVE_SAMPLE:
+            return 1;
+        case BMSCommand::READ_STATIC:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+int8_t BMSWorker::addBay(MakitaBMS& bms) {
+    if (_bay_count >= MAX_BAYS || _task) return -1;
+    _bays[_bay_count].bms = &bms;
+    return (int8_t)_bay_count++;
+}
+
+bool BMSWorker::begin(uint32_t stack_size, UBaseType_t priority) {
+    if (_bay_count == 0) return false;
+    _commands = xQueueCreate(QUEUE_DEPTH, sizeof(BMSJob*));
+    // Room for a burst (every bay finishing a job and stopping a live session); publish()
+    // blocks beyond that until loop() catches up
+    _results = xQueueCreate(QUEUE_DEPTH + 2 * MAX_BAYS, sizeof(BMSJob*));
+    if (!_commands || !_results) return false;
+    for (uint8_t i = 0; i < _bay_count; i++) {
+        _bays[i].bms->setCompletionCallback([this, i](BMSOperation op, BMSStatus status, const BatteryData&) {
+            onComplete(i, op, status);
+        });
+    }
+    return xTaskCreate(taskEntry, "bms_worker", stack_size, this, priority, &_task) == pdPASS;
+}
+
+bool BMSWorker::submit(BMSCommand cmd, uint8_t bay, uint32_t client_id, uint16_t param) {
+    if (bay >= _bay_count) {
+        countSubmit(false);
+        return false;
+    }
+    BMSJob* job = new BMSJob();
+    job->command = cmd;
+    job->bay = bay;
+    job->client_id = client_id;
+    job->param = param;
+    job->enqueued_ms = millis();
+    if (xQueueSend(_commands, &job, 0) != pdTRUE) {
+        delete job;
+        countSubmit(false);
+        return false;
+    }
+    countSubmit(true);
+    return true;
+}
+
+/**
+ * submit() runs on the AsyncTCP task and on loop(), and the worker rejects jobs too,
+ * so the counters they share are only updated inside _stats_mux.
+ */
+void BMSWorker::countSubmit(bool accepted) {
+    uint8_t depth = accepted ? pending() : 0;
+    portENTER_CRITICAL(&_stats_mux);
+    if (accepted) {
+        _stats.submitted++;
+        if (depth > _stats.max_depth) _stats.max_depth = depth;
+    } else {
+        _stats.rejected++;
+    }
+    portEXIT_CRITICAL(&_stats_mux);
+}
+
+BMSJob* BMSWorker::poll() {
+    BMSJob* job = nullptr;
+    if (_results && xQueueReceive(_results, &job, 0) == pdTRUE) return job;
+    return nullptr;
+}
+
+uint8_t BMSWorker::pending() const {
+    if (!_commands) return 0;
+    return (uint8_t)uxQueueMessagesWaiting(_commands) + _backlogged + _running;
+}
+
+void BMSWorker::taskEntry(void* arg) {
+    static_cast<BMSWorker*>(arg)->run();
+}
+
+/**
+ * Worker loop: advances every bay whose deadline has passed, starts the next job on
+ * idle bays, then sleeps until the earliest bay deadline (or live sample slot) or
+ * until a new command arrives. Power-on waits cost no CPU and overlap across bays.
+ */
+void BMSWorker::run() {
+    for (;;) {
+        uint32_t wait_ms = UINT32_MAX;
+        for (uint8_t i = 0; i < _bay_count; i++) {
+            Bay& b = _bays[i];
+            if (b.job) b.bms->poll();
+            if (!b.job) startNext(i);
+            if (b.job) {
+                uint32_t ms = b.bms->msUntilNextStep();
+                if (ms < wait_ms) wait_ms = ms;
+            } else if (b.live) {
+                int32_t due = (int32_t)(b.live_next_ms - millis());
+                uint32_t ms = due > 0 ? (uint32_t)due : 0;
+                if (ms < wait_ms) wait_ms = ms;
+            }
+        }
+        TickType_t wait = portMAX_DELAY;
+        if (wait_ms != UINT32_MAX) {
+            wait = pdMS_TO_TICKS(wait_ms);
+            if (wait == 0) wait = 1;  // let lower-priority tasks run between steps
+        }
+        BMSJob* job = nullptr;
+        if (xQueueReceive(_commands, &job, wait) == pdTRUE) enqueue(job);
+    }
+}
+
+/**
+ * Moves a submitted job to its bay's backlog. A full backlog rejects the job.
+ */
+void BMSWorker::enqueue(BMSJob* job) {
+    Bay& b = _bays[job->bay];
+    if (share(b, job)) return;
+    if (b.backlog_len >= QUEUE_DEPTH) {
+        reject(job);
+        return;
+    }
+    b.backlog[(b.backlog_head + b.backlog_len) % QUEUE_DEPTH] = job;
+    b.backlog_len++;
+    _backlogged++;
+}
+
+/**
+ * Publishes a job that will not run, with ERROR_BUSY.
+ */
+void BMSWorker::reject(BMSJob* job) {
+    job->status = BMSStatus::ERROR_BUSY;
+    job->started_ms = millis();
+    countSubmit(false);
+    publish(job);
+}
+
+/**
+ * Single flight: a read that matches one already running or waiting on the bay rides on
+ * it and is published with its result; otherwise, inside the freshness window, it is
+ * answered from the worker's copy. Either way it costs no bus time, so bus occupancy
+ * does not grow with the number of dashboards. At most MAX_FOLLOWERS ride on one read;
+ * further ones are rejected rather than growing the chain. Returns true if the job
+ * was taken.
+ */
+bool BMSWorker::share(Bay& b, BMSJob* job) {
+    uint8_t cls = readClass(job->command);
+    if (!cls) return false;
+
+    BMSJob* leader = (b.job && readClass(b.job->command) == cls) ? b.job : nullptr;
+    for (uint8_t i = 0; !leader && i < b.backlog_len; i++) {
+        BMSJob* queued = b.backlog[(b.backlog_head + i) % QUEUE_DEPTH];
+        if (readClass(queued->command) == cls) leader = queued;
+    }
+    if (leader) {
+        BMSJob** tail = &leader->followers;
+        uint8_t followers = 0;
+        for (; *tail; tail = &(*tail)->followers) followers++;
+        if (followers >= MAX_FOLLOWERS) {
+            reject(job);
+            return true;
+        }
+        *tail = job;
+        job->shared = true;
+        _stats.merged++;
+        return true;
+    }
+
+    uint32_t at = (cls == 2) ? b.static_ms : b.dynamic_ms;
+    uint32_t fresh_ms = _fresh_ms;
+    if (fresh_ms == 0 || at == 0 || millis() - at >= fresh_ms) return false;
+    job->shared = true;
+    job->started_ms = millis();
+    job->status = BMSStatus::OK;
+    job->present = true;
+    job->data = b.data;
+    job->features = b.features;
+    _stats.cache_hits++;
+    publish(job);
+    return true;
+}
+
+/**
+ * Starts the oldest backlogged job of an idle bay; queued commands go before live
+ * samples. During a live session a sample is started once its slot is due.
+ */
+void BMSWorker::startNext(uint8_t bay) {
+    Bay& b = _bays[bay];
+    BMSJob* job = nullptr;
+    if (b.backlog_len > 0) {
+        job = b.backlog[b.backlog_head];
+        b.backlog_head = (b.backlog_head + 1) % QUEUE_DEPTH;
+        b.backlog_len--;
+        _backlogged--;
+    } else if (b.live && (int32_t)(millis() - b.live_next_ms) >= 0) {
+        job = nextLiveSample(bay);
+    }
+    if (!job) return;
+    b.job = job;
+    _running++;
+    job->started_ms = millis();
+    start(bay, job);
+}
+
+/**
+ * Starts the first bus operation of a job. Jobs the BMS rejects up front
+ * (not identified, not available) complete immediately.
+ */
+void BMSWorker::start(uint8_t bay, BMSJob* job) {
+    Bay& b = _bays[bay];
+    MakitaBMS& bms = *b.bms;
+    BMSStatus status = BMSStatus::OK;
+    bool immediate = false;  // finished without touching the bus
+    switch (job->command) {
+        case BMSCommand::PRESENCE:
+            status = bms.beginPresence();
+            break;
+        case BMSCommand::READ_STATIC:
+            b.fresh = BatteryData();
+            status = bms.beginStaticRead(b.fresh, job->features);
+            break;
+        case BMSCommand::AUTO_DETECT:
+            // Gated detection: a presence probe first; identification only if a pack answers
+            if (job->param == DETECT_GATED) {
+                status = bms.beginPresence(true);
+            } else {
+                b.fresh = BatteryData();
+                status = bms.beginIdentifyAndSample(b.fresh, job->features);
+            }
+            break;
+        case BMSCommand::READ_DYNAMIC:
+        case BMSCommand::AUTO_POLL:
+            // Inside a live session the BMS is already powered: take a sample instead
+            status = b.live ? bms.beginLiveSample(b.data) : bms.beginDynamicRead(b.data);
+            break;
+        case BMSCommand::LED_ON:
+            status = bms.beginLedTest(true);
+            break;
+        case BMSCommand::LED_OFF:
+            status = bms.beginLedTest(false);
+            break;
+        case BMSCommand::CLEAR_ERRORS:
+            status = bms.beginClearErrors();
+            break;
+        case BMSCommand::LIVE_START:
+            if (b.live) {
+                setLiveRate(b, job->param);
+                immediate = true;
+            } else {
+                status = bms.beginLiveSession(b.data);
+            }
+            job->param = b.live ? b.live_hz : job->param;
+            break;
+        case BMSCommand::LIVE_STOP:
+            // Idempotent: stopping an idle bus just confirms the power is off
+            if (b.live) {
+                bms.endLiveSession();
+                b.live = false;
+            }
+            immediate = true;
+            break;
+        case BMSCommand::LIVE_SAMPLE:
+            status = bms.beginLiveSample(b.data);
+            break;
+        default:
+            break;
+    }
+
+    // Any operation that power-cycles the BMS closes the session inside MakitaBMS
+    bool preempted = b.live && !bms.liveActive();
+    if (preempted) b.live = false;
+
+    if (status != BMSStatus::OK || immediate) {
+        job->status = status;
+        job->data = b.data;
+        complete(bay);
+    }
+    if (preempted) stopLive(bay, LiveStopReason::PREEMPTED);
+}
+
+/**
+ * Clamps the requested live rate to LIVE_MIN_HZ..LIVE_MAX_HZ.
+ */
+void BMSWorker::setLiveRate(Bay& b, uint16_t hz) {
+    if (hz < LIVE_MIN_HZ) hz = LIVE_MIN_HZ;
+    if (hz > LIVE_MAX_HZ) hz = LIVE_MAX_HZ;
+    b.live_hz = (uint8_t)hz;
+    b.live_interval_ms = 1000 / hz;
+}
+
+/**
+ * Builds the next live sample job, or ends the session when a safety limit is hit.
+ * Samples are fixed-rate; after a stall the schedule restarts instead of bursting.
+ */
+BMSJob* BMSWorker::nextLiveSample(uint8_t bay) {
+    Bay& b = _bays[bay];
+    uint32_t now = millis();
+    if (b.bms->liveTripped()) {
+        stopLive(bay, LiveStopReason::WATCHDOG);
+        return nullptr;
+    }
+    if (now - b.live_started_ms >= LIVE_MAX_SESSION_MS) {
+        stopLive(bay, LiveStopReason::MAX_DURATION);
+        return nullptr;
+    }
+    b.live_next_ms += b.live_interval_ms;
+    if ((int32_t)(now - b.live_next_ms) >= 0) b.live_next_ms = now + b.live_interval_ms;
+
+    BMSJob* job = new BMSJob();
+    job->command = BMSCommand::LIVE_SAMPLE;
+    job->bay = bay;
+    job->enqueued_ms = now;
+    return job;
+}
+
+/**
+ * Powers the bay's BMS down and reports the end of the session as a LIVE_STOP result.
+ */
+void BMSWorker::stopLive(uint8_t bay, LiveStopReason reason) {
+    Bay& b = _bays[bay];
+    if (b.bms->liveActive()) b.bms->endLiveSession();
+    b.live = false;
+    BMSJob* job = new BMSJob();
+    job->command = BMSCommand::LIVE_STOP;
+    job->bay = bay;
+    job->param = (uint16_t)reason;
+    job->enqueued_ms = job->started_ms = millis();
+    job->data = b.data;
+    publish(job);
+}
+
+/**
+ * Completion callback of a bay's BMS state machine (runs inside its poll()).
+ */
+void BMSWorker::onComplete(uint8_t bay, BMSOperation op, BMSStatus status) {
+    Bay& b = _bays[bay];
+    BMSJob* job = b.job;
+    if (!job) return;
+
+    switch (job->command) {
+        case BMSCommand::PRESENCE:
+            job->status = status;
+            job->present = (status == BMSStatus::OK);
+            break;
+        case BMSCommand::AUTO_DETECT:
+            if (op == BMSOperation::PRESENCE) {
+                job->present = (status == BMSStatus::OK);
+                if (job->present) {
+                    // The probe left the BMS powered: identify in the same window
+                    b.fresh = BatteryData();
+                    BMSStatus ident = b.bms->beginIdentifyAndSample(b.fresh, job->features);
+                    if (ident == BMSStatus::OK) return;  // job continues
+                    b.bms->releasePower();
+                    status = ident;
+                }
+                job->status = status;
+                break;
+            }
+            // Identification and first dynamic read ran in one IDENTIFY operation
+            job->status = status;
+            if (status == BMSStatus::OK) {
+                job->present = true;
+                b.data = b.fresh;
+                b.features = job->features;
+                b.static_ms = millis() | 1;
+                job->dynamic_status = b.bms->lastSampleStatus();
+                b.dynamic_ms = (job->dynamic_status == BMSStatus::OK) ? b.static_ms : 0;
+            }
+            break;
+        case BMSCommand::READ_STATIC:
+            job->status = status;
+            if (status == BMSStatus::OK) {
+                b.data = b.fresh;
+                b.features = job->features;
+                b.static_ms = millis() | 1;
+            } else {
+                b.static_ms = b.dynamic_ms = 0;
+            }
+            break;
+        case BMSCommand::LIVE_START:
+            job->status = status;
+            if (status == BMSStatus::OK) {
+                b.live = true;
+                b.live_fails = 0;
+                b.live_started_ms = millis();
+                setLiveRate(b, job->param);
+                job->param = b.live_hz;
+                b.live_next_ms = b.live_started_ms + b.live_interval_ms;
+            }
+            break;
+        case BMSCommand::LIVE_SAMPLE:
+        case BMSCommand::READ_DYNAMIC:
+        case BMSCommand::AUTO_POLL:
+            job->status = status;
+            if (op == BMSOperation::LIVE_SAMPLE) {
+                b.live_fails = (status == BMSStatus::OK) ? 0 : b.live_fails + 1;
+            }
+            // A failed read may mean the pack is gone: stop answering from the copy
+            if (status == BMSStatus::OK) b.dynamic_ms = millis() | 1;
+            else b.static_ms = b.dynamic_ms = 0;
+            break;
+        case BMSCommand::CLEAR_ERRORS:
+            job->status = status;
+            b.static_ms = 0;  // the status byte may have changed
+            break;
+        default:
+            job->status = status;
+            break;
+    }
+    job->data = b.data;
+    complete(bay);
+    if (b.live && b.live_fails >= LIVE_MAX_FAILS) stopLive(bay, LiveStopReason::FAILURES);
+}
+
+/**
+ * Hands the bay's current job to the result queue.
+ */
+void BMSWorker::complete(uint8_t bay) {
+    BMSJob* job = _bays[bay].job;
+    _bays[bay].job = nullptr;
+    _running--;
+    // Followers get the same result; they are detached first since loop() owns the
+    // leader once it is published
+    BMSJob* follower = job->followers;
+    job->followers = nullptr;
+    for (BMSJob* f = follower; f; f = f->followers) {
+        f->started_ms = job->started_ms;
+        f->status = job->status;
+        f->dynamic_status = job->dynamic_status;
+        f->present = job->present;
+        f->data = job->data;
+        f->features = job->features;
+    }
+    publish(job);
+    while (follower) {
+        BMSJob* next = follower->followers;
+        follower->followers = nullptr;
+        publish(follower);
+        follower = next;
+    }
+}
+
+void BMSWorker::publish(BMSJob* job) {
+    job->finished_ms = millis();
+    record(job);
+    // Nothing bounds how many results can be waiting: cache hits, merged reads and
+    // live samples are all published here. If loop() falls behind by more than the
+    // queue holds, this blocks and the worker stalls until loop() drains it. No result
+    // is dropped, and submit() starts failing once the command queue fills.
+    xQueueSend(_results, &job, portMAX_DELAY);
+}
+
+void BMSWorker::record(const BMSJob* job) {
+    CommandStats& s = _stats.commands[(size_t)job->command];
+    uint32_t latency = job->finished_ms - job->enqueued_ms;
+    s.count++;
+    s.last_ms = latency;
+    s.last_wait_ms = job->started_ms - job->enqueued_ms;
+    s.total_ms += latency;
+    if (latency > s.max_ms) s.max_ms = latency;
+}
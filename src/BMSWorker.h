@@ -0,0 +1,186 @@
+// src/BMSWorker.h - DEDICATED BUS TASK
+
+#ifndef BMS_WORKER_H
+#define BMS_WORKER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "MakitaBMS.h"
+
+#ifndef MAKITA_READ_FRESH_MS
+#define MAKITA_READ_FRESH_MS 1000   // read_static / read_dynamic answered from the last result this long
+#endif
+
+// Operations the worker can run on the bus
+enum class BMSCommand : uint8_t {
+    PRESENCE,       // power-on + reset, presence pulse only
+    READ_STATIC,    // manual identification
+    READ_DYNAMIC,   // manual voltage/temperature read
+    LED_ON,
+    LED_OFF,
+    CLEAR_ERRORS,
+    AUTO_DETECT,    // identification + first dynamic read in one power session
+    AUTO_POLL,      // periodic dynamic read while a battery is identified
+    LIVE_START,     // open a live session (param = rate in Hz); changes the rate if already open
+    LIVE_STOP,      // close the live session (param = LiveStopReason)
+    LIVE_SAMPLE,    // generated by the worker at the live rate, never submitted
+    COUNT
+};
+
+// Why a live session ended (LIVE_STOP param)
+enum class LiveStopReason : uint8_t {
+    REQUESTED,      // live_stop from a client
+    IDLE_TIMEOUT,   // no client keepalive
+    MAX_DURATION,   // hard cap on session length
+    WATCHDOG,       // BMS power cut by the MakitaBMS watchdog
+    FAILURES,       // consecutive failed samples (battery removed?)
+    PREEMPTED       // another bus operation needed a power cycle
+};
+
+const char* commandName(BMSCommand cmd);
+const char* liveStopReasonName(LiveStopReason reason);
+
+/**
+ * One unit of bus work. Allocated by submit(), travels through the command queue
+ * to the worker and back through the result queue; the consumer deletes it.
+ */
+struct BMSJob {
+    BMSCommand command;
+    uint8_t bay = 0;                          // target bay (index passed to addBay order)
+    uint32_t client_id = 0;                   // requesting WS client, 0 = internal
+    uint32_t enqueued_ms = 0;
+    uint32_t started_ms = 0;
+    uint32_t finished_ms = 0;
+    BMSStatus status = BMSStatus::OK;         // result of the main operation
+    BMSStatus dynamic_status = BMSStatus::OK; // AUTO_DETECT: result of the follow-up dynamic read
+    bool present = false;                     // PRESENCE / AUTO_DETECT: a pack answered
+    uint16_t param = 0;                       // LIVE_START: rate in Hz, LIVE_STOP: LiveStopReason,
+                                              // AUTO_DETECT: DETECT_GATED
+    BatteryData data;
+    SupportedFeatures features;
+    bool shared = false;                      // answered without a bus transaction of its own:
+                                              // merged into an identical read, or still fresh
+    BMSJob* followers = nullptr;              // reads merged into this one, published after it
+};
+
+/**
+ * Owns the MakitaBMS instances (one per bay) and runs every bus operation on its own
+ * FreeRTOS task, so the AsyncTCP callback and loop() never block on the 300 ms power-on
+ * waits. Operations use the asynchronous MakitaBMS API: the task sleeps until the
+ * earliest deadline of any bay, so one bay's power-on wait overlaps bus traffic on
+ * another. Each bay runs one job at a time; jobs for a busy bay wait in its backlog.
+ * Reads are single-flight: however many clients ask, one bus transaction answers them.
+ */
+class BMSWorker {
+public:
+    struct CommandStats {
+        uint32_t count = 0;
+        uint32_t last_ms = 0;     // enqueue -> finish of the most recent job
+        uint32_t max_ms = 0;
+        uint32_t total_ms = 0;    // for the average
+        uint32_t last_wait_ms = 0; // time spent queued before the worker picked it up
+    };
+
+    struct Stats {
+        uint32_t submitted = 0;
+        uint32_t rejected = 0;    // queue, backlog or follower chain full
+        uint32_t merged = 0;      // reads that rode on an identical one in flight
+        uint32_t cache_hits = 0;  // reads answered inside the freshness window
+        uint8_t max_depth = 0;    // high-water mark of pending commands
+        CommandStats commands[(size_t)BMSCommand::COUNT];
+    };
+
+    static constexpr uint8_t QUEUE_DEPTH = 8;
+    static constexpr uint8_t MAX_BAYS = 4;
+    static constexpr uint8_t MAX_FOLLOWERS = 4;   // reads merged into one; more get ERROR_BUSY
+
+    // AUTO_DETECT param: probe presence first and identify only if a pack answers
+    static constexpr uint16_t DETECT_GATED = 1;
+
+    // Live session limits
+    static constexpr uint8_t LIVE_MIN_HZ = 1;
+    static constexpr uint8_t LIVE_MAX_HZ = 10;
+    static constexpr uint32_t LIVE_MAX_SESSION_MS = 10UL * 60 * 1000;
+    static constexpr uint8_t LIVE_MAX_FAILS = 3;
+
+    BMSWorker() = default;
+
+    // Registers a bay before begin(); returns its index, or -1 if MAX_BAYS are in use.
+    int8_t addBay(MakitaBMS& bms);
+    uint8_t bayCount() const { return _bay_count; }
+
+    // Creates the queues and starts the task. Call from setup().
+    bool begin(uint32_t stack_size = 6144, UBaseType_t priority = 2);
+
+    // Queues a command for a bay; returns false if the queue is full or the bay is unknown.
+    bool submit(BMSCommand cmd, uint8_t bay = 0, uint32_t client_id = 0, uint16_t param = 0);
+
+    // Returns the next finished job (caller must delete it) or nullptr.
+    BMSJob* poll();
+
+    // Freshness window for read_static / read_dynamic (0 = always read the bus)
+    void setFreshness(uint32_t ms) { _fresh_ms = ms; }
+    uint32_t freshness() const { return _fresh_ms; }
+
+    uint8_t pending() const;       // commands waiting + the ones running
+    bool busy() const { return _running > 0; }
+    bool busy(uint8_t bay) const { return bay < _bay_count && _bays[bay].job != nullptr; }
+    bool liveActive(uint8_t bay) const { return bay < _bay_count && _bays[bay].live; }
+    const Stats& stats() const { return _stats; }
+
+private:
+    // Per-bay state, touched only by the worker task (busy(bay) reads `job` as a hint)
+    struct Bay {
+        MakitaBMS* bms = nullptr;
+        BMSJob* volatile job = nullptr; // job currently on this bay's bus
+        BMSJob* backlog[QUEUE_DEPTH];   // jobs waiting for this bay (FIFO)
+        uint8_t backlog_head = 0;
+        uint8_t backlog_len = 0;
+
+        // Worker-owned copy of the identified battery; dynamic reads update it in place
+        BatteryData data;
+        BatteryData fresh;              // identification target, promoted to data on success
+        SupportedFeatures features;     // of the last identification
+        uint32_t static_ms = 0;         // millis() of the last good identification, 0 = none
+        uint32_t dynamic_ms = 0;        // millis() of the last good dynamic read or sample
+
+        // Live session
+        bool live = false;
+        uint8_t live_hz = 0;
+        uint32_t live_interval_ms = 0;
+        uint32_t live_started_ms = 0;
+        uint32_t live_next_ms = 0;
+        uint8_t live_fails = 0;
+    };
+
+    Bay _bays[MAX_BAYS];
+    uint8_t _bay_count = 0;
+    QueueHandle_t _commands = nullptr;
+    QueueHandle_t _results = nullptr;
+    TaskHandle_t _task = nullptr;
+    volatile uint8_t _running = 0;   // bays with a job on the bus
+    volatile uint8_t _backlogged = 0;
+    volatile uint32_t _fresh_ms = MAKITA_READ_FRESH_MS;
+    Stats _stats;
+    portMUX_TYPE _stats_mux = portMUX_INITIALIZER_UNLOCKED;   // submitted / rejected / max_depth
+
+    static void taskEntry(void* arg);
+    void run();
+    void enqueue(BMSJob* job);
+    bool share(Bay& b, BMSJob* job);
+    void reject(BMSJob* job);
+    void countSubmit(bool accepted);
+    void startNext(uint8_t bay);
+    void start(uint8_t bay, BMSJob* job);
+    void onComplete(uint8_t bay, BMSOperation op, BMSStatus status);
+    void complete(uint8_t bay);
+    void publish(BMSJob* job);
+    void setLiveRate(Bay& b, uint16_t hz);
+    BMSJob* nextLiveSample(uint8_t bay);
+    void stopLive(uint8_t bay, LiveStopReason reason);
+    void record(const BMSJob* job);
+};
+
+#endif
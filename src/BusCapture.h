@@ -0,0 +1,59 @@
+// src/BusCapture.h - BUS CAPTURE FILE FORMAT
+
+#ifndef BUS_CAPTURE_H
+#define BUS_CAPTURE_H
+
+#include <stdint.h>
+
+/**
+ * Layout of /capture.bin: one CaptureHeader followed by `count` CaptureEntry records,
+ * oldest first, all little-endian. No Arduino dependencies, so the host replay tool
+ * (tools/capture_replay.cpp) reads it with the same definitions.
+ */
+namespace BusCapture {
+
+constexpr char MAGIC[4] = {'M', 'K', 'C', 'P'};
+constexpr uint8_t VERSION = 1;
+constexpr uint8_t MAX_TX = 4;     // longest command in MakitaProtocol
+constexpr uint8_t MAX_RX = 40;    // longest frame (0x33 static read: ROM ID + 32 bytes)
+
+enum Kind : uint8_t {
+    RESET = 0,      // presence probe: reset pulse only
+    EXEC = 1,       // reset + control byte + command + response (MakitaBMS::exec)
+    RAW = 2         // reset + control byte + response, no command (F0513 model answer)
+};
+
+enum Flags : uint8_t {
+    PRESENT = 0x01  // reset() saw a presence pulse
+};
+
+struct __attribute__((packed)) Header {
+    char magic[4];
+    uint8_t version;
+    uint8_t bay;
+    uint8_t entry_size;     // sizeof(Entry), lets readers skip fields added later
+    uint8_t reserved;
+    uint16_t count;         // entries that follow
+    uint16_t reserved2;
+    uint32_t total;         // transactions recorded since boot / last clear (older ones were overwritten)
+};
+
+struct __attribute__((packed)) Entry {
+    uint32_t t_us;          // micros() at the reset pulse (wraps after ~71 min)
+    uint16_t dur_us;        // whole transaction, saturates at 65535
+    uint8_t kind;           // Kind
+    uint8_t control;        // 0x33 / 0xCC / 0x31, 0 for RESET
+    uint8_t flags;          // Flags
+    uint8_t tx_len;
+    uint8_t rx_len;         // frame bytes; 0x33 frames start with the 8-byte ROM ID
+    uint8_t reserved;
+    uint8_t tx[MAX_TX];
+    uint8_t rx[MAX_RX];
+};
+
+static_assert(sizeof(Header) == 16, "capture header layout");
+static_assert(sizeof(Entry) == 56, "capture entry layout");
+
+} // namespace BusCapture
+
+#endif
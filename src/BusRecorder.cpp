@@ -0,0 +1,47 @@
+// src/BusRecorder.cpp - RAW BUS TRANSACTION RECORDER
+
+#include "BusRecorder.h"
+
+void BusRecorder::record(const BusCapture::Entry& entry) {
+    portENTER_CRITICAL(&_mux);
+    _entries[_total % DEPTH] = entry;
+    _total++;
+    portEXIT_CRITICAL(&_mux);
+}
+
+uint16_t BusRecorder::size() const {
+    return _total < DEPTH ? (uint16_t)_total : DEPTH;
+}
+
+uint16_t BusRecorder::snapshot(BusCapture::Entry* out, uint16_t max, uint32_t* total) const {
+    portENTER_CRITICAL(&_mux);
+    uint16_t n = size();
+    if (n > max) n = max;
+    uint32_t first = _total - n;
+    for (uint16_t i = 0; i < n; i++) out[i] = _entries[(first + i) % DEPTH];
+    if (total) *total = _total;
+    portEXIT_CRITICAL(&_mux);
+    return n;
+}
+
+void BusRecorder::clear() {
+    portENTER_CRITICAL(&_mux);
+    _total = 0;
+    portEXIT_CRITICAL(&_mux);
+}
+
+size_t BusRecorder::writeFile(uint8_t* out, size_t cap, uint8_t bay) const {
+    if (cap < sizeof(BusCapture::Header)) return 0;
+    uint16_t max = (cap - sizeof(BusCapture::Header)) / sizeof(BusCapture::Entry);
+
+    BusCapture::Header hdr = {};
+    memcpy(hdr.magic, BusCapture::MAGIC, sizeof(hdr.magic));
+    hdr.version = BusCapture::VERSION;
+    hdr.bay = bay;
+    hdr.entry_size = sizeof(BusCapture::Entry);
+    uint32_t total = 0;
+    hdr.count = snapshot((BusCapture::Entry*)(out + sizeof(hdr)), max, &total);
+    hdr.total = total;
+    memcpy(out, &hdr, sizeof(hdr));
+    return sizeof(hdr) + hdr.count * sizeof(BusCapture::Entry);
+}
@@ -0,0 +1,44 @@
+// src/BusRecorder.h - RAW BUS TRANSACTION RECORDER
+
+#ifndef BUS_RECORDER_H
+#define BUS_RECORDER_H
+
+#include <Arduino.h>
+#include "BusCapture.h"
+
+#ifndef MAKITA_CAPTURE_DEPTH
+#define MAKITA_CAPTURE_DEPTH 64     // transactions kept per bay (56 bytes each)
+#endif
+
+/**
+ * Fixed-size ring of the most recent bus transactions. The bus worker records every
+ * transaction (an entry copy, no heap, no formatting); when full the oldest entry is
+ * overwritten. Readers on other tasks (the HTTP handler) take a consistent copy:
+ * writes and snapshots hold a short spinlock around the memcpy only.
+ */
+class BusRecorder {
+public:
+    static constexpr uint16_t DEPTH = MAKITA_CAPTURE_DEPTH;
+
+    void record(const BusCapture::Entry& entry);
+
+    // Copies up to `max` entries, oldest first; returns how many were copied
+    uint16_t snapshot(BusCapture::Entry* out, uint16_t max, uint32_t* total = nullptr) const;
+
+    uint16_t size() const;
+    uint32_t total() const { return _total; }
+    void clear();
+
+    // Bytes of a capture file holding the current entries
+    size_t fileSize() const { return sizeof(BusCapture::Header) + size() * sizeof(BusCapture::Entry); }
+
+    // Writes header + entries into out (at least fileSize() bytes); returns bytes written
+    size_t writeFile(uint8_t* out, size_t cap, uint8_t bay) const;
+
+private:
+    BusCapture::Entry _entries[DEPTH];
+    uint32_t _total = 0;                // entries ever recorded; _total % DEPTH is the next slot
+    mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif
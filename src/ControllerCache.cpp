@@ -0,0 +1,80 @@
+// src/ControllerCache.cpp - PERSISTENT IDENTIFICATION CACHE
+
+#include "ControllerCache.h"
+#include "FS.h"
+#include "LittleFS.h"
+
+ControllerCache::ControllerCache(const char* path) : _path(path) {}
+
+void ControllerCache::begin() {
+    _count = 0;
+    File f = LittleFS.open(_path, "r");
+    if (!f) return;
+    FileHeader hdr = {};
+    bool valid = f.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr)
+                 && hdr.magic[0] == 0x1D && hdr.magic[1] == 0xCA && hdr.version == 1
+                 && hdr.count <= MAX_ENTRIES;
+    if (valid) {
+        size_t bytes = hdr.count * sizeof(Entry);
+        if (f.read((uint8_t*)_entries, bytes) == bytes) _count = hdr.count;
+    }
+    f.close();
+    for (uint8_t i = 0; i < _count; i++) _entries[i].model[sizeof(_entries[i].model) - 1] = '\0';
+}
+
+int ControllerCache::find(const uint8_t rom[8]) const {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (memcmp(_entries[i].rom, rom, 8) == 0) return i;
+    }
+    return -1;
+}
+
+bool ControllerCache::lookup(const uint8_t rom[8], Entry& out) const {
+    int i = find(rom);
+    if (i < 0) return false;
+    out = _entries[i];
+    return true;
+}
+
+/**
+ * Entries are kept oldest-first; a stored entry moves to the end.
+ */
+void ControllerCache::store(const Entry& entry) {
+    int i = find(entry.rom);
+    if (i >= 0) {
+        remove(i);
+    } else if (_count == MAX_ENTRIES) {
+        remove(0);
+    }
+    _entries[_count] = entry;
+    _entries[_count].model[sizeof(entry.model) - 1] = '\0';
+    _count++;
+    save();
+}
+
+void ControllerCache::invalidate(const uint8_t rom[8]) {
+    int i = find(rom);
+    if (i < 0) return;
+    remove(i);
+    save();
+}
+
+void ControllerCache::clear() {
+    _count = 0;
+    LittleFS.remove(_path);
+}
+
+void ControllerCache::remove(int index) {
+    for (int i = index; i < _count - 1; i++) _entries[i] = _entries[i + 1];
+    _count--;
+}
+
+bool ControllerCache::save() {
+    File f = LittleFS.open(_path, "w");
+    if (!f) return false;
+    FileHeader hdr = {{0x1D, 0xCA}, 1, _count};
+    bool ok = f.write((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr)
+              && f.write((uint8_t*)_entries, _count * sizeof(Entry)) == _count * sizeof(Entry);
+    f.close();
+    return ok;
+}
@@ -0,0 +1,56 @@
+// src/ControllerCache.h - PERSISTENT IDENTIFICATION CACHE
+
+#ifndef CONTROLLER_CACHE_H
+#define CONTROLLER_CACHE_H
+
+#include <Arduino.h>
+
+/**
+ * Maps the 8-byte ROM ID of a pack to what the model probe found last time
+ * (controller type, model string, cell count), so identification can skip the
+ * power-cycled getModel() / F0513 probes for packs that have been seen before.
+ *
+ * Entries live in RAM and are written back to a small LittleFS file on every change.
+ * Only the bus worker task touches the cache (through MakitaBMS).
+ */
+class ControllerCache {
+public:
+    struct Entry {
+        uint8_t rom[8];
+        uint8_t controller;      // MakitaBMS::ControllerType
+        uint8_t cell_count;
+        uint8_t type_code;       // static frame byte 19, checked on every hit
+        uint8_t capacity_code;   // static frame byte 24, checked on every hit
+        char model[8];           // NUL-terminated, e.g. "BL1850B"
+    };
+
+    static constexpr uint8_t MAX_ENTRIES = 32;
+
+    explicit ControllerCache(const char* path = "/idcache.bin");
+
+    // Loads the cache file. Call after LittleFS.begin().
+    void begin();
+
+    bool lookup(const uint8_t rom[8], Entry& out) const;
+    void store(const Entry& entry);           // insert or replace; evicts the oldest when full
+    void invalidate(const uint8_t rom[8]);
+    void clear();
+    uint8_t size() const { return _count; }
+
+private:
+    struct FileHeader {
+        uint8_t magic[2];        // 0x1D 0xCA
+        uint8_t version;
+        uint8_t count;
+    };
+
+    const char* _path;
+    Entry _entries[MAX_ENTRIES];
+    uint8_t _count = 0;
+
+    int find(const uint8_t rom[8]) const;
+    void remove(int index);
+    bool save();
+};
+
+#endif
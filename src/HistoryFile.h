@@ -0,0 +1,121 @@
+// src/HistoryFile.h - BATTERY HISTORY FILE LAYOUT AND DOWNSAMPLING
+
+#ifndef HISTORY_FILE_H
+#define HISTORY_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// History file header (12 bytes)
+struct __attribute__((packed)) HistoryHeader {
+    uint8_t  magic[2];      // 0xBA 0x7E
+    uint8_t  version;       // format version
+    uint8_t  cell_count;    // 4 or 5
+    char     model[8];      // null-padded model name
+};
+
+// History record (24 bytes)
+struct __attribute__((packed)) HistoryRecord {
+    uint32_t timestamp;     // unix seconds
+    uint16_t charge_cycles;
+    uint16_t pack_voltage;  // millivolts
+    uint16_t cell_voltages[5]; // millivolts, unused=0
+    uint16_t cell_diff;     // millivolts×10
+    int16_t  temp1;         // °C×100
+    int16_t  temp2;         // °C×100
+};
+static_assert(sizeof(HistoryRecord) == 24, "history record layout");
+
+const uint8_t HISTORY_VERSION = 1;
+const uint8_t HISTORY_READ_BLOCK = 32;   // records per read() when scanning a file
+
+// Version 2 files come from development builds that appended two unverified wear
+// counters to each record. They are still read, and appended to in their own record
+// size, the four extra bytes ignored on read and written as zero.
+const size_t HISTORY_RECORD_V2_SIZE = 28;
+const size_t HISTORY_RECORD_MAX = HISTORY_RECORD_V2_SIZE;
+
+inline size_t historyRecordSize(const HistoryHeader& hdr) {
+    return hdr.version == 2 ? HISTORY_RECORD_V2_SIZE : sizeof(HistoryRecord);
+}
+
+/**
+ * Sequential reader over the records of a history file: one read() fills a block,
+ * next() hands the records out one by one (bytes past sizeof(HistoryRecord) are skipped).
+ * F is anything with size_t read(uint8_t*, size_t): an fs::File on the device.
+ */
+template <class F>
+struct HistoryBlockReader {
+    F& f;
+    size_t recSize;
+    uint8_t block[HISTORY_READ_BLOCK * HISTORY_RECORD_MAX];
+    size_t have = 0, pos = 0;
+
+    HistoryBlockReader(F& file, size_t size) : f(file), recSize(size) {}
+
+    bool next(HistoryRecord& rec) {
+        if (pos + recSize > have) {
+            have = f.read(block, HISTORY_READ_BLOCK * recSize);
+            pos = 0;
+            if (have < recSize) return false;
+        }
+        rec = HistoryRecord();
+        memcpy(&rec, block + pos, recSize < sizeof(rec) ? recSize : sizeof(rec));
+        pos += recSize;
+        return true;
+    }
+};
+
+/**
+ * Running min/max/mean of the records of one chart point. Sums stay in 32 bits up to
+ * ~200k records per bucket.
+ */
+struct HistoryBucket {
+    uint32_t n = 0;
+    uint64_t ts = 0;
+    uint32_t pack = 0, cells[5] = {0}, diff = 0;
+    int32_t t1 = 0, t2 = 0;
+    uint16_t packMin = 0xFFFF, packMax = 0, diffMax = 0;
+    uint16_t cycles = 0;                  // of the last record
+
+    void add(const HistoryRecord& r) {
+        n++;
+        ts += r.timestamp;
+        pack += r.pack_voltage;
+        for (uint8_t c = 0; c < 5; c++) cells[c] += r.cell_voltages[c];
+        diff += r.cell_diff;
+        t1 += r.temp1;
+        t2 += r.temp2;
+        if (r.pack_voltage < packMin) packMin = r.pack_voltage;
+        if (r.pack_voltage > packMax) packMax = r.pack_voltage;
+        if (r.cell_diff > diffMax) diffMax = r.cell_diff;
+        cycles = r.charge_cycles;
+    }
+};
+
+/**
+ * One pass over `total` records: record i goes to bucket i * points / total, so the
+ * points cover the whole lifetime of the pack. Only the current bucket is kept in
+ * memory. next(HistoryRecord&) supplies records (false stops early); emit(const
+ * HistoryBucket&) receives each finished bucket, at most `points` of them.
+ */
+template <class Next, class Emit>
+void bucketHistory(uint32_t total, uint16_t points, Next next, Emit emit) {
+    HistoryBucket bucket;
+    uint32_t current = 0;
+    HistoryRecord rec;
+    for (uint32_t i = 0; i < total; i++) {
+        if (!next(rec)) break;
+        uint32_t b = (uint32_t)((uint64_t)i * points / total);
+        if (b != current && bucket.n) {
+            emit(bucket);
+            bucket = HistoryBucket();
+        }
+        current = b;
+        bucket.add(rec);
+    }
+    if (bucket.n) emit(bucket);
+}
+
+#endif
@@ -0,0 +1,69 @@
+// src/LogRing.cpp - DEFERRED BMS LOGGING
+
+#include "LogRing.h"
+
+LogRecord* LogRing::claim(uint8_t level, uint8_t kind) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) >= CAPACITY) {
+        if (_dropped < 255) _dropped++;
+        _dropped_total++;
+        return nullptr;
+    }
+    LogRecord* rec = &_records[head % CAPACITY];
+    rec->ms = millis();
+    rec->level = level;
+    rec->kind = kind;
+    rec->dropped = _dropped;
+    rec->prefix = nullptr;
+    _dropped = 0;
+    return rec;
+}
+
+void LogRing::commit() {
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void LogRing::pushText(uint8_t level, const char* text) {
+    LogRecord* rec = claim(level, LogRecord::TEXT);
+    if (!rec) return;
+    size_t n = text ? strnlen(text, LogRecord::PAYLOAD) : 0;
+    memcpy(rec->payload, text, n);
+    rec->len = (uint8_t)n;
+    commit();
+}
+
+void LogRing::pushHex(uint8_t level, const char* prefix, const uint8_t* data, uint8_t len) {
+    LogRecord* rec = claim(level, LogRecord::BYTES);
+    if (!rec) return;
+    if (!data) len = 0;
+    if (len > LogRecord::PAYLOAD) len = LogRecord::PAYLOAD;
+    memcpy(rec->payload, data, len);
+    rec->len = len;
+    rec->prefix = prefix;
+    commit();
+}
+
+bool LogRing::pop(LogRecord& out) {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) return false;
+    out = _records[tail % CAPACITY];
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+size_t LogRing::format(const LogRecord& rec, char* out, size_t cap) {
+    if (cap == 0) return 0;
+    size_t n = 0;
+    if (rec.kind == LogRecord::TEXT) {
+        n = rec.len < cap - 1 ? rec.len : cap - 1;
+        memcpy(out, rec.payload, n);
+    } else {
+        int w = snprintf(out, cap, "%s", rec.prefix ? rec.prefix : "");
+        n = (w < 0) ? 0 : ((size_t)w < cap ? (size_t)w : cap - 1);
+        for (uint8_t i = 0; i < rec.len && n + 3 < cap; i++) {
+            n += snprintf(out + n, cap - n, "%02X ", (uint8_t)rec.payload[i]);
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
@@ -0,0 +1,62 @@
+// src/LogRing.h - DEFERRED BMS LOGGING
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * One log line in binary form. Text lines are copied (truncated to PAYLOAD bytes);
+ * hex dumps keep the raw bytes plus a pointer to a string-literal prefix and are
+ * only formatted when the consumer drains the ring.
+ */
+struct LogRecord {
+    static constexpr uint8_t PAYLOAD = 80;
+    enum Kind : uint8_t { TEXT, BYTES };    // not HEX: Arduino.h defines it as a macro
+
+    uint32_t ms;
+    uint8_t level;          // LogLevel
+    uint8_t kind;
+    uint8_t len;            // TEXT: chars, BYTES: bytes
+    uint8_t dropped;        // records lost (ring full) right before this one, saturating
+    const char* prefix;     // BYTES only; must be a literal (outlives the record)
+    char payload[PAYLOAD];
+};
+
+/**
+ * Preallocated single-producer / single-consumer ring of LogRecords.
+ * The producer (the bus worker task) only copies bytes: no heap, no formatting,
+ * no Serial or WebSocket calls, so logging does not change bus timing.
+ * The consumer (loop()) formats and flushes records later. When the ring is full
+ * new records are dropped and counted.
+ */
+class LogRing {
+public:
+    static constexpr uint8_t CAPACITY = 48;   // power of two not required
+
+    // Producer side
+    void pushText(uint8_t level, const char* text);
+    void pushHex(uint8_t level, const char* prefix, const uint8_t* data, uint8_t len);
+
+    // Consumer side: copies the oldest record out; false if empty
+    bool pop(LogRecord& out);
+    bool empty() const { return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire); }
+
+    // Formats a record as a single line ("prefix" + "AA BB ..." for hex dumps)
+    static size_t format(const LogRecord& rec, char* out, size_t cap);
+
+    uint32_t droppedTotal() const { return _dropped_total; }
+
+private:
+    LogRecord _records[CAPACITY];
+    std::atomic<uint32_t> _head{0};   // next slot to write (producer)
+    std::atomic<uint32_t> _tail{0};   // next slot to read (consumer)
+    uint8_t _dropped = 0;             // producer-owned, folded into the next record
+    uint32_t _dropped_total = 0;
+
+    LogRecord* claim(uint8_t level, uint8_t kind);
+    void commit();
+};
+
+#endif
@@ -1,20 +1,21 @@
 // src/MakitaBMS.cpp - VERSIÓN OPTIMIZADA Y DOCUMENTADA
 
 #include "MakitaBMS.h"
+#include <stdarg.h>
 
-// --- Definiciones de comandos estáticos (Requerido para el Linker en C++14) ---
-constexpr byte MakitaBMS::CMD_READ_STATIC[];
-constexpr byte MakitaBMS::CMD_READ_DYNAMIC[];
-constexpr byte MakitaBMS::CMD_LED_TEST_INIT[];
-constexpr byte MakitaBMS::CMD_LED_ON[];
-constexpr byte MakitaBMS::CMD_LED_OFF[];
-constexpr byte MakitaBMS::CMD_CLEAR_ERR_INIT[];
-constexpr byte MakitaBMS::CMD_CLEAR_ERR_EXEC[];
-constexpr byte MakitaBMS::CMD_GET_MODEL[];
+using namespace MakitaProtocol;
 
 /**
  * Convierte el estado interno del BMS a un mensaje de texto comprensible.
  */
+const char* lockStateName(LockState state) {
+    switch (state) {
+        case LockState::UNLOCKED: return "UNLOCKED";
+        case LockState::LOCKED:   return "LOCKED";
+        default: return "N/A";
+    }
+}
+
 String statusToString(BMSStatus status) {
     switch (status) {
         case BMSStatus::OK: return "";
@@ -23,387 +24,932 @@ String statusToString(BMSStatus status) {
         case BMSStatus::ERROR_MODEL_NOT_SUPPORTED: return "Battery model not supported.";
         case BMSStatus::ERROR_COMMUNICATION: return "Communication error (data integrity).";
         case BMSStatus::ERROR_NOT_AVAILABLE: return "Function not available for this model.";
+        case BMSStatus::ERROR_BUSY: return "BMS busy with another operation.";
         default: return "Unknown error.";
     }
 }
 
 /**
  * Constructor de la clase MakitaBMS.
- * Configura los pines de comunicación y de control de energía.
+ * El bus se encarga de los pines de comunicación y de control de energía.
+ */
+MakitaBMS::MakitaBMS(MakitaBus& bus) : _bus(bus) {
+    _bus.setPower(false); // Initial state: OFF
+}
+
+/**
+ * Inicializa el bus (RMT si está disponible, bit-bang como respaldo, o el simulador).
+ * Debe llamarse desde setup(): el driver RMT no puede instalarse en constructores globales.
  */
-MakitaBMS::MakitaBMS(uint8_t onewire_pin, uint8_t enable_pin) 
-    : makita(onewire_pin), _enable_pin(enable_pin) {
-    pinMode(_enable_pin, OUTPUT);
-    digitalWrite(_enable_pin, LOW); // Initial state: OFF (direct drive, HIGH=on)
+void MakitaBMS::begin() {
+    _cycles_per_us = ESP.getCpuFreqMHz();
+    _bus.begin();
+    logf(LOG_LEVEL_INFO, "OneWire backend: %s", _bus.name());
 }
 
-void MakitaBMS::setLogCallback(LogCallback callback) { _log = callback; }
 void MakitaBMS::setLogLevel(LogLevel level) { _logLevel = level; }
 
 /**
- * Envía mensajes de texto a través del callback registrado (Serial/Web).
+ * Registra un mensaje en el anillo de logs (sin formatear ni enviar: seguro en mitad del bus).
  */
-void MakitaBMS::logger(const String& message, LogLevel level) { 
-    if (_log && level <= _logLevel) _log(message, level); 
+void MakitaBMS::logger(const char* message, LogLevel level) {
+    if (level <= _logLevel) _logs.pushText(level, message);
 }
 
 /**
- * Helper para imprimir bloques de datos en formato hexadecimal (depuración profunda).
+ * Igual que logger() pero con formato printf. Solo formatea si el nivel está activo.
  */
-void MakitaBMS::log_hex(const String& prefix, const byte* data, int len) { 
-    if (_logLevel < LOG_LEVEL_DEBUG || !_log) return; 
-    String hex_str;
-    hex_str.reserve(prefix.length() + len * 3);
-    hex_str = prefix; 
-    if (data && len > 0) {
-        for (int i = 0; i < len; i++) { 
-            char buf[4]; 
-            sprintf(buf, "%02X ", data[i]); 
-            hex_str += buf; 
-        } 
-    }
-    _log(hex_str, LOG_LEVEL_DEBUG); 
+void MakitaBMS::logf(LogLevel level, const char* fmt, ...) {
+    if (level > _logLevel) return;
+    char line[LogRecord::PAYLOAD + 1];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    _logs.pushText(level, line);
+}
+
+/**
+ * Volcado hexadecimal diferido: solo copia los bytes; se formatean al vaciar el anillo.
+ */
+void MakitaBMS::log_hex(const char* prefix, const byte* data, int len) {
+    if (_logLevel < LOG_LEVEL_DEBUG) return;
+    _logs.pushHex(LOG_LEVEL_DEBUG, prefix, data, (uint8_t)(len > 0 ? len : 0));
+}
+
+/**
+ * Power cycle the BMS: LOW 100ms -> HIGH 300ms, then continue with `resume`.
+ * Forces a fresh wake-up from dormancy. Non-blocking: the waits are state-machine deadlines.
+ */
+void MakitaBMS::powerCycle(Phase resume) {
+    _power_held = false;
+    _bus.setPower(false);
+    _resume = resume;
+    schedule(Phase::CYCLE_ON, POWER_OFF_MS);
 }
 
 /**
- * Power cycle the BMS: LOW 100ms -> HIGH 300ms.
- * Forces a fresh wake-up from dormancy.
+ * Enable the BMS and continue with `next` once it has had POWER_ON_MS to wake up.
  */
-void MakitaBMS::powerCycle() {
-    digitalWrite(_enable_pin, LOW);
-    delay(100);
-    digitalWrite(_enable_pin, HIGH);
-    delay(300);
+void MakitaBMS::powerOn(Phase next) {
+    if (_power_held) {
+        // A presence probe left the BMS awake: continue in the same window
+        _power_held = false;
+        _wakes++;
+        schedule(next, 0);
+        return;
+    }
+    _bus.setPower(true);
+    _wakes++;
+    _power_on_cycles = ESP.getCycleCount();
+    _timing_power_on = true;
+    schedule(next, POWER_ON_MS);
+}
+
+void MakitaBMS::schedule(Phase next, uint32_t wait_ms) {
+    _phase = next;
+    _deadline = millis() + wait_ms;
 }
 
 /**
- * Retry OneWire reset() up to max_attempts times with 100ms gaps.
- * BMS frequently ignores presence pulses, so retrying is essential.
+ * Ends the running operation and delivers the result through the completion callback.
+ * The callback may start the next operation right away.
  */
-bool MakitaBMS::resetWithRetry(uint8_t max_attempts) {
-    for (uint8_t i = 0; i < max_attempts; i++) {
-        if (makita.reset()) return true;
-        delay(100);
+void MakitaBMS::finish(BMSStatus status) {
+    BMSOperation op = _op;
+    BatteryData& data = _target ? *_target : _scratch;
+    if (op == BMSOperation::IDENTIFY && _identify_sampling) {
+        // Identification succeeded; `status` is the result of the first dynamic read
+        _identify_sampling = false;
+        _sample_status = status;
+        logf(LOG_LEVEL_INFO, "Identify + first sample: %lu ms, %u power window(s)",
+             (unsigned long)(millis() - _op_started_ms), (unsigned)_wakes);
+        if (_identity_from_cache && status != BMSStatus::OK && _cache) {
+            logger("Controller cache: dynamic read failed, entry invalidated", LOG_LEVEL_INFO);
+            _cache->invalidate(_rom);
+        }
+        _identity_from_cache = false;
+        status = BMSStatus::OK;
+    }
+    _sample_after_identify = false;
+    if (_identity_from_cache && (op == BMSOperation::READ_DYNAMIC || op == BMSOperation::LIVE_START)) {
+        // The first dynamic read confirms a cached identity; a failure forces a probe next time
+        _identity_from_cache = false;
+        if (status != BMSStatus::OK && _cache) {
+            logger("Controller cache: dynamic read failed, entry invalidated", LOG_LEVEL_INFO);
+            _cache->invalidate(_rom);
+        }
     }
-    return false;
+    BusMetrics::OpCounters& counters = _metrics.ops[(size_t)op];
+    if (status == BMSStatus::OK) counters.ok++;
+    else counters.failed++;
+    _phase = Phase::IDLE;
+    _op = BMSOperation::NONE;
+    _last_status = status;
+    _target = nullptr;
+    _features = nullptr;
+    if (_on_complete) _on_complete(op, status, data);
 }
 
 /**
  * Check if a response buffer is garbage (all 0xFF or all 0x00).
  * Pull-up idle with no battery produces 0xFF; shorted bus produces 0x00.
+ * The rule lives in MakitaProtocol so the capture replay tool applies the same one.
  */
 bool MakitaBMS::isResponseGarbage(const byte* data, uint8_t len) {
-    if (data == nullptr || len == 0) return true;
-    uint8_t check = (len < 3) ? len : 3;
-    bool all_ff = true, all_00 = true;
-    for (uint8_t i = 0; i < check; i++) {
-        if (data[i] != 0xFF) all_ff = false;
-        if (data[i] != 0x00) all_00 = false;
-    }
-    return all_ff || all_00;
+    bool garbage = MakitaProtocol::isGarbage(data, len);
+    if (garbage) _metrics.garbage++;
+    return garbage;
 }
 
 /**
- * Ejecuta una transacción de comando/respuesta usando el protocolo tipo 'CC' (Común).
- * Returns true if reset() succeeded (presence pulse detected).
+ * Transacción genérica descrita por un MakitaProtocol::Command: reset, byte de control,
+ * ROM ID (solo 0x33), comando y respuesta. Transporte y longitudes son parte del tipo,
+ * así que cada comando genera su propia secuencia sin ramas en tiempo de ejecución.
+ * El log va al final para no alterar los tiempos entre bytes.
  */
-bool MakitaBMS::cmd_and_read_cc(const byte* cmd, uint8_t cmd_len, byte* rsp, uint8_t rsp_len) {
-    bool present = makita.reset();
+template <class C>
+bool MakitaBMS::exec(const C& cmd, byte (&frame)[C::FRAME_LEN]) {
+    static_assert(C::TX_LEN <= BusCapture::MAX_TX && C::FRAME_LEN <= BusCapture::MAX_RX,
+                  "command does not fit a capture entry");
+    uint32_t t0 = micros();
+    bool present = busReset();
     delayMicroseconds(400);
-    makita.write(0xcc); // byte de control tipo CC
-    log_hex(">> CC (cmd): ", cmd, cmd_len);
-    if (cmd != nullptr) for (int i = 0; i < cmd_len; i++) { makita.write(cmd[i]); delayMicroseconds(90); }
-    if (rsp != nullptr) for (int i = 0; i < rsp_len; i++) { rsp[i] = makita.read(); delayMicroseconds(90); }
-    log_hex("<< CC (rsp): ", rsp, rsp_len);
+    busWrite((uint8_t)C::TRANSPORT);
+    if (C::RX_OFFSET) busReadBytes(frame, C::RX_OFFSET, 90);
+    busWriteBytes(cmd.tx, C::TX_LEN, 90);
+    busReadBytes(frame + C::RX_OFFSET, C::RX_LEN, 90);
+    recordTransaction(t0, BusCapture::EXEC, (uint8_t)C::TRANSPORT, present, cmd.tx, C::TX_LEN, frame, C::FRAME_LEN);
+    bool rom33 = C::TRANSPORT == Transport::ROM_33;
+    log_hex(rom33 ? ">> 33 (cmd): " : ">> CC (cmd): ", cmd.tx, C::TX_LEN);
+    log_hex(rom33 ? "<< 33 (rom+rsp): " : "<< CC (rsp): ", frame, C::FRAME_LEN);
     return present;
 }
 
-/**
- * Ejecuta una transacción compleja usando el protocolo tipo '33'.
- * Este protocolo requiere una lectura inicial de 8 bytes (ROM ID) antes de enviar el comando.
- * Returns true if reset() succeeded (presence pulse detected).
- */
-bool MakitaBMS::cmd_and_read_33(const byte* cmd, uint8_t cmd_len, byte* rsp, uint8_t rsp_len) {
-    bool present = makita.reset();
+template <class C>
+bool MakitaBMS::exec(const C& cmd) {
+    static_assert(C::FRAME_LEN == 0, "command returns data: pass a frame buffer");
+    static_assert(C::TX_LEN <= BusCapture::MAX_TX, "command does not fit a capture entry");
+    uint32_t t0 = micros();
+    bool present = busReset();
     delayMicroseconds(400);
-    makita.write(0x33); // byte de control tipo 33
-    log_hex(">> 33 (env): ", cmd, cmd_len);
-    byte initial_read[8];
-    for (int i = 0; i < 8; i++) { initial_read[i] = makita.read(); delayMicroseconds(90); }
-    log_hex("<< 33 (8b ROM): ", initial_read, 8);
-    for (int i = 0; i < cmd_len; i++) { makita.write(cmd[i]); delayMicroseconds(90); }
-    for (int i = 0; i < rsp_len; i++) { rsp[i] = makita.read(); delayMicroseconds(90); }
-    log_hex("<< 33 (rsp): ", rsp, rsp_len);
+    busWrite((uint8_t)C::TRANSPORT);
+    busWriteBytes(cmd.tx, C::TX_LEN, 90);
+    recordTransaction(t0, BusCapture::EXEC, (uint8_t)C::TRANSPORT, present, cmd.tx, C::TX_LEN, nullptr, 0);
+    log_hex(">> CC (cmd): ", cmd.tx, C::TX_LEN);
     return present;
 }
 
 /**
- * Comprueba si hay una batería físicamente conectada al puerto.
+ * Copia la transacción al registro binario (sin heap ni formato: no altera los tiempos).
  */
-bool MakitaBMS::isPresent() {
-    digitalWrite(_enable_pin, HIGH); // Encender alimentación del BMS
-    delay(300);
+void MakitaBMS::recordTransaction(uint32_t t0_us, uint8_t kind, uint8_t control, bool present,
+                                  const byte* tx, uint8_t tx_len, const byte* rx, uint8_t rx_len) {
+    BusCapture::Entry e = {};
+    uint32_t dur = micros() - t0_us;
+    e.t_us = t0_us;
+    e.dur_us = dur > 0xFFFF ? 0xFFFF : (uint16_t)dur;
+    e.kind = kind;
+    e.control = control;
+    e.flags = present ? BusCapture::PRESENT : 0;
+    e.tx_len = tx_len;
+    e.rx_len = rx_len;
+    if (tx_len) memcpy(e.tx, tx, tx_len);
+    if (rx_len) memcpy(e.rx, rx, rx_len);
+    _recorder.record(e);
+}
 
-    bool present = makita.reset();   // Intentar resetear el bus y capturar pulso de presencia
+// --- API asíncrona (máquina de estados) ---
+// --- Transacciones del bus con medida de tiempos ---
 
-    digitalWrite(_enable_pin, LOW);  // Apagar para seguridad
-    
-    if (present) {
-        logger("Presence: Battery detected", LOG_LEVEL_INFO);
-    } else {
-        logger("Presence: Empty bus", LOG_LEVEL_INFO);
-    }
+/**
+ * Registra en la fase indicada el tiempo transcurrido desde start_cycles.
+ * Las transferencias de varios bytes se normalizan por byte.
+ */
+void MakitaBMS::notePhase(BusMetrics::Phase phase, uint32_t start_cycles, uint8_t bytes) {
+    uint32_t us = (ESP.getCycleCount() - start_cycles) / _cycles_per_us;
+    _metrics.phases[phase].add(bytes > 1 ? us / bytes : us);
+}
+
+bool MakitaBMS::busReset() {
+    uint32_t c0 = ESP.getCycleCount();
+    bool present = _bus.reset();
+    notePhase(BusMetrics::RESET, c0);
+    if (!present) _metrics.no_presence++;
     return present;
 }
 
+void MakitaBMS::busWrite(uint8_t v) {
+    uint32_t c0 = ESP.getCycleCount();
+    _bus.write(v);
+    notePhase(BusMetrics::WRITE_BYTE, c0);
+}
+
+uint8_t MakitaBMS::busRead() {
+    uint32_t c0 = ESP.getCycleCount();
+    uint8_t v = _bus.read();
+    notePhase(BusMetrics::READ_BYTE, c0);
+    return v;
+}
+
+void MakitaBMS::busWriteBytes(const byte* data, uint8_t len, uint16_t gap_us) {
+    uint32_t c0 = ESP.getCycleCount();
+    _bus.writeBytes(data, len, gap_us);
+    notePhase(BusMetrics::WRITE_BYTE, c0, len);
+}
+
+void MakitaBMS::busReadBytes(byte* data, uint8_t len, uint16_t gap_us) {
+    uint32_t c0 = ESP.getCycleCount();
+    _bus.readBytes(data, len, gap_us);
+    notePhase(BusMetrics::READ_BYTE, c0, len);
+}
+
+void MakitaBMS::clearMetrics() {
+    _metrics = BusMetrics();
+    _bus.clearCriticalSections();
+}
+
+const char* busPhaseName(uint8_t phase) {
+    switch (phase) {
+        case BusMetrics::RESET:      return "reset";
+        case BusMetrics::WRITE_BYTE: return "write_byte";
+        case BusMetrics::READ_BYTE:  return "read_byte";
+        case BusMetrics::POWER_ON:   return "power_on";
+        default: return "unknown";
+    }
+}
+
+const char* operationName(BMSOperation op) {
+    switch (op) {
+        case BMSOperation::NONE:         return "none";
+        case BMSOperation::PRESENCE:     return "presence";
+        case BMSOperation::READ_STATIC:  return "read_static";
+        case BMSOperation::READ_DYNAMIC: return "read_dynamic";
+        case BMSOperation::LED_TEST:     return "led_test";
+        case BMSOperation::CLEAR_ERRORS: return "clear_errors";
+        case BMSOperation::IDENTIFY:     return "identify";
+        case BMSOperation::LIVE_START:   return "live_start";
+        case BMSOperation::LIVE_SAMPLE:  return "live_sample";
+        default: return "unknown";
+    }
+}
+
+void MakitaBMS::setCompletionCallback(CompletionCallback callback) { _on_complete = callback; }
+
+/**
+ * Avanza la operación en curso. Cada paso ejecuta como mucho una transacción corta del bus;
+ * las esperas de encendido (300 ms) y apagado (100/50 ms) son plazos, no delay().
+ * @return true cuando no queda ninguna operación en curso.
+ */
+bool MakitaBMS::poll() {
+    while (_phase != Phase::IDLE && (int32_t)(millis() - _deadline) >= 0) {
+        if (_timing_power_on) {
+            // Espera de encendido real: POWER_ON_MS + el retraso con que la tarea llega aquí
+            _timing_power_on = false;
+            notePhase(BusMetrics::POWER_ON, _power_on_cycles);
+        }
+        step();
+    }
+    return _phase == Phase::IDLE;
+}
+
+uint32_t MakitaBMS::msUntilNextStep() const {
+    if (_phase == Phase::IDLE) return 0;
+    int32_t remaining = (int32_t)(_deadline - millis());
+    return remaining > 0 ? (uint32_t)remaining : 0;
+}
+
+/**
+ * Ejecuta la operación actual hasta el final (envoltorio bloqueante del API asíncrono).
+ */
+BMSStatus MakitaBMS::runToCompletion() {
+    while (!poll()) delay(msUntilNextStep());
+    return _last_status;
+}
+
+/**
+ * Comprueba si hay una batería físicamente conectada al puerto.
+ * Solo encendido + reset(): sin transferencia de datos, sirve de filtro barato antes
+ * de una identificación completa.
+ */
+BMSStatus MakitaBMS::beginPresence(bool hold_power) {
+    if (busy()) return BMSStatus::ERROR_BUSY;
+    if (_live) endLiveSession();
+    _op = BMSOperation::PRESENCE;
+    _hold_power = hold_power;
+    powerOn(Phase::PRESENCE_PROBE); // Encender alimentación del BMS
+    return BMSStatus::OK;
+}
+
+void MakitaBMS::releasePower() {
+    if (busy()) return;
+    _power_held = false;
+    _bus.setPower(false);
+}
+
 /**
  * Identifica la batería leyendo la tabla de datos estáticos maestros.
  * Determina el modelo de procesador y las funciones disponibles.
  *
  * Uses power cycling and retry logic for reliable BMS wake-up.
- * Worst-case blocking: ~2.6s (no battery). Typical success: ~1.5s.
+ * Worst-case duration: ~2.6s (no battery). Typical success: ~1.5s, almost all of it waits.
  */
-BMSStatus MakitaBMS::readStaticData(BatteryData &data, SupportedFeatures &features) {
+BMSStatus MakitaBMS::beginStaticRead(BatteryData &data, SupportedFeatures &features) {
+    if (busy()) return BMSStatus::ERROR_BUSY;
     logger("--- Reading Static Data (Identification) ---", LOG_LEVEL_INFO);
     _is_identified = false;
+    _f0513_batch = F0513Batch::UNKNOWN; // puede ser otra batería
+    if (_live) endLiveSession();
+    _op = BMSOperation::READ_STATIC;
+    _target = &data;
+    _features = &features;
+    _attempt = 0;
+    _wakes = 0;
+    _sample_after_identify = false;
+    _identify_sampling = false;
+    _op_started_ms = millis();
+    // First attempt: simple power on
+    powerOn(Phase::STATIC_READ);
+    return BMSStatus::OK;
+}
 
-    byte response[40];
-    bool data_valid = false;
+/**
+ * Identificación + primera lectura de voltajes/temperaturas para el panel completo.
+ * Mismo flujo que beginStaticRead(), pero: el modelo STANDARD se pregunta en la misma
+ * ventana que la trama 0xAA (los power cycles de sondeo quedan como respaldo) y la
+ * lectura dinámica sigue sin apagar el BMS. Con caché, todo cabe en una sola ventana.
+ */
+BMSStatus MakitaBMS::beginIdentifyAndSample(BatteryData &data, SupportedFeatures &features) {
+    BMSStatus status = beginStaticRead(data, features);
+    if (status != BMSStatus::OK) return status;
+    _op = BMSOperation::IDENTIFY;
+    _sample_after_identify = true;
+    _sample_status = BMSStatus::ERROR_NOT_IDENTIFIED;
+    return BMSStatus::OK;
+}
 
-    // Try up to 2 attempts: initial read, then power cycle + retry
-    for (int attempt = 0; attempt < 2 && !data_valid; attempt++) {
-        if (attempt == 0) {
-            // First attempt: simple power on
-            digitalWrite(_enable_pin, HIGH);
-            delay(300);
-        } else {
-            // Second attempt: full power cycle to wake dormant BMS
-            logger("Retrying with power cycle...", LOG_LEVEL_DEBUG);
-            powerCycle();
+/**
+ * Lee voltajes y temperaturas actuales.
+ * Utiliza algoritmos diferentes según el controlador detectado previamente.
+ */
+BMSStatus MakitaBMS::beginDynamicRead(BatteryData &data) {
+    if (busy()) return BMSStatus::ERROR_BUSY;
+    if (!_is_identified) return BMSStatus::ERROR_NOT_IDENTIFIED;
+    logger("--- Reading Voltages & Temperatures ---", LOG_LEVEL_INFO);
+    if (_live) endLiveSession();
+    _op = BMSOperation::READ_DYNAMIC;
+    _target = &data;
+    _op_started_ms = millis();
+    startDynamic(false);
+    return BMSStatus::OK;
+}
+
+/**
+ * Arranca la lectura dinámica del controlador identificado.
+ * @param powered true si el BMS ya está alimentado (sigue en la misma ventana)
+ */
+void MakitaBMS::startDynamic(bool powered) {
+    Phase first = Phase::DYN_STANDARD;
+    if (_controller == ControllerType::F0513) {
+        _step = 0;
+        _f0513_all_garbage = true;
+        _f0513_any_garbage = false;
+        _f0513_batching = (_f0513_batch != F0513Batch::NO);
+        _f0513_fell_back = false;
+        first = Phase::DYN_F0513_CMD;
+        // Per-command mode needs a fresh window for the first command too
+        if (powered && !_f0513_batching) {
+            _bus.setPower(false);
+            schedule(Phase::DYN_F0513_ON, F0513_OFF_MS);
+            return;
         }
+    }
+    if (powered) schedule(first, 0);
+    else powerOn(first);
+}
 
-        // Single clean reset→command→read sequence (matches original timing)
-        makita.reset();
-        delayMicroseconds(400);
-        makita.write(0x33);
+/**
+ * Control directo de los LEDs de la placa de la batería.
+ */
+BMSStatus MakitaBMS::beginLedTest(bool on) {
+    if (busy()) return BMSStatus::ERROR_BUSY;
+    if (!_is_identified || _controller != ControllerType::STANDARD) return BMSStatus::ERROR_NOT_AVAILABLE;
+    if (_live) endLiveSession();
+    _op = BMSOperation::LED_TEST;
+    _service_action = on ? &LED_ON : &LED_OFF;
+    powerOn(Phase::SERVICE_EXEC);
+    return BMSStatus::OK;
+}
 
-        byte initial_read[8];
-        for (int i = 0; i < 8; i++) { initial_read[i] = makita.read(); delayMicroseconds(90); }
-        for (int i = 0; i < 2; i++) { makita.write(CMD_READ_STATIC[i]); delayMicroseconds(90); }
+/**
+ * Intenta borrar errores persistentes y desbloquear el controlador.
+ */
+BMSStatus MakitaBMS::beginClearErrors() {
+    if (busy()) return BMSStatus::ERROR_BUSY;
+    if (!_is_identified || _controller != ControllerType::STANDARD) return BMSStatus::ERROR_NOT_AVAILABLE;
+    if (_live) endLiveSession();
+    _op = BMSOperation::CLEAR_ERRORS;
+    _service_action = &CLEAR_ERRORS;
+    powerOn(Phase::SERVICE_EXEC);
+    return BMSStatus::OK;
+}
 
-        byte remaining[32];
-        for (int i = 0; i < 32; i++) { remaining[i] = makita.read(); delayMicroseconds(90); }
+/**
+ * Abre una sesión en vivo: el BMS queda alimentado hasta endLiveSession() o hasta que
+ * el watchdog corte la alimentación. Solo controladores STANDARD (F0513 necesita una
+ * ventana de alimentación por comando).
+ */
+BMSStatus MakitaBMS::beginLiveSession(BatteryData &data) {
+    if (busy()) return BMSStatus::ERROR_BUSY;
+    if (!_is_identified) return BMSStatus::ERROR_NOT_IDENTIFIED;
+    if (_controller != ControllerType::STANDARD) return BMSStatus::ERROR_NOT_AVAILABLE;
+    if (_live) return BMSStatus::OK;
+    // Sin watchdog no hay sesión: nunca dejamos el BMS alimentado sin red de seguridad
+    if (!armLiveWatchdog()) return BMSStatus::ERROR_NOT_AVAILABLE;
+    logger("--- Starting Live Session ---", LOG_LEVEL_INFO);
+    _live = true;
+    _live_tripped = false;
+    _op = BMSOperation::LIVE_START;
+    _target = &data;
+    powerOn(Phase::LIVE_WAKE);
+    return BMSStatus::OK;
+}
 
-        memcpy(response, initial_read, 8);
-        memcpy(response + 8, remaining, 32);
+/**
+ * Una muestra 0xD7 dentro de la sesión en vivo; la alimentación ya está fija.
+ */
+BMSStatus MakitaBMS::beginLiveSample(BatteryData &data) {
+    if (busy()) return BMSStatus::ERROR_BUSY;
+    if (!_live) return BMSStatus::ERROR_NOT_AVAILABLE;
+    if (_live_tripped) return BMSStatus::ERROR_COMMUNICATION;
+    _op = BMSOperation::LIVE_SAMPLE;
+    _target = &data;
+    schedule(Phase::LIVE_SAMPLE, 0);
+    return BMSStatus::OK;
+}
 
-        log_hex("Static raw: ", response, 40);
+/**
+ * Cierra la sesión en vivo y apaga el BMS. No llamar con una operación en curso.
+ */
+void MakitaBMS::endLiveSession() {
+    if (_live_timer) esp_timer_stop(_live_timer);
+    _bus.setPower(false);
+    if (_live) logger(_live_tripped ? "Live session: watchdog cut BMS power" : "Live session ended.", LOG_LEVEL_INFO);
+    _live = false;
+    _live_tripped = false;
+}
 
-        if (!isResponseGarbage(response, 40)) {
-            data_valid = true;
+/**
+ * (Re)arma el watchdog de la sesión en vivo. El temporizador se crea la primera vez.
+ */
+bool MakitaBMS::armLiveWatchdog() {
+    if (!_live_timer) {
+        esp_timer_create_args_t args = {};
+        args.callback = &MakitaBMS::liveWatchdogExpired;
+        args.arg = this;
+        args.name = "bms_live_wdt";
+        if (esp_timer_create(&args, &_live_timer) != ESP_OK) {
+            _live_timer = nullptr;
+            return false;
         }
     }
+    esp_timer_stop(_live_timer); // falla si no estaba en marcha; da igual
+    return esp_timer_start_once(_live_timer, (uint64_t)LIVE_WATCHDOG_MS * 1000ULL) == ESP_OK;
+}
 
-    if (!data_valid) {
-        logger("Response is garbage (no battery)", LOG_LEVEL_DEBUG);
-        digitalWrite(_enable_pin, LOW);
-        return BMSStatus::ERROR_NOT_PRESENT;
-    }
+/**
+ * Corre en la tarea esp_timer: si el worker deja de muestrear, el BMS no se queda encendido.
+ */
+void MakitaBMS::liveWatchdogExpired(void* arg) {
+    MakitaBMS* self = static_cast<MakitaBMS*>(arg);
+    self->_bus.setPower(false);
+    self->_live_tripped = true;
+}
 
-    // Parse static fields
-    data.charge_cycles = ((nibble_swap(response[34]) << 8) | nibble_swap(response[35])) & 0x0FFF;
-    data.lock_status = (response[28] & 0x0F) > 0 ? "LOCKED" : "UNLOCKED";
-
-    char buf[12];
-    sprintf(buf, "%02X", response[27]); data.status_code = buf;
-    sprintf(buf, "%02d/%02d/20%02d", response[2], response[1], response[0]); data.mfg_date = buf;
-    data.capacity = String(nibble_swap(response[24]) / 10.0f, 1) + "Ah";
-    data.battery_type = String(nibble_swap(response[19]));
-
-    data.rom_id = "";
-    data.rom_id.reserve(24);
-    for(int i = 0; i < 8; i++) { char r_buf[4]; sprintf(r_buf, "%02X ", response[i]); data.rom_id += r_buf; }
-
-    // Power cycle before model identification — fresh wake-up
-    powerCycle();
-
-    // Try standard controller first
-    _controller = ControllerType::UNKNOWN;
-    String m_str = getModel();
-    if (m_str != "") {
-        _controller = ControllerType::STANDARD;
-        data.model = m_str;
-    } else {
-        // Power cycle before F0513 attempt
-        powerCycle();
-        m_str = getF0513Model();
-        if (m_str != "") {
-            _controller = ControllerType::F0513;
-            data.model = m_str;
+/**
+ * Un paso de la máquina de estados: se llama cuando vence el plazo de la fase actual.
+ */
+void MakitaBMS::step() {
+    switch (_phase) {
+        case Phase::IDLE:
+            break;
+
+        case Phase::CYCLE_ON:
+            powerOn(_resume);
+            break;
+
+        case Phase::PRESENCE_PROBE: {
+            uint32_t t0 = micros();
+            bool present = busReset();   // Intentar resetear el bus y capturar pulso de presencia
+            recordTransaction(t0, BusCapture::RESET, 0, present, nullptr, 0, nullptr, 0);
+            _last_presence = present;
+            if (present && _hold_power) {
+                _power_held = true;          // la siguiente operación continúa en esta ventana
+            } else {
+                _bus.setPower(false);  // Apagar para seguridad
+            }
+            // Las sondas periódicas (hold_power) solo registran en DEBUG para no saturar el log
+            LogLevel level = _hold_power ? LOG_LEVEL_DEBUG : LOG_LEVEL_INFO;
+            _hold_power = false;
+            if (present) {
+                logger("Presence: Battery detected", level);
+            } else {
+                logger("Presence: Empty bus", level);
+            }
+            finish(present ? BMSStatus::OK : BMSStatus::ERROR_NOT_PRESENT);
+            break;
+        }
+
+        case Phase::STATIC_READ: {
+            // Single clean reset→command→read sequence (matches original timing)
+            exec(READ_STATIC, _rsp);
+
+            if (isResponseGarbage(_rsp, sizeof(_rsp))) {
+                if (_attempt == 0) {
+                    // Second attempt: full power cycle to wake dormant BMS
+                    _attempt++;
+                    _metrics.ops[(size_t)_op].retries++;
+                    logger("Retrying with power cycle...", LOG_LEVEL_DEBUG);
+                    powerCycle(Phase::STATIC_READ);
+                } else {
+                    logger("Response is garbage (no battery)", LOG_LEVEL_DEBUG);
+                    _bus.setPower(false);
+                    finish(BMSStatus::ERROR_NOT_PRESENT);
+                }
+                break;
+            }
+
+            parseStaticFrame(*_target);
+
+            // Known pack: skip the model probes
+            if (identifyFromCache()) break;
+            if (_sample_after_identify && identifyInSameWindow()) break;
+
+            // Power cycle before model identification — fresh wake-up
+            _controller = ControllerType::UNKNOWN;
+            powerCycle(Phase::MODEL_STANDARD);
+            break;
+        }
+
+        case Phase::MODEL_STANDARD: {
+            // Try standard controller first
+            char model[8];
+            if (getModel(model)) {
+                _controller = ControllerType::STANDARD;
+                memcpy(_target->model, model, sizeof(model));
+                completeIdentification();
+            } else {
+                // Power cycle before F0513 attempt
+                powerCycle(Phase::MODEL_F0513_CMD);
+            }
+            break;
+        }
+
+        case Phase::MODEL_F0513_CMD: {
+            exec(F0513_MODEL_REQUEST);
+            schedule(Phase::MODEL_F0513_READ, F0513_MODEL_GAP_MS);
+            break;
+        }
+
+        case Phase::MODEL_F0513_READ: {
+            char model[8];
+            if (readF0513Model(model)) {
+                _controller = ControllerType::F0513;
+                memcpy(_target->model, model, sizeof(model));
+            }
+            completeIdentification();
+            break;
+        }
+
+        case Phase::DYN_STANDARD:
+            finish(readStandardDynamic(*_target));
+            break;
+
+        case Phase::DYN_F0513_ON:
+            powerOn(Phase::DYN_F0513_CMD);
+            break;
+
+        case Phase::DYN_F0513_CMD:
+            stepF0513Dynamic(*_target);
+            break;
+
+        case Phase::SERVICE_EXEC: {
+            byte enter[ServiceEnter::FRAME_LEN];
+            byte action[ServiceAction::FRAME_LEN];
+            exec(SERVICE_ENTER, enter);
+            exec(*_service_action, action);
+            _bus.setPower(false);
+            finish(BMSStatus::OK);
+            break;
+        }
+
+        case Phase::LIVE_WAKE: {
+            // La primera muestra confirma que el BMS responde con la alimentación fija
+            BMSStatus status = readStandardDynamic(*_target, true);
+            if (status != BMSStatus::OK) {
+                endLiveSession();
+                finish(status);
+                break;
+            }
+            logger("Live session started.", LOG_LEVEL_INFO);
+            armLiveWatchdog();
+            finish(BMSStatus::OK);
+            break;
+        }
+
+        case Phase::LIVE_SAMPLE: {
+            if (!_live || _live_tripped) {
+                finish(BMSStatus::ERROR_COMMUNICATION);
+                break;
+            }
+            BMSStatus status = readStandardDynamic(*_target, true);
+            armLiveWatchdog();
+            finish(status);
+            break;
         }
     }
+}
 
-    // Cell count detection based on model
-    if (data.model.startsWith("BL14")) {
-        data.cell_count = 4;
-    } else {
-        data.cell_count = 5;
+/**
+ * Parse static fields from the 40-byte 0x33/0xAA frame held in _rsp.
+ */
+void MakitaBMS::parseStaticFrame(BatteryData &data) {
+    const byte* frame = _rsp;
+    data.charge_cycles = readField(frame, Static::CYCLES);
+    data.lock_status = readField(frame, Static::LOCK) ? LockState::LOCKED : LockState::UNLOCKED;
+    data.status_code = readField(frame, Static::STATUS);
+    data.mfg_date = packDate(readField(frame, Static::DATE_YEAR), readField(frame, Static::DATE_MONTH),
+                             readField(frame, Static::DATE_DAY));
+    data.capacity_dah = readField(frame, Static::CAPACITY);
+    data.battery_type = readField(frame, Static::TYPE);
+    static_assert(sizeof(data.static_raw) == Static::TABLE_LEN, "static_raw must hold the 0xAA table");
+    memcpy(data.static_raw, frame + Static::TABLE_OFFSET, Static::TABLE_LEN);
+
+    memcpy(_rom, frame + Static::ROM_ID_FIRST.offset, Static::ROM_ID_LEN);
+    memcpy(data.rom_id, frame + Static::ROM_ID_FIRST.offset, Static::ROM_ID_LEN);
+    data.has_rom = true;
+}
+
+/**
+ * Looks the ROM ID up in the controller cache. The static frame fields stored with the
+ * entry must still match; otherwise the entry is dropped and the full probe runs.
+ */
+bool MakitaBMS::identifyFromCache() {
+    _identity_from_cache = false;
+    if (!_cache) return false;
+    ControllerCache::Entry entry;
+    if (!_cache->lookup(_rom, entry)) return false;
+    if (entry.type_code != readField(_rsp, Static::TYPE_CODE) ||
+        entry.capacity_code != readField(_rsp, Static::CAPACITY_CODE) ||
+        entry.controller == (uint8_t)ControllerType::UNKNOWN ||
+        entry.controller > (uint8_t)ControllerType::F0513 ||
+        entry.cell_count < 4 || entry.cell_count > 5) {
+        logger("Controller cache: entry mismatch, probing", LOG_LEVEL_INFO);
+        _cache->invalidate(_rom);
+        return false;
     }
+    _controller = (ControllerType)entry.controller;
+    memcpy(_target->model, entry.model, sizeof(_target->model) - 1);
+    _target->model[sizeof(_target->model) - 1] = '\0';
+    _target->cell_count = entry.cell_count;
+    _identity_from_cache = true;
+    logf(LOG_LEVEL_DEBUG, "Controller cache hit: %s", _target->model);
+    completeIdentification();
+    return true;
+}
+
+/**
+ * Asks for the STANDARD model in the same power window as the static frame. Some packs
+ * only answer after a fresh wake-up; those (and F0513) fall back to the power-cycled probes.
+ */
+bool MakitaBMS::identifyInSameWindow() {
+    char model[8];
+    if (!getModel(model) || strncmp(model, "BL", 2) != 0) return false;
+    _controller = ControllerType::STANDARD;
+    memcpy(_target->model, model, sizeof(model));
+    completeIdentification();
+    return true;
+}
+
+/**
+ * Final step of identification, once the model probes are done.
+ */
+void MakitaBMS::completeIdentification() {
+    BatteryData &data = *_target;
 
-    digitalWrite(_enable_pin, LOW);
+    // Cell count detection based on model (a cache hit already set the stored count)
+    if (!_identity_from_cache) data.cell_count = cellCountForModel(data.model);
 
-    if (_controller == ControllerType::UNKNOWN) return BMSStatus::ERROR_MODEL_NOT_SUPPORTED;
+    // In identify-and-sample mode the BMS stays powered for the first dynamic read
+    if (!_sample_after_identify || _controller == ControllerType::UNKNOWN) _bus.setPower(false);
+
+    if (_controller == ControllerType::UNKNOWN) {
+        finish(BMSStatus::ERROR_MODEL_NOT_SUPPORTED);
+        return;
+    }
 
     _is_identified = true;
-    features.read_dynamic = true;
+    _features->read_dynamic = true;
     if (_controller == ControllerType::STANDARD) {
-        features.led_test = true;
-        features.clear_errors = true;
+        _features->led_test = true;
+        _features->clear_errors = true;
+        _features->live_session = true;
     }
 
-    logger("Identification complete: " + data.model, LOG_LEVEL_INFO);
-    return BMSStatus::OK;
+    if (_cache && !_identity_from_cache) {
+        ControllerCache::Entry entry = {};
+        memcpy(entry.rom, _rom, 8);
+        entry.controller = (uint8_t)_controller;
+        entry.cell_count = (uint8_t)data.cell_count;
+        entry.type_code = readField(_rsp, Static::TYPE_CODE);
+        entry.capacity_code = readField(_rsp, Static::CAPACITY_CODE);
+        memcpy(entry.model, data.model, sizeof(entry.model) - 1);  // store() terminates it
+        _cache->store(entry);
+    }
+
+    logf(LOG_LEVEL_INFO, "Identification complete: %s", data.model);
+    if (_sample_after_identify) {
+        _identify_sampling = true;
+        startDynamic(true);
+        return;
+    }
+    finish(BMSStatus::OK);
 }
 
 /**
- * Lee voltajes y temperaturas actuales.
- * Utiliza algoritmos diferentes según el controlador detectado previamente.
+ * STANDARD controller: one 0xD7 command returns pack, cell and temperature words.
  */
-BMSStatus MakitaBMS::readDynamicData(BatteryData &data) {
-    if (!_is_identified) return BMSStatus::ERROR_NOT_IDENTIFIED;
-    logger("--- Reading Voltages & Temperatures ---", LOG_LEVEL_INFO); 
-    
-    if (_controller == ControllerType::STANDARD) {
-        digitalWrite(_enable_pin, HIGH);
-        delay(300);
+BMSStatus MakitaBMS::readStandardDynamic(BatteryData &data, bool keep_power) {
+    byte rsp[DynamicRead::FRAME_LEN];
+    exec(READ_DYNAMIC, rsp);
+
+    // Validate response — garbage means battery not responding
+    if (isResponseGarbage(rsp, sizeof(rsp))) {
+        logger("Dynamic read: garbage response", LOG_LEVEL_DEBUG);
+        if (!keep_power) _bus.setPower(false);
+        return BMSStatus::ERROR_COMMUNICATION;
+    }
 
-        byte rsp[29];
-        cmd_and_read_cc(CMD_READ_DYNAMIC, 4, rsp, sizeof(rsp));
+    // Conversión de bytes a mV / centésimas de °C (little-endian, sin pasar por float)
+    data.pack_mv = readField(rsp, Dynamic::PACK_MV);
+    Dynamic::Cells cells = Dynamic::readCells(rsp, data.cell_count);  // celdas no usadas (4S) a cero
+    memcpy(data.cell_mv, cells.mv, sizeof(data.cell_mv));
+    data.cell_diff_mv = cells.diff_mv;
+    const uint16_t max_mv = cells.max_mv;
+    data.temp1_cC = (int16_t)readField(rsp, Dynamic::TEMP1_CC);
+    data.temp2_cC = (int16_t)readField(rsp, Dynamic::TEMP2_CC);
+
+    if (!keep_power) _bus.setPower(false);
+
+    // Sanity check: catch mid-read disconnects where partial data is 0xFF
+    if (data.pack_mv > 25000 || max_mv > 5000) {
+        logger("Dynamic read: voltage out of range (mid-read disconnect?)", LOG_LEVEL_DEBUG);
+        return BMSStatus::ERROR_COMMUNICATION;
+    }
 
-        // Validate response — garbage means battery not responding
-        if (isResponseGarbage(rsp, sizeof(rsp))) {
-            logger("Dynamic read: garbage response", LOG_LEVEL_DEBUG);
-            digitalWrite(_enable_pin, LOW);
-            return BMSStatus::ERROR_COMMUNICATION;
-        }
+    if (!keep_power) logger("Dynamic read complete.", LOG_LEVEL_INFO);
+    return BMSStatus::OK;
+}
 
-        // Conversión de bytes a voltajes reales
-        data.pack_voltage = ((rsp[1] << 8) | rsp[0]) / 1000.0f;
-        float min_v = 5.0, max_v = 0.0;
-        for(int i=0; i<data.cell_count; i++) {
-            float val = ((rsp[i*2+3] << 8) | rsp[i*2+2]) / 1000.0f;
-            data.cell_voltages[i] = val;
-            if (val > 0.5 && val < min_v) min_v = val;
-            if (val > max_v) max_v = val;
-        }
-        // Limpiamos celdas no usadas si es 4S
-        if (data.cell_count < 5) {
-            for(int i=data.cell_count; i<5; i++) data.cell_voltages[i] = 0.0;
-        }
-        data.cell_diff = (max_v > min_v) ? (max_v - min_v) : 0.0;
-        data.temp1 = ((rsp[15] << 8) | rsp[14]) / 100.0f;
-        data.temp2 = ((rsp[17] << 8) | rsp[16]) / 100.0f;
+/**
+ * F0513 controller: "Power-Request" mode. Steps: 2x clear (0xF0 0x00), one 0x31+i per cell,
+ * then temperature (0x52). Each call runs one step.
+ *
+ * Batched (default): all steps share one power window, F0513_BATCH_GAP_MS apart, so a
+ * refresh costs one 300 ms wake instead of one per command (~3 s -> ~0.35 s for 5S).
+ * If any cell comes back as 0xFFFF/0x0000 the read restarts with one power window per
+ * command; if that succeeds the controller is remembered as not accepting batches.
+ */
+void MakitaBMS::stepF0513Dynamic(BatteryData &data) {
+    const uint8_t first_cell = 2;
+    const uint8_t temp_step = first_cell + data.cell_count;
+    byte r[F0513Read::FRAME_LEN] = {0xFF, 0xFF};
+
+    if (_step < first_cell) {
+        exec(F0513_CLEAR);
+    } else if (_step < temp_step) {
+        // Solicita el voltaje de cada celda por separado
+        uint8_t i = _step - first_cell;
+        exec(F0513_CELL[i], r);
+        uint16_t raw = readField(r, F0513::CELL_MV);
+        _f0513_mv[i] = raw;
+        if (raw != 0xFFFF && raw != 0x0000) _f0513_all_garbage = false;
+        else _f0513_any_garbage = true;
+    } else {
+        exec(F0513_TEMP, r);
+        data.temp1_cC = (int16_t)readField(r, F0513::TEMP_CC);
+    }
+    if (!_f0513_batching || _step == temp_step) _bus.setPower(false);
+
+    if (_step == temp_step - 1 && _f0513_batching && _f0513_any_garbage) {
+        // El controlador no aceptó la secuencia en una sola ventana: repetir por comando
+        logger("F0513 batched read rejected, retrying with one power window per command", LOG_LEVEL_DEBUG);
+        _bus.setPower(false);
+        _metrics.ops[(size_t)_op].retries++;
+        _f0513_batching = false;
+        _f0513_fell_back = true;
+        _step = 0;
+        _f0513_all_garbage = true;
+        _f0513_any_garbage = false;
+        schedule(Phase::DYN_F0513_ON, F0513_OFF_MS);
+        return;
+    }
 
-        digitalWrite(_enable_pin, LOW);
+    if (_step == temp_step - 1 && _f0513_all_garbage) {
+        logger("F0513 dynamic read: all cells garbage", LOG_LEVEL_DEBUG);
+        finish(BMSStatus::ERROR_COMMUNICATION);
+        return;
+    }
 
-        // Sanity check: catch mid-read disconnects where partial data is 0xFF
-        if (data.pack_voltage > 25.0f || max_v > 5.0f) {
-            logger("Dynamic read: voltage out of range (mid-read disconnect?)", LOG_LEVEL_DEBUG);
-            return BMSStatus::ERROR_COMMUNICATION;
-        }
+    if (_step < temp_step) {
+        _step++;
+        if (_f0513_batching) schedule(Phase::DYN_F0513_CMD, F0513_BATCH_GAP_MS);
+        else schedule(Phase::DYN_F0513_ON, F0513_OFF_MS);
+        return;
+    }
 
-    } else if (_controller == ControllerType::F0513) {
-        // El controlador F0513 es modo "Power-Request": necesita alimentación por cada comando
-        auto exec = [&](const byte* c, uint8_t cl, byte* r, uint8_t rl) {
-            digitalWrite(_enable_pin, HIGH); delay(300);
-            cmd_and_read_cc(c, cl, r, rl);
-            digitalWrite(_enable_pin, LOW); delay(50);
-        };
-
-        const byte clr[] = {0xF0, 0x00};
-        exec(clr, 2, nullptr, 0); exec(clr, 2, nullptr, 0);
-        
-        byte r[2]; float v[5], t_v = 0;
-        bool all_garbage = true;
-        // Solicita el voltaje de cada celda por separado
-        for(int i=0; i<data.cell_count; i++) {
-            byte cmd_cell[] = {(byte)(0x31 + i)};
-            exec(cmd_cell, 1, r, 2);
-            uint16_t raw = (r[1]<<8)|r[0];
-            v[i] = raw / 1000.0f;
-            if (raw != 0xFFFF && raw != 0x0000) all_garbage = false;
+    uint16_t min_mv = 5000, max_mv = 0;
+    uint32_t total_mv = 0;
+    for(int i=0; i<5; i++) {
+        if (i < data.cell_count) {
+            uint16_t mv = _f0513_mv[i];
+            data.cell_mv[i] = mv; total_mv += mv;
+            if(mv > 500 && mv < min_mv) min_mv = mv;
+            if(mv > max_mv) max_mv = mv;
+        } else {
+            data.cell_mv[i] = 0;
         }
+    }
+    // Celdas basura (0xFFFF) podrían desbordar la suma: saturar
+    data.pack_mv = (total_mv > 0xFFFF) ? 0xFFFF : (uint16_t)total_mv;
+    data.cell_diff_mv = (max_mv > 500 && max_mv > min_mv) ? (max_mv - min_mv) : 0;
+    data.temp2_cC = 0;
+
+    // Recordar el modo que funcionó para las siguientes lecturas
+    if (_f0513_batching) {
+        _f0513_batch = F0513Batch::YES;
+    } else if (_f0513_fell_back) {
+        _f0513_batch = F0513Batch::NO;
+        logger("F0513: controller needs one power window per command", LOG_LEVEL_INFO);
+    }
 
-        if (all_garbage) {
-            logger("F0513 dynamic read: all cells garbage", LOG_LEVEL_DEBUG);
-            return BMSStatus::ERROR_COMMUNICATION;
-        }
+    logf(LOG_LEVEL_INFO, "Dynamic read complete (F0513 %s, %uS, %lu ms).",
+         _f0513_batching ? "batched" : "per-command", (unsigned)data.cell_count,
+         (unsigned long)(millis() - _op_started_ms));
+    finish(BMSStatus::OK);
+}
 
-        byte cmd_temp[] = {0x52};
-        exec(cmd_temp, 1, r, 2); data.temp1=((r[1]<<8)|r[0])/100.0f;
+// --- API bloqueante (envoltorios del API asíncrono) ---
 
-        float min_v = 5.0, max_v = 0.0;
-        for(int i=0; i<5; i++) { 
-            if (i < data.cell_count) {
-                data.cell_voltages[i] = v[i]; t_v += v[i]; 
-                if(v[i] > 0.5 && v[i] < min_v) min_v = v[i]; 
-                if(v[i] > max_v) max_v = v[i]; 
-            } else {
-                data.cell_voltages[i] = 0.0;
-            }
-        }
-        data.pack_voltage = t_v; 
-        data.cell_diff = (max_v > 0.5 && max_v > min_v) ? (max_v - min_v) : 0.0;
-        data.temp2 = 0;
-    }
-    
-    logger("Dynamic read complete.", LOG_LEVEL_INFO); 
-    return BMSStatus::OK;
+bool MakitaBMS::isPresent() {
+    if (beginPresence() != BMSStatus::OK) return false;
+    runToCompletion();
+    return _last_presence;
 }
 
-String MakitaBMS::getModel() {
-    byte rsp[16];
-    cmd_and_read_cc(CMD_GET_MODEL, 2, rsp, sizeof(rsp));
-    if (rsp[0] == 0xFF || rsp[0] == 0x00) return "";
-    char m[8]; memcpy(m, rsp, 7); m[7] = '\0';
-    return String(m);
+BMSStatus MakitaBMS::readStaticData(BatteryData &data, SupportedFeatures &features) {
+    BMSStatus status = beginStaticRead(data, features);
+    return (status == BMSStatus::OK) ? runToCompletion() : status;
 }
 
-String MakitaBMS::getF0513Model() {
-    byte cmd_99[] = {0x99};
-    cmd_and_read_cc(cmd_99, 1, nullptr, 0); delay(100);
-    makita.reset(); delayMicroseconds(400); makita.write(0x31);
-    byte r[2];
-    delayMicroseconds(90); r[0] = makita.read(); delayMicroseconds(90); r[1] = makita.read();
-    byte cmd_f0[] = {0xF0, 0x00};
-    cmd_and_read_cc(cmd_f0, 2, nullptr, 0);
-    if (r[0] == 0xFF && r[1] == 0xFF) return "";
-    char b[8]; sprintf(b, "BL%02X%02X", r[1], r[0]);
-    return String(b);
+BMSStatus MakitaBMS::readDynamicData(BatteryData &data) {
+    BMSStatus status = beginDynamicRead(data);
+    return (status == BMSStatus::OK) ? runToCompletion() : status;
 }
 
-/**
- * Control directo de los LEDs de la placa de la batería.
- */
 BMSStatus MakitaBMS::ledTest(bool on) {
-    if (!_is_identified || _controller != ControllerType::STANDARD) return BMSStatus::ERROR_NOT_AVAILABLE;
-    digitalWrite(_enable_pin, HIGH); delay(300);
-    byte b[9];
-    cmd_and_read_33(CMD_LED_TEST_INIT, 3, b, 9);
-    cmd_and_read_33(on ? CMD_LED_ON : CMD_LED_OFF, 2, b, 9);
-    digitalWrite(_enable_pin, LOW);
-    return BMSStatus::OK; 
+    BMSStatus status = beginLedTest(on);
+    return (status == BMSStatus::OK) ? runToCompletion() : status;
+}
+
+BMSStatus MakitaBMS::clearErrors() {
+    BMSStatus status = beginClearErrors();
+    return (status == BMSStatus::OK) ? runToCompletion() : status;
+}
+
+bool MakitaBMS::getModel(char (&out)[8]) {
+    byte rsp[ModelRead::FRAME_LEN];
+    exec(READ_MODEL, rsp);
+    uint8_t first = readField(rsp, Model::FIRST);
+    if (first == 0xFF || first == 0x00) return false;
+    memcpy(out, rsp + Model::TEXT_OFFSET, Model::TEXT_LEN); out[Model::TEXT_LEN] = '\0';
+    return true;
 }
 
 /**
- * Intenta borrar errores persistentes y desbloquear el controlador.
+ * Second half of the F0513 model query (the 0x99 command was sent 100 ms earlier).
+ * The answer uses its own control byte and waits before each read, so it stays outside
+ * the generic executor; the decode still goes through the field table.
  */
-BMSStatus MakitaBMS::clearErrors() {
-    if (!_is_identified || _controller != ControllerType::STANDARD) return BMSStatus::ERROR_NOT_AVAILABLE;
-    digitalWrite(_enable_pin, HIGH); delay(300);
-    byte b[9];
-    cmd_and_read_33(CMD_CLEAR_ERR_INIT, 3, b, 9);
-    cmd_and_read_33(CMD_CLEAR_ERR_EXEC, 2, b, 9);
-    digitalWrite(_enable_pin, LOW);
-    return BMSStatus::OK; 
+bool MakitaBMS::readF0513Model(char (&out)[8]) {
+    uint32_t t0 = micros();
+    bool present = busReset(); delayMicroseconds(400); busWrite(F0513::MODEL_CONTROL);
+    byte r[2];
+    delayMicroseconds(90); r[0] = busRead(); delayMicroseconds(90); r[1] = busRead();
+    recordTransaction(t0, BusCapture::RAW, F0513::MODEL_CONTROL, present, nullptr, 0, r, sizeof(r));
+    exec(F0513_CLEAR);
+    uint16_t model = readField(r, F0513::MODEL);
+    if (model == 0xFFFF) return false;
+    snprintf(out, sizeof(out), "BL%04X", model);
+    return true;
 }
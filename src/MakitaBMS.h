@@ -5,7 +5,12 @@
 
 #include <Arduino.h>
 #include <functional>
-#include "OneWireMakita.h"
+#include <esp_timer.h>
+#include "MakitaBus.h"
+#include "ControllerCache.h"
+#include "LogRing.h"
+#include "BusRecorder.h"
+#include "MakitaProtocol.h"
 
 // --- Enumeraciones y Tipos ---
 
@@ -23,32 +28,91 @@ enum class BMSStatus {
     ERROR_NOT_IDENTIFIED,      // Se intentó una acción sin haber leído primero los datos estáticos
     ERROR_MODEL_NOT_SUPPORTED, // Se detectó una batería pero su protocolo es desconocido
     ERROR_COMMUNICATION,       // Fallo de integridad o tiempo en el bus de datos
-    ERROR_NOT_AVAILABLE        // La función solicitada no existe para este modelo de batería
+    ERROR_NOT_AVAILABLE,       // La función solicitada no existe para este modelo de batería
+    ERROR_BUSY                 // Ya hay otra operación en curso en este bus
 };
 
+// Operaciones que puede ejecutar la máquina de estados del BMS
+enum class BMSOperation : uint8_t {
+    NONE,
+    PRESENCE,
+    READ_STATIC,
+    READ_DYNAMIC,
+    LED_TEST,
+    CLEAR_ERRORS,
+    IDENTIFY,      // identificación + primera lectura dinámica en una sola sesión de alimentación
+    LIVE_START,    // encendido de una sesión en vivo + primera muestra
+    LIVE_SAMPLE,   // muestra dentro de una sesión en vivo (sin ciclo de alimentación)
+    COUNT
+};
+
+const char* operationName(BMSOperation op);
+
+// Métricas del bus: duración de cada fase (contador de ciclos de la CPU, en µs) y
+// resultado de cada operación. Las escribe la tarea del bus; leerlas da una instantánea aproximada.
+struct BusMetrics {
+    enum Phase : uint8_t {
+        RESET,       // pulso de reinicio + presencia
+        WRITE_BYTE,  // por byte (las transferencias en bloque se normalizan)
+        READ_BYTE,
+        POWER_ON,    // habilitar -> primer paso real (POWER_ON_MS + retraso de la tarea)
+        PHASE_COUNT
+    };
+    struct OpCounters {
+        uint32_t ok = 0;
+        uint32_t failed = 0;
+        uint32_t retries = 0;    // reintentos internos (power cycle, lote F0513 rechazado...)
+    };
+    LatencyHistogram phases[PHASE_COUNT];
+    OpCounters ops[(size_t)BMSOperation::COUNT];
+    uint32_t garbage = 0;        // respuestas descartadas por isResponseGarbage()
+    uint32_t no_presence = 0;    // reset() sin pulso de presencia
+};
+
+const char* busPhaseName(uint8_t phase);
+
 // Función auxiliar para convertir el estado interno a un mensaje legible para el usuario
 String statusToString(BMSStatus status);
 
-// Callback para redirigir los logs (por ejemplo, a Serial o a WebSocket)
-using LogCallback = std::function<void(const String&, LogLevel)>;
+struct BatteryData;
+// Callback de fin de operación asíncrona (data es el destino pasado a begin*())
+using CompletionCallback = std::function<void(BMSOperation, BMSStatus, const BatteryData&)>;
 
 // --- Estructuras de Datos ---
 
-// Estructura para almacenar la información técnica "limpia" de la batería
+// Estado de bloqueo del controlador (nibble bajo del byte 28 de la trama estática)
+enum class LockState : uint8_t { UNKNOWN, UNLOCKED, LOCKED };
+const char* lockStateName(LockState state); // "N/A", "UNLOCKED", "LOCKED"
+
+// Fecha de fabricación empaquetada en 16 bits: (año - 2000) << 9 | mes << 5 | día (0 = desconocida)
+inline uint16_t packDate(uint8_t yy, uint8_t mm, uint8_t dd) {
+    return (uint16_t)(((yy & 0x7F) << 9) | ((mm & 0x0F) << 5) | (dd & 0x1F));
+}
+inline uint8_t dateYear(uint16_t d)  { return d >> 9; }          // 0..127 (+2000)
+inline uint8_t dateMonth(uint16_t d) { return (d >> 5) & 0x0F; }
+inline uint8_t dateDay(uint16_t d)   { return d & 0x1F; }
+
+// Estructura para almacenar la información técnica "limpia" de la batería.
+// POD de tamaño fijo (sin String): se copia sin tocar el heap. Los textos legibles
+// (fecha, capacidad, ROM ID en hex...) se generan solo al serializar para la interfaz.
+// Voltajes y temperaturas van en enteros (mV, centésimas de °C) desde el bus hasta el
+// historial; el C3 no tiene FPU y así los valores guardados son exactos.
 struct BatteryData {
-    String model = "N/A";           // Nombre del modelo (ej: BL1830)
-    int charge_cycles = 0;          // Contador total de ciclos de carga
-    String lock_status = "N/A";     // Estado de bloqueo del controlador
-    String status_code = "00";      // Código de estado interno en HEX
-    float pack_voltage = 0.0;       // Voltaje total sumado del paquete (V)
-    int cell_count = 5;             // Número de celdas en serie (5 para 18V, 4 para 14.4V)
-    float cell_voltages[5] = {0.0}; // Voltaje individual de cada una de las 5 celdas
-    float cell_diff = 0.0;          // Diferencia máxima entre la celda más alta y más baja
-    float temp1 = 0.0, temp2 = 0.0; // Temperaturas medidas por los sensores internos (°C)
-    String mfg_date = "N/A";        // Fecha de fabricación formateada
-    String capacity = "N/A";        // Capacidad nominal (ej: 5.0Ah)
-    String battery_type = "";       // Identificador del tipo de química/generación
-    String rom_id = "";             // Identificación de 8 bytes de la ROM del BMS
+    char model[8] = "N/A";          // Nombre del modelo (ej: BL1830), terminado en '\0'
+    uint16_t charge_cycles = 0;     // Contador total de ciclos de carga
+    LockState lock_status = LockState::UNKNOWN; // Estado de bloqueo del controlador
+    uint8_t status_code = 0;        // Código de estado interno (byte 27)
+    uint16_t pack_mv = 0;           // Voltaje total del paquete (mV)
+    uint8_t cell_count = 5;         // Número de celdas en serie (5 para 18V, 4 para 14.4V)
+    uint16_t cell_mv[5] = {0};      // Voltaje de cada celda tal como llega del bus (mV), 0 = no usada
+    uint16_t cell_diff_mv = 0;      // Diferencia entre la celda más alta y la más baja (mV)
+    int16_t temp1_cC = 0, temp2_cC = 0; // Temperaturas de los sensores internos (centésimas de °C)
+    uint16_t mfg_date = 0;          // Fecha de fabricación empaquetada (ver packDate)
+    uint8_t capacity_dah = 0;       // Capacidad nominal en décimas de Ah (50 = 5.0Ah)
+    uint8_t battery_type = 0;       // Identificador del tipo de química/generación
+    bool has_rom = false;           // rom_id válido (trama estática leída)
+    uint8_t rom_id[8] = {0};        // Identificación de 8 bytes de la ROM del BMS
+    uint8_t static_raw[32] = {0};   // Tabla 0xAA completa (sin el ROM ID), para diagnóstico
 };
 
 // Estructura para saber qué comandos permite ejecutar el modelo detectado
@@ -56,6 +120,7 @@ struct SupportedFeatures {
     bool read_dynamic = false; // ¿Permite leer voltajes de celdas?
     bool led_test = false;     // ¿Permite controlar los LEDs manualmente?
     bool clear_errors = false; // ¿Permite borrar errores/bloqueos?
+    bool live_session = false; // ¿Admite sesión en vivo (alimentación fija)?
 };
 
 // --- Clase Controladora Principal ---
@@ -66,63 +131,199 @@ struct SupportedFeatures {
  */
 class MakitaBMS {
 public:
-    // Comandos constantes del protocolo Makita (definidos en HEX)
-    static constexpr byte CMD_READ_STATIC[]     = {0xAA, 0x00}; // Leer tabla de datos maestros
-    static constexpr byte CMD_READ_DYNAMIC[]    = {0xD7, 0x00, 0x00, 0xFF}; // Leer voltajes/temp
-    static constexpr byte CMD_LED_TEST_INIT[]   = {0xD9, 0x96, 0xA5}; // Iniciar modo test LED
-    static constexpr byte CMD_LED_ON[]          = {0xDA, 0x31}; // Encender LEDs
-    static constexpr byte CMD_LED_OFF[]         = {0xDA, 0x34}; // Apagar LEDs
-    static constexpr byte CMD_CLEAR_ERR_INIT[]  = {0xD9, 0x96, 0xA5}; // Iniciar reseteo de errores
-    static constexpr byte CMD_CLEAR_ERR_EXEC[]  = {0xDA, 0x04}; // Ejecutar borrado
-    static constexpr byte CMD_GET_MODEL[]       = {0xDC, 0x0C}; // Consultar nombre del modelo
+    // Tipos de controladores detectados
+    enum class ControllerType : uint8_t { UNKNOWN, STANDARD, F0513 };
 
     /**
-     * @param onewire_pin Pin GPIO para datos
-     * @param enable_pin Pin GPIO para habilitar la alimentación del BMS
+     * @param bus Bus de datos + alimentación del BMS (OneWireMakita o MakitaSim)
      */
-    MakitaBMS(uint8_t onewire_pin, uint8_t enable_pin);
+    explicit MakitaBMS(MakitaBus& bus);
+
+    // Inicializa el bus (RMT o bit-bang en hardware). Llamar desde setup().
+    void begin();
     
-    // Configuración del sistema de registro de eventos
-    void setLogCallback(LogCallback callback);
+    // Configuración del sistema de registro de eventos. Los mensajes se guardan como registros
+    // binarios en un anillo preasignado; el consumidor (loop()) los formatea y envía más tarde.
     void setLogLevel(LogLevel level);
+    LogRing& logs() { return _logs; }
+
+    // Registro binario de las últimas transacciones del bus (ver BusCapture.h), descargable
+    // como /capture.bin y reproducible en el PC con tools/capture_replay.
+    BusRecorder& recorder() { return _recorder; }
+
+    // Caché persistente ROM ID -> controlador/modelo (opcional). Con un acierto, la identificación
+    // se salta los sondeos de modelo; si la primera lectura dinámica falla, la entrada se invalida.
+    void setControllerCache(ControllerCache* cache) { _cache = cache; }
 
-    // Operaciones principales
+    // Tiempos del bus y contadores por operación (ver BusMetrics). Las secciones críticas
+    // del motor bit-bang están en bus().criticalSections().
+    const BusMetrics& metrics() const { return _metrics; }
+    void clearMetrics();
+    const MakitaBus& bus() const { return _bus; }
+
+    // Operaciones principales (bloqueantes: ejecutan la máquina de estados hasta el final)
     bool isPresent(); // Verifica si hay conexión física
     BMSStatus readStaticData(BatteryData &data, SupportedFeatures &features); // Identifica el modelo
     BMSStatus readDynamicData(BatteryData &data); // Lee voltajes en tiempo real
     BMSStatus ledTest(bool on); // Prueba visual de LEDs
     BMSStatus clearErrors();    // Intenta restaurar baterías "muertas" (solo modelos compatibles)
 
+    // API asíncrona: begin*() vuelve de inmediato (OK = operación iniciada) y poll() la avanza.
+    // Los destinos (data/features) deben seguir vivos hasta el callback de fin.
+    // hold_power: si hay batería, el BMS queda alimentado y la siguiente operación se salta
+    // el despertar de POWER_ON_MS (sonda previa a la identificación). Ver releasePower().
+    BMSStatus beginPresence(bool hold_power = false);
+    BMSStatus beginStaticRead(BatteryData &data, SupportedFeatures &features);
+    BMSStatus beginDynamicRead(BatteryData &data);
+    BMSStatus beginLedTest(bool on);
+    BMSStatus beginClearErrors();
+
+    // Identificación y primera lectura dinámica sin apagar entre medias cuando el controlador
+    // lo permite. El estado del callback es el de la identificación; el de la lectura
+    // dinámica queda en lastSampleStatus().
+    BMSStatus beginIdentifyAndSample(BatteryData &data, SupportedFeatures &features);
+    BMSStatus lastSampleStatus() const { return _sample_status; }
+
+    // Sesión en vivo (solo STANDARD): el BMS queda alimentado y cada muestra es un único 0xD7,
+    // sin los 300 ms de despertar. Un watchdog (esp_timer) corta la alimentación si pasan
+    // LIVE_WATCHDOG_MS sin muestras. Cualquier otra operación cierra la sesión.
+    BMSStatus beginLiveSession(BatteryData &data);  // enciende, espera POWER_ON_MS y toma la primera muestra
+    BMSStatus beginLiveSample(BatteryData &data);   // muestra inmediata
+    void endLiveSession();                          // apaga el BMS y desarma el watchdog
+    bool liveActive() const { return _live; }
+    bool liveTripped() const { return _live_tripped; } // el watchdog cortó la alimentación
+
+    void setCompletionCallback(CompletionCallback callback);
+    bool poll();                      // true si no queda operación en curso
+    bool busy() const { return _phase != Phase::IDLE; }
+    uint32_t msUntilNextStep() const; // tiempo hasta el próximo paso (0 = ya)
+    BMSOperation operation() const { return _op; }
+    void releasePower();              // apaga un BMS retenido por beginPresence(true)
+    bool lastPresence() const { return _last_presence; }
+
+    // Tiempos de alimentación del BMS (ms)
+    static constexpr uint32_t POWER_ON_MS = 300;        // despertar tras habilitar
+    static constexpr uint32_t POWER_OFF_MS = 100;       // apagado en un power cycle
+    static constexpr uint32_t F0513_OFF_MS = 50;        // apagado entre comandos F0513
+    static constexpr uint32_t F0513_MODEL_GAP_MS = 100; // 0x99 -> lectura de modelo F0513
+    static constexpr uint32_t F0513_BATCH_GAP_MS = 5;   // entre comandos F0513 dentro de una misma ventana
+    static constexpr uint32_t LIVE_WATCHDOG_MS = 2000;  // máximo sin muestras en una sesión en vivo
+
 private:
-    OneWireMakita makita; // Capa de abstracción del bus físico
-    uint8_t _enable_pin;   // Pin de control de alimentación
+    // Fases de la máquina de estados; cada una se ejecuta al vencer _deadline
+    enum class Phase : uint8_t {
+        IDLE,
+        CYCLE_ON,           // fin del apagado de un power cycle -> encender y seguir en _resume
+        PRESENCE_PROBE,
+        STATIC_READ,
+        MODEL_STANDARD,
+        MODEL_F0513_CMD,
+        MODEL_F0513_READ,
+        DYN_STANDARD,
+        DYN_F0513_ON,
+        DYN_F0513_CMD,
+        SERVICE_EXEC,       // LED test / clear errors (dos transacciones 0x33)
+        LIVE_WAKE,          // primera muestra de una sesión en vivo
+        LIVE_SAMPLE
+    };
+
+    MakitaBus& _bus;       // Bus físico (o simulado) y línea de alimentación
     
-    // Tipos de controladores detectados
-    enum class ControllerType { UNKNOWN, STANDARD, F0513 } _controller = ControllerType::UNKNOWN;
+    ControllerType _controller = ControllerType::UNKNOWN;
     bool _is_identified = false; // Flag para asegurar el flujo correcto de comandos
+    ControllerCache* _cache = nullptr;
+    bool _identity_from_cache = false; // identificado por caché y aún sin lectura dinámica válida
+    byte _rom[8] = {0};
     
-    LogCallback _log;
-    LogLevel _logLevel = LOG_LEVEL_DEBUG;
+    LogRing _logs;
+    BusRecorder _recorder;
+    volatile LogLevel _logLevel = LOG_LEVEL_DEBUG;
+
+    BusMetrics _metrics;
+    uint32_t _cycles_per_us = 160;
+    uint32_t _power_on_cycles = 0;
+    bool _timing_power_on = false;     // hay una espera de encendido pendiente de medir
+
+    // Estado de la operación asíncrona en curso
+    Phase _phase = Phase::IDLE;
+    Phase _resume = Phase::IDLE;
+    uint32_t _deadline = 0;
+    BMSOperation _op = BMSOperation::NONE;
+    BMSStatus _last_status = BMSStatus::OK;
+    bool _last_presence = false;
+    CompletionCallback _on_complete;
+    BatteryData* _target = nullptr;
+    SupportedFeatures* _features = nullptr;
+    BatteryData _scratch;              // destino para operaciones sin datos (LED, presencia...)
+    byte _rsp[MakitaProtocol::StaticRead::FRAME_LEN]; // trama estática 0x33/0xAA (ROM ID + tabla)
+    uint8_t _attempt = 0;
+    uint8_t _step = 0;                 // paso F0513 en curso
+    uint16_t _f0513_mv[5] = {0};
+    bool _f0513_all_garbage = true;
+    bool _f0513_any_garbage = false;
+    // Lectura F0513 por lotes (toda la secuencia en una ventana de alimentación).
+    // UNKNOWN hasta la primera lectura; NO si el controlador solo responde con una ventana por comando.
+    enum class F0513Batch : uint8_t { UNKNOWN, YES, NO } _f0513_batch = F0513Batch::UNKNOWN;
+    bool _f0513_batching = false;      // modo de la lectura en curso
+    bool _f0513_fell_back = false;     // la lectura en curso abandonó el lote
+    uint32_t _op_started_ms = 0;
+    bool _hold_power = false;          // sonda de presencia en curso con hold_power
+    bool _power_held = false;          // BMS alimentado y despierto, listo para la siguiente operación
+    uint8_t _wakes = 0;                // ventanas de alimentación abiertas en la operación en curso
+    bool _sample_after_identify = false; // IDENTIFY: encadenar la lectura dinámica
+    bool _identify_sampling = false;     // IDENTIFY: identificación hecha, lectura en curso
+    BMSStatus _sample_status = BMSStatus::OK;
+    const MakitaProtocol::ServiceAction* _service_action = nullptr;
+
+    // Sesión en vivo
+    bool _live = false;
+    volatile bool _live_tripped = false;   // escrito desde la tarea esp_timer
+    esp_timer_handle_t _live_timer = nullptr;
+
+    void schedule(Phase next, uint32_t wait_ms);
+    void powerOn(Phase next);
+    void step();
+    void finish(BMSStatus status);
+    BMSStatus runToCompletion();
+    void parseStaticFrame(BatteryData &data);
+    bool identifyFromCache();
+    bool identifyInSameWindow();
+    void startDynamic(bool powered);
+    void completeIdentification();
+    BMSStatus readStandardDynamic(BatteryData &data, bool keep_power = false);
+    void stepF0513Dynamic(BatteryData &data);
+    bool armLiveWatchdog();
+    static void liveWatchdogExpired(void* arg);
     
-    // Funciones internas de comunicación por el bus
-    bool cmd_and_read_33(const byte* cmd, uint8_t cmd_len, byte* rsp, uint8_t rsp_len);
-    bool cmd_and_read_cc(const byte* cmd, uint8_t cmd_len, byte* rsp, uint8_t rsp_len);
+    // Ejecutor genérico: una instancia por tipo de comando de MakitaProtocol.
+    // Devuelve true si reset() detectó el pulso de presencia.
+    template <class C> bool exec(const C& cmd, byte (&frame)[C::FRAME_LEN]);
+    template <class C> bool exec(const C& cmd);   // comandos sin respuesta
+    void recordTransaction(uint32_t t0_us, uint8_t kind, uint8_t control, bool present,
+                           const byte* tx, uint8_t tx_len, const byte* rx, uint8_t rx_len);
 
-    // Power cycling and retry logic for reliable BMS wake-up
-    void powerCycle();
-    bool resetWithRetry(uint8_t max_attempts = 3);
-    static bool isResponseGarbage(const byte* data, uint8_t len);
+    // Power cycling for reliable BMS wake-up
+    void powerCycle(Phase resume);
+    bool isResponseGarbage(const byte* data, uint8_t len);
 
-    // Utilidad para corregir el orden de los bits/nibbles en algunos campos
-    byte nibble_swap(byte b) { return (b >> 4) | (b << 4); }
+    // Transacciones del bus con medida de tiempos (todas las llamadas a _bus pasan por aquí)
+    bool busReset();
+    void busWrite(uint8_t v);
+    uint8_t busRead();
+    void busWriteBytes(const byte* data, uint8_t len, uint16_t gap_us);
+    void busReadBytes(byte* data, uint8_t len, uint16_t gap_us);
+    void notePhase(BusMetrics::Phase phase, uint32_t start_cycles, uint8_t bytes = 1);
 
-    // Métodos específicos de identificación por tipo de hardware
-    String getModel();
-    String getF0513Model();
+    // Métodos específicos de identificación por tipo de hardware.
+    // Escriben el modelo en out (terminado en '\0'); false si el BMS no respondió.
+    bool getModel(char (&out)[8]);
+    bool readF0513Model(char (&out)[8]);
 
     // Gestión interna de logs y volcado de datos
-    void logger(const String& message, LogLevel level); 
-    void log_hex(const String& prefix, const byte* data, int len);
+    void logger(const char* message, LogLevel level);
+    // Variante printf con búfer fijo en la pila (se trunca a LogRecord::PAYLOAD)
+    void logf(LogLevel level, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+    void log_hex(const char* prefix, const byte* data, int len); // prefix: literal
 };
 
 #endif
@@ -0,0 +1,180 @@
+// src/MakitaProtocol.h - PROTOCOL DESCRIPTOR TABLE
+
+#ifndef MAKITA_PROTOCOL_H
+#define MAKITA_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Compile-time description of the Makita BMS commands and of the frames they return.
+ *
+ * A Command carries its transport (control byte), TX bytes and RX length in its type, so
+ * MakitaBMS::exec() is instantiated per command with no runtime branching on transport or
+ * lengths. A Field locates a value inside a response frame (offset, width, byte order,
+ * nibble swap, mask); readField() folds to plain loads and shifts when the field is a
+ * constant. Supporting a new command or field means adding an entry here.
+ *
+ * Frame layout: 0x33 commands return the 8-byte ROM ID first, so their frames are
+ * 8 + RX bytes and field offsets count from the start of the ROM ID. 0xCC commands
+ * return RX bytes.
+ */
+namespace MakitaProtocol {
+
+// The value is the control byte sent after the reset pulse
+enum class Transport : uint8_t {
+    ROM_33 = 0x33,   // read the 8-byte ROM ID, then send the command
+    SKIP_CC = 0xCC   // send the command directly
+};
+
+enum class Endian : uint8_t { LITTLE, BIG };
+
+template <Transport T, uint8_t TX, uint8_t RX>
+struct Command {
+    static constexpr Transport TRANSPORT = T;
+    static constexpr uint8_t TX_LEN = TX;
+    static constexpr uint8_t RX_LEN = RX;
+    static constexpr uint8_t RX_OFFSET = (T == Transport::ROM_33) ? 8 : 0;
+    static constexpr uint8_t FRAME_LEN = RX_OFFSET + RX;
+
+    uint8_t tx[TX];
+};
+
+struct Field {
+    uint8_t offset;
+    uint8_t width;            // 1 or 2 bytes
+    Endian endian;
+    bool nibble_swap;         // swap the nibbles of each byte before assembling
+    uint16_t mask;
+};
+
+constexpr uint8_t swapNibbles(uint8_t b) { return (uint8_t)((b >> 4) | (b << 4)); }
+
+constexpr uint16_t readField(const uint8_t* frame, const Field& f) {
+    uint8_t a = f.nibble_swap ? swapNibbles(frame[f.offset]) : frame[f.offset];
+    if (f.width == 1) return a & f.mask;
+    uint8_t b = f.nibble_swap ? swapNibbles(frame[f.offset + 1]) : frame[f.offset + 1];
+    uint16_t v = (f.endian == Endian::BIG) ? (uint16_t)((a << 8) | b) : (uint16_t)((b << 8) | a);
+    return v & f.mask;
+}
+
+constexpr Field byteAt(uint8_t offset, uint16_t mask = 0xFF) {
+    return Field{offset, 1, Endian::LITTLE, false, mask};
+}
+constexpr Field le16(uint8_t offset) {
+    return Field{offset, 2, Endian::LITTLE, false, 0xFFFF};
+}
+
+// A response that is the idle pull-up (0xFF) or a shorted line (0x00) rather than an
+// answer. The first GARBAGE_PROBE_LEN bytes decide; an empty response is garbage.
+constexpr uint8_t GARBAGE_PROBE_LEN = 3;
+
+inline bool isGarbage(const uint8_t* frame, uint8_t len) {
+    if (frame == nullptr || len == 0) return true;
+    uint8_t check = (len < GARBAGE_PROBE_LEN) ? len : GARBAGE_PROBE_LEN;
+    bool all_ff = true, all_00 = true;
+    for (uint8_t i = 0; i < check; i++) {
+        if (frame[i] != 0xFF) all_ff = false;
+        if (frame[i] != 0x00) all_00 = false;
+    }
+    return all_ff || all_00;
+}
+
+// Cells in series for a model name: "BL14xx" packs are 4S, the rest 5S
+inline uint8_t cellCountForModel(const char* model) {
+    return strncmp(model, "BL14", 4) == 0 ? 4 : 5;
+}
+
+// --- 0xAA: static data (ROM ID + 32-byte table) ---
+using StaticRead = Command<Transport::ROM_33, 2, 32>;
+constexpr StaticRead READ_STATIC = {{0xAA, 0x00}};
+
+namespace Static {
+constexpr Field ROM_ID_FIRST = byteAt(0);       // 8 bytes of ROM ID from here
+constexpr uint8_t ROM_ID_LEN = 8;
+constexpr Field DATE_YEAR    = byteAt(0);       // the ROM ID starts with the build date
+constexpr Field DATE_MONTH   = byteAt(1);
+constexpr Field DATE_DAY     = byteAt(2);
+constexpr Field TYPE_CODE    = byteAt(19);      // raw, as stored in the controller cache
+constexpr Field TYPE         = Field{19, 1, Endian::LITTLE, true, 0xFF};
+constexpr Field CAPACITY_CODE = byteAt(24);
+constexpr Field CAPACITY     = Field{24, 1, Endian::LITTLE, true, 0xFF};  // tenths of Ah
+constexpr Field STATUS       = byteAt(27);
+constexpr Field LOCK         = byteAt(28, 0x0F); // non-zero = locked
+constexpr Field CYCLES       = Field{34, 2, Endian::BIG, true, 0x0FFF};
+// Community notes put overdischarge/overload counters at bytes 29/30. No capture
+// confirms them yet, so they are not decoded: TABLE exposes the raw bytes instead.
+constexpr uint8_t TABLE_OFFSET = 8;             // the 32 bytes after the ROM ID
+constexpr uint8_t TABLE_LEN = StaticRead::RX_LEN;
+}
+
+// --- 0xD7: STANDARD dynamic data ---
+using DynamicRead = Command<Transport::SKIP_CC, 4, 29>;
+constexpr DynamicRead READ_DYNAMIC = {{0xD7, 0x00, 0x00, 0xFF}};
+
+namespace Dynamic {
+constexpr Field PACK_MV  = le16(0);
+constexpr Field CELL_MV[5] = {le16(2), le16(4), le16(6), le16(8), le16(10)};
+constexpr Field TEMP1_CC = le16(14);
+constexpr Field TEMP2_CC = le16(16);
+
+// The first cell_count cells of a frame (the others are zeroed), their spread and the
+// highest one. Readings under 500 mV are left out of the minimum.
+struct Cells {
+    uint16_t mv[5];
+    uint16_t diff_mv;
+    uint16_t max_mv;
+};
+
+inline Cells readCells(const uint8_t* frame, uint8_t cell_count) {
+    Cells c = {{0, 0, 0, 0, 0}, 0, 0};
+    uint16_t min_mv = 5000;
+    for (uint8_t i = 0; i < cell_count && i < 5; i++) {
+        uint16_t mv = readField(frame, CELL_MV[i]);
+        c.mv[i] = mv;
+        if (mv > 500 && mv < min_mv) min_mv = mv;
+        if (mv > c.max_mv) c.max_mv = mv;
+    }
+    c.diff_mv = (c.max_mv > min_mv) ? (uint16_t)(c.max_mv - min_mv) : 0;
+    return c;
+}
+}
+
+// --- 0xDC 0x0C: STANDARD model name ---
+using ModelRead = Command<Transport::SKIP_CC, 2, 16>;
+constexpr ModelRead READ_MODEL = {{0xDC, 0x0C}};
+
+namespace Model {
+constexpr Field FIRST = byteAt(0);              // 0x00/0xFF = no answer
+constexpr uint8_t TEXT_OFFSET = 0;
+constexpr uint8_t TEXT_LEN = 7;
+}
+
+// --- Service mode (LED test, clear errors): enter, then one action ---
+using ServiceEnter = Command<Transport::ROM_33, 3, 9>;
+using ServiceAction = Command<Transport::ROM_33, 2, 9>;
+constexpr ServiceEnter SERVICE_ENTER = {{0xD9, 0x96, 0xA5}};
+constexpr ServiceAction LED_ON       = {{0xDA, 0x31}};
+constexpr ServiceAction LED_OFF      = {{0xDA, 0x34}};
+constexpr ServiceAction CLEAR_ERRORS = {{0xDA, 0x04}};
+
+// --- F0513 controller ---
+using F0513Command = Command<Transport::SKIP_CC, 1, 0>;
+using F0513Clear = Command<Transport::SKIP_CC, 2, 0>;
+using F0513Read = Command<Transport::SKIP_CC, 1, 2>;
+constexpr F0513Command F0513_MODEL_REQUEST = {{0x99}};  // answer read with the 0x31 sequence
+constexpr F0513Clear F0513_CLEAR = {{0xF0, 0x00}};
+constexpr F0513Read F0513_CELL[5] = {{{0x31}}, {{0x32}}, {{0x33}}, {{0x34}}, {{0x35}}};
+constexpr F0513Read F0513_TEMP = {{0x52}};
+
+namespace F0513 {
+constexpr uint8_t MODEL_CONTROL = 0x31;         // control byte of the model answer
+constexpr Field MODEL   = le16(0);              // printed as "BL%04X"
+constexpr Field CELL_MV = le16(0);
+constexpr Field TEMP_CC = le16(0);
+}
+
+} // namespace MakitaProtocol
+
+#endif
@@ -0,0 +1,90 @@
+// src/Telemetry.h - BINARY DYNAMIC TELEMETRY AND DELTA ENCODING
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// dynamic_data as a packed little-endian frame (the C3 is little-endian, so it is sent as is)
+struct __attribute__((packed)) TelemetryFrame {
+    uint8_t  type;          // TELEMETRY_DYNAMIC
+    uint8_t  version;       // TELEMETRY_VERSION
+    uint8_t  bay;
+    uint8_t  cell_count;
+    uint16_t pack_mv;
+    uint16_t cell_mv[5];    // unused cells = 0
+    uint16_t cell_diff_mv;
+    int16_t  temp1_cC;      // °C×100
+    int16_t  temp2_cC;
+};
+const uint8_t TELEMETRY_DYNAMIC = 0x01;
+const uint8_t TELEMETRY_VERSION = 1;
+static_assert(sizeof(TelemetryFrame) == 22, "TelemetryFrame layout is decoded by data/app.js");
+
+// Delta updates: between keyframes a dynamic update carries only the field groups that
+// moved by at least the threshold since they were last sent (TELEMETRY_DELTA frame or a
+// dynamic_data message with "delta":true). Unchanged readings send nothing.
+const uint8_t TELEMETRY_DELTA = 0x02;
+enum DynamicField : uint8_t {
+    DYN_PACK = 0x01, DYN_CELLS = 0x02, DYN_DIFF = 0x04, DYN_TEMP1 = 0x08, DYN_TEMP2 = 0x10,
+    DYN_ALL = 0x1F
+};
+
+// Longest TELEMETRY_DELTA frame: header plus every group with five cells
+const size_t TELEMETRY_DELTA_MAX = 5 + sizeof(uint16_t) * 9;
+
+inline bool movedBy(int32_t a, int32_t b, uint16_t threshold) {
+    return (a > b ? a - b : b - a) >= threshold;
+}
+
+/**
+ * Field groups of `now` that moved from `sent` by at least mv (pack, cells, diff) or
+ * centi_c (temperatures).
+ */
+inline uint8_t changedFields(const TelemetryFrame& sent, const TelemetryFrame& now, uint16_t mv, uint16_t centi_c) {
+    uint8_t fields = 0;
+    if (movedBy(now.pack_mv, sent.pack_mv, mv)) fields |= DYN_PACK;
+    for (uint8_t i = 0; i < now.cell_count && i < 5; i++) {
+        if (movedBy(now.cell_mv[i], sent.cell_mv[i], mv)) fields |= DYN_CELLS;
+    }
+    if (movedBy(now.cell_diff_mv, sent.cell_diff_mv, mv)) fields |= DYN_DIFF;
+    if (movedBy(now.temp1_cC, sent.temp1_cC, centi_c)) fields |= DYN_TEMP1;
+    if (movedBy(now.temp2_cC, sent.temp2_cC, centi_c)) fields |= DYN_TEMP2;
+    return fields;
+}
+
+/**
+ * Copies the groups in `fields` from `now` into the baseline the clients hold.
+ */
+inline void applyFields(TelemetryFrame& sent, const TelemetryFrame& now, uint8_t fields) {
+    if (fields & DYN_PACK) sent.pack_mv = now.pack_mv;
+    if (fields & DYN_CELLS) memcpy(sent.cell_mv, now.cell_mv, sizeof(now.cell_mv));
+    if (fields & DYN_DIFF) sent.cell_diff_mv = now.cell_diff_mv;
+    if (fields & DYN_TEMP1) sent.temp1_cC = now.temp1_cC;
+    if (fields & DYN_TEMP2) sent.temp2_cC = now.temp2_cC;
+}
+
+/**
+ * TELEMETRY_DELTA frame: type, version, bay, field mask, cell count, then the little-endian
+ * values of the groups in the mask, in DynamicField order (cells: cell_count values).
+ * `out` must hold TELEMETRY_DELTA_MAX bytes.
+ */
+inline size_t encodeDelta(const TelemetryFrame& now, uint8_t fields, uint8_t* out) {
+    size_t n = 0;
+    auto put16 = [&](uint16_t v) { out[n++] = v & 0xFF; out[n++] = v >> 8; };
+    out[n++] = TELEMETRY_DELTA;
+    out[n++] = TELEMETRY_VERSION;
+    out[n++] = now.bay;
+    out[n++] = fields;
+    out[n++] = now.cell_count;
+    if (fields & DYN_PACK) put16(now.pack_mv);
+    if (fields & DYN_CELLS) for (uint8_t i = 0; i < now.cell_count && i < 5; i++) put16(now.cell_mv[i]);
+    if (fields & DYN_DIFF) put16(now.cell_diff_mv);
+    if (fields & DYN_TEMP1) put16((uint16_t)now.temp1_cC);
+    if (fields & DYN_TEMP2) put16((uint16_t)now.temp2_cC);
+    return n;
+}
+
+#endif
@@ -0,0 +1,34 @@
+// src/TelemetryJson.h - dynamic_data JSON FOR CLIENTS WITHOUT BINARY TELEMETRY
+
+#ifndef TELEMETRY_JSON_H
+#define TELEMETRY_JSON_H
+
+#include <ArduinoJson.h>
+#include "Telemetry.h"
+
+// Integer mV / centi-°C become volts and °C only here, for the UI
+inline void addDynamicFields(JsonObject dataObj, const TelemetryFrame& frame, uint8_t fields) {
+    if (fields & DYN_PACK) dataObj["pack_voltage"] = frame.pack_mv / 1000.0f;
+    if (fields & DYN_CELLS) {
+        JsonArray cellV = dataObj.createNestedArray("cell_voltages");
+        for (uint8_t i = 0; i < frame.cell_count && i < 5; i++) cellV.add(frame.cell_mv[i] / 1000.0f);
+    }
+    if (fields & DYN_DIFF) dataObj["cell_diff"] = frame.cell_diff_mv / 1000.0f;
+    if (fields & DYN_TEMP1) dataObj["temp1"] = frame.temp1_cC / 100.0f;
+    if (fields & DYN_TEMP2) dataObj["temp2"] = frame.temp2_cC / 100.0f;
+}
+
+/**
+ * dynamic_data message: the JSON form of a TelemetryFrame (fields = DYN_ALL, a keyframe)
+ * or of a TELEMETRY_DELTA ("delta": true, only the groups in fields).
+ * Static fields are never included: the client merges dynamic_data into its last
+ * static_data, so a keyframe must not overwrite model, cycles or ROM ID.
+ */
+inline void buildDynamicJson(JsonDocument& doc, const TelemetryFrame& frame, uint8_t fields) {
+    doc["type"] = "dynamic_data";
+    doc["bay"] = frame.bay;
+    if (fields != DYN_ALL) doc["delta"] = true;
+    addDynamicFields(doc.createNestedObject("data"), frame, fields);
+}
+
+#endif
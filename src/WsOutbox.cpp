@@ -0,0 +1,89 @@
+// src/WsOutbox.cpp - PER-CLIENT WEBSOCKET SEND QUEUE
+
+#include "WsOutbox.h"
+
+// Messages leaving the queue are moved into locals and released after the critical
+// section: dropping the last reference frees the payload.
+
+WsOutbox::Result WsOutbox::push(WsMessage msg) {
+    WsMessage evicted;
+    Result result = QUEUED;
+    portENTER_CRITICAL(&_mux);
+    int16_t same = -1, oldestDebug = -1;
+    for (uint8_t i = 0; i < _count; i++) {
+        const WsMessage& m = at(i);
+        if (msg.kind == WsMessage::DYNAMIC && m.kind == WsMessage::DYNAMIC && m.bay == msg.bay) same = i;
+        if (m.kind == WsMessage::DEBUG && oldestDebug < 0) oldestDebug = i;
+    }
+    if (same >= 0) {
+        std::swap(at(same), msg);
+        _stats.coalesced++;
+        result = COALESCED;
+    } else {
+        if (_count == DEPTH && oldestDebug >= 0) {
+            removeAt(oldestDebug, evicted);
+            _stats.dropped++;
+        }
+        if (_count < DEPTH) {
+            at(_count) = std::move(msg);
+            _count++;
+            if (_count > _stats.max_queued) _stats.max_queued = _count;
+        } else if (msg.kind == WsMessage::CONTROL) {
+            result = OVERFLOW;
+        } else {
+            _stats.dropped++;
+            result = DROPPED;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+    return result;
+}
+
+bool WsOutbox::pop(WsMessage& out) {
+    WsMessage previous;
+    portENTER_CRITICAL(&_mux);
+    bool ok = _count > 0;
+    if (ok) {
+        std::swap(previous, out);
+        out = std::move(at(0));
+        _head = (_head + 1) % DEPTH;
+        _count--;
+        _stats.sent++;
+    }
+    portEXIT_CRITICAL(&_mux);
+    return ok;
+}
+
+bool WsOutbox::hasDynamic(uint8_t bay) const {
+    bool found = false;
+    portENTER_CRITICAL(&_mux);
+    for (uint8_t i = 0; i < _count && !found; i++) {
+        found = at(i).kind == WsMessage::DYNAMIC && at(i).bay == bay;
+    }
+    portEXIT_CRITICAL(&_mux);
+    return found;
+}
+
+void WsOutbox::clear() {
+    for (;;) {
+        WsMessage m;
+        portENTER_CRITICAL(&_mux);
+        bool more = _count > 0;
+        if (more) {
+            m = std::move(at(0));
+            _head = (_head + 1) % DEPTH;
+            _count--;
+        } else {
+            _head = 0;
+            _stats = Stats();
+        }
+        portEXIT_CRITICAL(&_mux);
+        if (!more) return;
+    }
+}
+
+void WsOutbox::removeAt(uint8_t i, WsMessage& removed) {
+    removed = std::move(at(i));
+    for (uint8_t j = i; j + 1 < _count; j++) at(j) = std::move(at(j + 1));
+    _count--;
+}
@@ -0,0 +1,77 @@
+// src/WsOutbox.h - PER-CLIENT WEBSOCKET SEND QUEUE
+
+#ifndef WS_OUTBOX_H
+#define WS_OUTBOX_H
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+#ifndef MAKITA_WS_OUTBOX_DEPTH
+#define MAKITA_WS_OUTBOX_DEPTH 16   // frames waiting per client
+#endif
+
+/**
+ * One outgoing WebSocket frame. The payload is shared: a broadcast is serialized once
+ * and every client's outbox holds a reference to it.
+ */
+struct WsMessage {
+    enum Kind : uint8_t {
+        CONTROL,    // responses and state changes: never dropped
+        DYNAMIC,    // live readings: at most one queued per bay, newer ones replace it
+        DEBUG       // "debug" / log_batch lines: dropped first when the client is behind
+    };
+    std::shared_ptr<const std::string> payload;
+    bool binary = false;
+    uint8_t kind = CONTROL;
+    uint8_t bay = 0;
+};
+
+/**
+ * Bounded send queue of one WebSocket client. Producers (loop() and the AsyncTCP task)
+ * push; only loop() pops, and only while the client's AsyncTCP queue has room, so a
+ * stalled client backs up here instead of in the library and the others keep their rate.
+ *
+ * A DYNAMIC message replaces the queued one of the same bay (coalesced). When the queue
+ * is full the oldest DEBUG message makes room; a DEBUG or DYNAMIC message that still does
+ * not fit is dropped. CONTROL messages are never dropped: if they alone fill the queue,
+ * push() returns OVERFLOW and the caller closes the connection (the page reconnects and
+ * is resynced).
+ */
+class WsOutbox {
+public:
+    static constexpr uint8_t DEPTH = MAKITA_WS_OUTBOX_DEPTH;
+    enum Result : uint8_t { QUEUED, COALESCED, DROPPED, OVERFLOW };
+
+    struct Stats {
+        uint8_t max_queued = 0;
+        uint32_t sent = 0;
+        uint32_t coalesced = 0;     // DYNAMIC replaced by a newer one before it was sent
+        uint32_t dropped = 0;       // DEBUG / DYNAMIC discarded
+    };
+
+    Result push(WsMessage msg);
+
+    // Consumer side (loop() only): moves the oldest message into out; false if empty
+    bool pop(WsMessage& out);
+
+    bool hasDynamic(uint8_t bay) const;
+    uint8_t size() const { return _count; }
+    const Stats& stats() const { return _stats; }
+
+    // Empties the queue and resets the stats (the slot is reused by a new client)
+    void clear();
+
+private:
+    WsMessage _queue[DEPTH];
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+    Stats _stats;
+    mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+    WsMessage& at(uint8_t i) { return _queue[(_head + i) % DEPTH]; }
+    const WsMessage& at(uint8_t i) const { return _queue[(_head + i) % DEPTH]; }
+    void removeAt(uint8_t i, WsMessage& removed);
+};
+
+#endif
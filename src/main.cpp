@@ -9,7 +9,19 @@
 #include "FS.h"
 #include "LittleFS.h"
 #include <Update.h>
+#include <memory>
 #include "MakitaBMS.h"
+#include "BMSWorker.h"
+#include "ControllerCache.h"
+#include "WsOutbox.h"
+#include "Telemetry.h"
+#include "TelemetryJson.h"
+#include "HistoryFile.h"
+#ifdef MAKITA_SIMULATED_BMS
+#include "MakitaSim.h"
+#else
+#include "OneWireMakita.h"
+#endif
 
 // --- Declaraciones Forward (Prototipos) ---
 void saveConfig(const String& lang, const String& theme, const String& ssid = "", const String& pass = "");
@@ -22,6 +34,17 @@ String statusToString(BMSStatus status);
 // Pin GPIO para la señal de habilitación del BMS (directo, sin transistor NPN)
 #define ENABLE_PIN  3
 
+// Bahías: un par de pines (datos, habilitación) por batería. Por defecto una sola bahía;
+// para más, p. ej. -DMAKITA_BAY_PINS="{{4,3},{5,6}}" (hasta BMSWorker::MAX_BAYS).
+// Las dos primeras bahías usan los canales RMT del C3; el resto, el motor bit-bang.
+#ifndef MAKITA_BAY_PINS
+#define MAKITA_BAY_PINS {{ONEWIRE_PIN, ENABLE_PIN}}
+#endif
+struct BayPins { uint8_t data; uint8_t enable; };
+const BayPins BAY_PINS[] = MAKITA_BAY_PINS;
+const uint8_t BAY_COUNT = sizeof(BAY_PINS) / sizeof(BAY_PINS[0]);
+static_assert(BAY_COUNT >= 1 && BAY_COUNT <= BMSWorker::MAX_BAYS, "MAKITA_BAY_PINS: 1..MAX_BAYS bays");
+
 // SSID del Punto de Acceso WiFi que creará el ESP32
 const char* ssid = "Makita_OBI_ESP32";
 
@@ -34,11 +57,19 @@ AsyncWebSocket ws("/ws");
 // SSID del Punto de Acceso WiFi que creará el ESP32
 const char* ssid_ap = "Makita_OBI_ESP32";
 
-// Instancia de la clase controladora del BMS de Makita
-MakitaBMS bms(ONEWIRE_PIN, ENABLE_PIN);
-
-// Caché global de datos para mantener la información estática al solicitar actualizaciones dinámicas
-static BatteryData cached_data;
+// Bus de cada bahía: el real (GPIO/RMT) o, con -DMAKITA_SIMULATED_BMS, una batería simulada.
+// Se crean en setup() (los constructores tocan los pines).
+#ifdef MAKITA_SIMULATED_BMS
+MakitaSim* buses[BAY_COUNT];
+#else
+OneWireMakita* buses[BAY_COUNT];
+#endif
+// Instancia de la clase controladora del BMS de Makita, una por bahía
+MakitaBMS* bms[BAY_COUNT];
+// Caché persistente de identificación (ROM ID -> controlador/modelo), compartida por las bahías
+ControllerCache controllerCache;
+// Tarea dedicada al bus: todas las operaciones de todas las bahías se encolan aquí
+BMSWorker worker;
 // Configuración persistente (WiFi Station)
 static String current_lang = "en";
 static String current_theme = "light";
@@ -46,64 +77,372 @@ static String current_wifi_ssid = "";
 static String current_wifi_pass = "";
 
 // Auto-detection timing and state
-const unsigned long DETECTION_INTERVAL = 5000;      // 5s normal polling
-const unsigned long BACKOFF_INTERVAL = 15000;        // 15s after repeated failures
+// An empty bay is watched with a cheap presence probe (power-on + reset, no data);
+// a full identification only runs when a pack answers, plus an ungated attempt every
+// DETECTION_INTERVAL for packs that miss the presence pulse.
+#ifdef MAKITA_INSERT_IRQ
+const unsigned long PROBE_INTERVAL = 2000;          // insertion edges trigger a probe right away
+#else
+const unsigned long PROBE_INTERVAL = 500;           // presence probe while no battery is identified
+#endif
+const unsigned long DETECTION_INTERVAL = 30000;     // ungated identification fallback
+const unsigned long BACKOFF_INTERVAL = 15000;        // 15s after repeated identification failures
 const unsigned long DYNAMIC_READ_INTERVAL = 10000;   // 10s between dynamic reads
 const uint8_t MAX_DETECTION_ATTEMPTS = 3;            // failures before backing off
 const uint8_t MAX_DYNAMIC_FAILS = 2;                 // consecutive fails before disconnect
 
-unsigned long lastDetectionAttempt = 0;
-bool lastPresenceState = false;
-bool autoReadIdentified = false;
-unsigned long lastDynamicRead = 0;
-uint8_t detectionFailCount = 0;          // consecutive static read failures
-uint8_t dynamicFailCount = 0;            // consecutive dynamic read failures
-SupportedFeatures cached_features;
-bool historyRecorded = false;            // one snapshot per insertion
+// Live session: BMS stays powered and the worker samples at liveRateHz.
+// Clients must send live_keepalive; without it (or with no clients) the session is closed.
+const unsigned long LIVE_IDLE_TIMEOUT = 30000;
+
+// Per-bay battery, auto-detection and live-session state (loop() task only, except insertEdge)
+struct BayState {
+    BatteryData cached_data;              // static info kept across dynamic updates
+    SupportedFeatures cached_features;
+    unsigned long lastDetectionAttempt = 0;
+    unsigned long lastPresenceProbe = 0;
+    bool lastPresenceState = false;
+    bool autoReadIdentified = false;
+    unsigned long lastDynamicRead = 0;
+    uint8_t detectionFailCount = 0;       // consecutive static read failures
+    uint8_t dynamicFailCount = 0;         // consecutive dynamic read failures
+    bool historyRecorded = false;         // one snapshot per insertion
+    bool autoJobPending = false;          // AUTO_DETECT / AUTO_POLL queued on the worker
+    bool liveActive = false;
+    uint8_t liveRateHz = 0;
+    unsigned long liveLastKeepalive = 0;
+    bool liveStopPending = false;
+    volatile bool insertEdge = false;     // set by the insertion ISR
+    // static_data serialized once per identification, shared by every send (including
+    // the connect handler on the AsyncTCP task): access with std::atomic_load/store
+    std::shared_ptr<const std::string> staticSnapshot;
+};
+BayState bays[BAY_COUNT];
+
 static unsigned long browserEpoch = 0;   // unix epoch from browser
 static unsigned long browserSyncMillis = 0; // millis() when synced
 volatile bool wifiScanRequested = false;  // set by WS handler, consumed by loop
+volatile int8_t autoDetectRequest = -1;   // set_auto_detect: 0/1 pending for loop, -1 none
+#ifdef MAKITA_SIMULATED_BMS
+volatile uint32_t soakRequest = 0;        // soak: cycles requested, started by loop
+#endif
 bool autoDetectEnabled = true;           // toggled from UI
+LogLevel logLevel = LOG_LEVEL_INFO;      // set_logging; DEBUG lines below it are not sent
+
+// Optional insertion interrupt (-DMAKITA_INSERT_IRQ): an edge on a bay's data line while
+// that bay is idle triggers a presence probe immediately instead of waiting for PROBE_INTERVAL.
+// MAKITA_INSERT_IRQ_PIN overrides the pin for bay 0 only.
+#ifdef MAKITA_INSERT_IRQ
+uint8_t insertIrqPin(uint8_t bay) {
+#ifdef MAKITA_INSERT_IRQ_PIN
+    if (bay == 0) return MAKITA_INSERT_IRQ_PIN;
+#endif
+    return BAY_PINS[bay].data;
+}
+void IRAM_ATTR onInsertEdge(void* arg) {
+    uint8_t bay = (uint8_t)(uintptr_t)arg;
+    if (!worker.busy(bay)) bays[bay].insertEdge = true;  // ignore our own bus traffic
+}
+#endif
+
+// BMS log records are drained from bms.logs() by loop() and sent in batches
+const uint8_t LOG_BATCH_LINES = 16;       // lines per WS frame
+
+// Connected WS clients and their telemetry format. Clients that send
+// {"command":"set_binary","enabled":true} get dynamic updates as a TelemetryFrame
+// instead of a dynamic_data JSON message; JSON stays for everything else.
+// Every frame goes through the client's outbox; loop() hands it to AsyncTCP while the
+// client keeps up (flushOutboxes), so a stalled client never slows down the others.
+struct WsClientSlot {
+    uint32_t id = 0;                      // 0 = free
+    bool binary = false;
+    bool closeRequested = false;          // control messages overflowed the outbox
+    uint8_t resync = 0;                   // bays whose update was dropped: next one is a keyframe
+    WsOutbox outbox;
+};
+const uint8_t MAX_TRACKED_CLIENTS = 8;    // further connections are refused
+WsClientSlot wsClients[MAX_TRACKED_CLIENTS];
+
+// Delta updates (Telemetry.h): a keyframe with every field goes out every deltaKeyframeMs
+// and after each identification; a client that connects, or that lost an update, gets
+// the next one in full on its own (resync).
+// set_delta changes the thresholds; mv = 0 sends every update in full.
+uint16_t deltaMv = 2;                    // pack, cell and diff threshold
+uint16_t deltaCentiC = 10;               // 0.1 °C
+uint32_t deltaKeyframeMs = 10000;
+
+struct DeltaState {
+    TelemetryFrame sent = {};            // values the clients currently hold
+    unsigned long lastKeyframe = 0;
+    bool keyframeDue = true;
+};
+DeltaState deltas[BAY_COUNT];
 
 // --- Funciones de Comunicación ---
 
+WsClientSlot* findClient(uint32_t id) {
+    for (WsClientSlot& slot : wsClients) if (slot.id == id) return &slot;
+    return nullptr;
+}
+
+// false if every slot is taken (the client is closed)
+bool trackClient(uint32_t id, bool connected) {
+    for (WsClientSlot& slot : wsClients) {
+        if (connected && slot.id == 0) {
+            slot.outbox.clear();
+            slot.binary = false;
+            slot.closeRequested = false;
+            slot.resync = 0xFF;           // late joiner: first update of every bay in full
+            slot.id = id;
+            return true;
+        }
+        if (!connected && slot.id == id) {
+            slot.id = 0;
+            slot.binary = false;
+            slot.outbox.clear();
+            return true;
+        }
+    }
+    return false;
+}
+
+void setBinaryTelemetry(uint32_t id, bool enabled) {
+    WsClientSlot* slot = findClient(id);
+    if (!slot || slot->binary == enabled) return;
+    slot->binary = enabled;
+    slot->resync = 0xFF;  // next update of every bay in full, in the new format
+}
+
+// The client's next dynamic update of the bay carries every field
+void requestKeyframe(uint32_t id, uint8_t bay) {
+    WsClientSlot* slot = findClient(id);
+    if (slot) slot->resync |= 1 << bay;
+}
+
+/**
+ * ROM ID as space-separated hex ("28 1A 00 ..."), the form shown in the UI and sent back
+ * in history commands.
+ */
+void formatRomId(const uint8_t* rom, char* out, size_t cap) {
+    size_t n = 0;
+    out[0] = '\0';
+    for (uint8_t i = 0; i < 8 && n + 3 < cap; i++) {
+        n += snprintf(out + n, cap - n, i ? " %02X" : "%02X", rom[i]);
+    }
+}
+
+std::shared_ptr<const std::string> wsPayload(const JsonDocument& doc) {
+    std::shared_ptr<std::string> out = std::make_shared<std::string>();
+    serializeJson(doc, *out);
+    return out;
+}
+
+std::shared_ptr<const std::string> wsPayload(const String& text) {
+    return std::make_shared<const std::string>(text.c_str(), text.length());
+}
+
+void queueMessage(WsClientSlot& slot, const WsMessage& msg) {
+    if (slot.outbox.push(msg) == WsOutbox::OVERFLOW) slot.closeRequested = true;
+}
+
+/**
+ * Encola un mensaje de texto para un cliente (respuestas a sus comandos).
+ */
+void wsSend(AsyncWebSocketClient* client, const String& text) {
+    WsClientSlot* slot = findClient(client->id());
+    if (slot) queueMessage(*slot, WsMessage{wsPayload(text), false, WsMessage::CONTROL, 0});
+}
+
 /**
- * Envía la información de la batería formateada en JSON a todos los clientes conectados.
- * @param type Tipo de mensaje (static_data o dynamic_data)
+ * Encola un mensaje de texto para todos los clientes; el payload se comparte.
+ */
+void wsSendAll(std::shared_ptr<const std::string> payload, uint8_t kind = WsMessage::CONTROL) {
+    WsMessage msg{std::move(payload), false, kind, 0};
+    for (WsClientSlot& slot : wsClients) {
+        if (slot.id) queueMessage(slot, msg);
+    }
+}
+
+void wsSendAll(const String& text, uint8_t kind = WsMessage::CONTROL) {
+    if (ws.count() > 0) wsSendAll(wsPayload(text), kind);
+}
+
+/**
+ * Hands queued frames to AsyncTCP, per client, while its library queue has room
+ * (WS_MAX_QUEUED_MESSAGES, kept short in platformio.ini). Called from loop() only,
+ * so frames leave each outbox in order.
+ */
+void flushOutboxes() {
+    for (WsClientSlot& slot : wsClients) {
+        if (!slot.id) continue;
+        AsyncWebSocketClient* c = ws.client(slot.id);
+        if (!c) continue;
+        if (slot.closeRequested) {
+            Serial.printf("WS client #%u: outbox overflow, closing\n", slot.id);
+            slot.closeRequested = false;
+            c->close();
+            continue;
+        }
+        WsMessage msg;
+        while (!c->queueIsFull() && slot.outbox.pop(msg)) {
+            if (msg.binary) c->binary(msg.payload->data(), msg.payload->size());
+            else c->text(msg.payload->data(), msg.payload->size());
+        }
+    }
+}
+
+TelemetryFrame telemetryFrame(uint8_t bay, const BatteryData& data) {
+    TelemetryFrame frame = {};
+    frame.type = TELEMETRY_DYNAMIC;
+    frame.version = TELEMETRY_VERSION;
+    frame.bay = bay;
+    frame.cell_count = data.cell_count;
+    frame.pack_mv = data.pack_mv;
+    for (uint8_t i = 0; i < 5; i++) frame.cell_mv[i] = i < data.cell_count ? data.cell_mv[i] : 0;
+    frame.cell_diff_mv = data.cell_diff_mv;
+    frame.temp1_cC = data.temp1_cC;
+    frame.temp2_cC = data.temp2_cC;
+    return frame;
+}
+
+/**
+ * Rellena un mensaje static_data con la información de la batería (campos estáticos y
+ * la última lectura dinámica). dynamic_data se construye con buildDynamicJson().
+ * @param type Tipo de mensaje (static_data)
+ * @param bay Bahía de origen
  * @param data Estructura con los valores leídos de la batería
  * @param features Puntero a las funciones soportadas (opcional)
  */
-void sendJsonResponse(const String& type, const BatteryData& data, const SupportedFeatures* features) {
-    if (ws.count() == 0) return;
-    DynamicJsonDocument doc(2048);
+void buildBatteryJson(JsonDocument& doc, const char* type, uint8_t bay, const BatteryData& data,
+                      const SupportedFeatures* features) {
     doc["type"] = type;
-
+    doc["bay"] = bay;
     JsonObject dataObj = doc.createNestedObject("data");
+
+    // BatteryData holds raw values; the display strings are built here only
+    char status[4], date[12] = "N/A", capacity[12] = "N/A", batteryType[4] = "", rom[24] = "";
+    snprintf(status, sizeof(status), "%02X", data.status_code);
+    // Same strings as before BatteryData went POD: "N/A" / "" until the static frame is read,
+    // then the raw values ("0.0Ah" and "00/00/2000" included)
+    if (data.has_rom) {
+        snprintf(date, sizeof(date), "%02u/%02u/20%02u", dateDay(data.mfg_date), dateMonth(data.mfg_date),
+                 dateYear(data.mfg_date));
+        snprintf(capacity, sizeof(capacity), "%u.%uAh", data.capacity_dah / 10, data.capacity_dah % 10);
+        snprintf(batteryType, sizeof(batteryType), "%u", data.battery_type);
+        formatRomId(data.rom_id, rom, sizeof(rom));
+    }
+
     dataObj["model"] = data.model;
     dataObj["charge_cycles"] = data.charge_cycles;
-    dataObj["lock_status"] = data.lock_status;
-    dataObj["status_code"] = data.status_code;
-    dataObj["mfg_date"] = data.mfg_date;
-    dataObj["capacity"] = data.capacity;
-    dataObj["battery_type"] = data.battery_type;
-    dataObj["pack_voltage"] = data.pack_voltage;
-    JsonArray cellV = dataObj.createNestedArray("cell_voltages");
-    for(int i=0; i<data.cell_count; i++) cellV.add(data.cell_voltages[i]);
-    dataObj["cell_diff"] = data.cell_diff;
-    dataObj["temp1"] = data.temp1;
-    dataObj["temp2"] = data.temp2;
-    dataObj["rom_id"] = data.rom_id;
+    dataObj["lock_status"] = lockStateName(data.lock_status);
+    dataObj["status_code"] = status;
+    dataObj["mfg_date"] = date;
+    dataObj["capacity"] = capacity;
+    dataObj["battery_type"] = batteryType;
+    addDynamicFields(dataObj, telemetryFrame(bay, data), DYN_ALL);
+    dataObj["rom_id"] = rom;
+    if (data.has_rom) {
+        // The whole 0xAA table, for bytes the protocol table does not decode yet
+        char raw[sizeof(data.static_raw) * 2 + 1];
+        for (uint8_t i = 0; i < sizeof(data.static_raw); i++) snprintf(raw + i * 2, 3, "%02X", data.static_raw[i]);
+        dataObj["static_raw"] = raw;
+    }
 
     if (features) {
         JsonObject featuresObj = doc.createNestedObject("features");
         featuresObj["read_dynamic"] = features->read_dynamic;
         featuresObj["led_test"] = features->led_test;
+        featuresObj["live_session"] = features->live_session;
         featuresObj["clear_errors"] = features->clear_errors;
     }
+}
 
-    String output;
-    serializeJson(doc, output);
-    ws.textAll(output);
+/**
+ * Envía una lectura dinámica en JSON a los clientes que no usan telemetría binaria.
+ * Solo lleva los campos dinámicos (ver buildDynamicJson): los estáticos van en static_data.
+ */
+std::shared_ptr<const std::string> dynamicJsonPayload(const TelemetryFrame& frame, uint8_t fields) {
+    DynamicJsonDocument doc(512);
+    buildDynamicJson(doc, frame, fields);
+    return wsPayload(doc);
+}
+
+/**
+ * Serializa static_data una vez por identificación y lo envía a todos los clientes.
+ * Los clientes que se conecten después reciben el mismo snapshot (sendStaticSnapshot)
+ * sin reconstruir el JSON ni reenviarlo a los demás.
+ */
+void sendStaticData(uint8_t bay) {
+    BayState& b = bays[bay];
+    deltas[bay].keyframeDue = true;  // clients get a new baseline
+    DynamicJsonDocument doc(2048);
+    buildBatteryJson(doc, "static_data", bay, b.cached_data, &b.cached_features);
+    std::shared_ptr<const std::string> snapshot = wsPayload(doc);
+    std::atomic_store(&b.staticSnapshot, snapshot);
+    if (ws.count() > 0) wsSendAll(snapshot);
+}
+
+// false if the bay has no snapshot yet
+bool sendStaticSnapshot(uint8_t bay, uint32_t client_id) {
+    std::shared_ptr<const std::string> snapshot = std::atomic_load(&bays[bay].staticSnapshot);
+    WsClientSlot* slot = findClient(client_id);
+    if (!snapshot) return false;
+    if (slot) queueMessage(*slot, WsMessage{snapshot, false, WsMessage::CONTROL, bay});
+    return true;
+}
+
+/**
+ * Envía una lectura dinámica: keyframe o delta según los umbrales, como TelemetryFrame /
+ * delta binario a los clientes binarios y como JSON al resto.
+ * Un cliente que aún tiene en cola una lectura de esta bahía, o que perdió una, recibe
+ * en su lugar un keyframe con los valores actuales: la cola guarda como mucho una
+ * lectura por bahía y el cliente nunca se queda con un delta incompleto.
+ */
+void sendDynamicData(uint8_t bay, const BatteryData& data) {
+    if (ws.count() == 0) return;
+    DeltaState& d = deltas[bay];
+    TelemetryFrame now = telemetryFrame(bay, data);
+
+    uint8_t fields = DYN_ALL;
+    bool keyframe = d.keyframeDue || deltaMv == 0 || millis() - d.lastKeyframe >= deltaKeyframeMs ||
+                    now.cell_count != d.sent.cell_count;
+    if (!keyframe) fields = changedFields(d.sent, now, deltaMv, deltaCentiC);  // 0: only clients in resync get an update
+
+    // The baseline follows what was actually sent
+    if (fields == DYN_ALL) {
+        d.sent = now;
+        d.lastKeyframe = millis();
+        d.keyframeDue = false;
+    } else {
+        applyFields(d.sent, now, fields);
+    }
+
+    // Payloads are built on first use and shared by every client that gets them
+    std::shared_ptr<const std::string> binFull, binDelta, jsonFull, jsonDelta;
+    const uint8_t bayBit = 1 << bay;
+    for (WsClientSlot& slot : wsClients) {
+        if (!slot.id || (!fields && !(slot.resync & bayBit))) continue;
+        bool full = fields == DYN_ALL || (slot.resync & bayBit) || slot.outbox.hasDynamic(bay);
+        std::shared_ptr<const std::string>* payload;
+        if (slot.binary) {
+            payload = full ? &binFull : &binDelta;
+            if (!*payload && full) {
+                *payload = std::make_shared<const std::string>((const char*)&d.sent, sizeof(d.sent));
+            } else if (!*payload) {
+                uint8_t buf[TELEMETRY_DELTA_MAX];
+                size_t len = encodeDelta(now, fields, buf);
+                *payload = std::make_shared<const std::string>((const char*)buf, len);
+            }
+        } else {
+            payload = full ? &jsonFull : &jsonDelta;
+            if (!*payload) *payload = full ? dynamicJsonPayload(d.sent, DYN_ALL) : dynamicJsonPayload(now, fields);
+        }
+        if (slot.outbox.push(WsMessage{*payload, slot.binary, WsMessage::DYNAMIC, bay}) == WsOutbox::DROPPED) {
+            slot.resync |= bayBit;
+        } else {
+            slot.resync &= ~bayBit;
+        }
+    }
 }
 
 /**
@@ -114,53 +453,82 @@ void sendFeedback(const String& type, const String& message) {
     DynamicJsonDocument doc(512);
     doc["type"] = type;
     doc["message"] = message;
-    String output;
-    serializeJson(doc, output);
-    ws.textAll(output);
+    // debug lines are the first thing dropped for a client that falls behind
+    wsSendAll(wsPayload(doc), type == "debug" ? WsMessage::DEBUG : WsMessage::CONTROL);
 }
 
 /**
- * Notifica a los clientes si hay una batería físicamente detectada en el bus.
+ * Notifica a los clientes si hay una batería físicamente detectada en el bus de una bahía.
  */
-void sendPresence(bool is_present) {
+void sendPresence(uint8_t bay, bool is_present, AsyncWebSocketClient* client = nullptr) {
     if (ws.count() == 0) return;
     DynamicJsonDocument doc(64);
     doc["type"] = "presence";
+    doc["bay"] = bay;
     doc["present"] = is_present;
     String output;
     serializeJson(doc, output);
-    ws.textAll(output);
+    if (client) wsSend(client, output);
+    else wsSendAll(output);
+}
+
+/**
+ * Prefijo "Bay N: " para los mensajes de una bahía (vacío si solo hay una).
+ */
+String bayLabel(uint8_t bay) {
+    return (BAY_COUNT > 1) ? "Bay " + String(bay) + ": " : String();
 }
 
 /**
  * Envía mensajes de log del sistema a la interfaz web para depuración remota.
  */
 void logToClients(const String& message, LogLevel level) {
+    if (level > logLevel) return;
     Serial.println(message);
     String prefix = (level == LOG_LEVEL_DEBUG) ? "[DBG] " : "";
     sendFeedback("debug", prefix + message);
 }
 
-// --- Battery History ---
+/**
+ * Formats the BMS log records queued by the bus worker and flushes them: every line
+ * goes to Serial, and up to LOG_BATCH_LINES lines share one "log_batch" WS frame.
+ * With more than one bay, lines are tagged with the bay number.
+ */
+void drainBmsLogs(uint8_t bay) {
+    LogRing& ring = bms[bay]->logs();
+    LogRecord rec;
+    char line[LogRecord::PAYLOAD * 3 + 56];
+    char tag[8] = "";
+    if (BAY_COUNT > 1) snprintf(tag, sizeof(tag), "[%u] ", bay);
+    while (!ring.empty()) {
+        DynamicJsonDocument doc(LOG_BATCH_LINES * 192 + 256);
+        doc["type"] = "log_batch";
+        JsonArray lines = doc.createNestedArray("lines");
+        uint8_t count = 0;
+        while (count < LOG_BATCH_LINES && ring.pop(rec)) {
+            if (rec.dropped) {
+                snprintf(line, sizeof(line), "[DBG] %s(%u log lines dropped)", tag, rec.dropped);
+                Serial.println(line);
+                lines.add(String(line));
+            }
+            size_t n = 0;
+            if (rec.level == LOG_LEVEL_DEBUG) n = snprintf(line, sizeof(line), "[DBG] ");
+            size_t body = n;
+            n += snprintf(line + n, sizeof(line) - n, "%s", tag);
+            LogRing::format(rec, line + n, sizeof(line) - n);
+            Serial.println(line + body);
+            lines.add(String(line));
+            count++;
+        }
+        if (ws.count() > 0) wsSendAll(wsPayload(doc), WsMessage::DEBUG);
+    }
+}
 
-// History file header (12 bytes)
-struct __attribute__((packed)) HistoryHeader {
-    uint8_t  magic[2];      // 0xBA 0x7E
-    uint8_t  version;       // format version
-    uint8_t  cell_count;    // 4 or 5
-    char     model[8];      // null-padded model name
-};
+void drainBmsLogs() {
+    for (uint8_t i = 0; i < BAY_COUNT; i++) drainBmsLogs(i);
+}
 
-// History record (24 bytes)
-struct __attribute__((packed)) HistoryRecord {
-    uint32_t timestamp;     // unix seconds
-    uint16_t charge_cycles;
-    uint16_t pack_voltage;  // millivolts
-    uint16_t cell_voltages[5]; // millivolts, unused=0
-    uint16_t cell_diff;     // millivolts×10
-    int16_t  temp1;         // °C×100
-    int16_t  temp2;         // °C×100
-};
+// --- Battery History ---
 
 // Get best available unix timestamp: NTP > browser sync > uptime
 uint32_t getTimestamp() {
@@ -178,29 +546,241 @@ String romIdToFilename(const String& rom_id) {
     return "/h/" + clean;
 }
 
+String romIdToFilename(const uint8_t* rom) {
+    char name[20];
+    for (uint8_t i = 0; i < 8; i++) snprintf(name + i * 2, 3, "%02X", rom[i]);
+    return String("/h/") + name;
+}
+
+// --- History index ---
+//
+// /h.idx holds one fixed-size summary per history file, so listing the packs reads one
+// file instead of opening and seeking every /h/<rom>. appendHistoryRecord() updates the
+// pack's entry in place; rebuildHistoryIndex() regenerates the whole index from /h
+// (at boot if it is missing or unreadable, and with the rebuild_history_index command).
+// Everything that writes /h or /h.idx runs on loop(): the WebSocket handler only queues
+// rebuilds and deletions, so an in-place update never races a rebuild's rename.
+
+const char* const HISTORY_INDEX_PATH = "/h.idx";
+const char* const HISTORY_INDEX_TMP = "/h.idx.tmp";
+const uint8_t HISTORY_INDEX_VERSION = 1;
+const uint8_t HISTORY_LIST_PAGE = 32;    // battery_list entries per WS message
+const uint8_t HISTORY_CLEAR_SLOTS = 4;   // clear_history requests waiting for loop()
+const uint8_t HISTORY_GET_SLOTS = 4;     // get_history requests waiting for loop()
+
+struct HistoryGetRequest {
+    uint32_t client_id;
+    uint16_t points;
+    char rom_id[24];        // as sent by the page, echoed back in battery_history
+};
+
+volatile bool historyIndexRebuildRequested = false;  // set by WS handler / listing, consumed by loop
+portMUX_TYPE historyRequestMux = portMUX_INITIALIZER_UNLOCKED;
+uint8_t historyClearRoms[HISTORY_CLEAR_SLOTS][8];
+uint8_t historyClearCount = 0;
+HistoryGetRequest historyGets[HISTORY_GET_SLOTS];
+uint8_t historyGetCount = 0;
+
+struct __attribute__((packed)) HistoryIndexHeader {
+    uint8_t  magic[2];      // 0xBA 0x1D
+    uint8_t  version;
+    uint8_t  entry_size;    // sizeof(HistoryIndexEntry)
+    uint16_t count;         // entries in use; bytes past them are stale
+    uint16_t reserved;
+};
+
+struct __attribute__((packed)) HistoryIndexEntry {
+    uint8_t  rom[8];
+    char     model[8];      // null-padded, as in the history header
+    uint8_t  cell_count;
+    uint8_t  version;       // history file version
+    uint16_t reserved;
+    uint32_t count;         // records in the file
+    uint32_t last_seen;     // last record: unix seconds
+    uint16_t last_voltage;  // millivolts
+    uint16_t last_cycles;
+    uint16_t last_diff;     // millivolts×10
+    uint16_t reserved2;
+};
+static_assert(sizeof(HistoryIndexEntry) == 36, "history index entry layout");
+
+// 16 hex digits (a history file name) to the 8 ROM ID bytes
+bool parseRomHex(const String& hex, uint8_t* rom) {
+    if (hex.length() != 16) return false;
+    for (uint8_t i = 0; i < 8; i++) {
+        char byteHex[3] = {hex[i * 2], hex[i * 2 + 1], 0};
+        if (!isxdigit((unsigned char)byteHex[0]) || !isxdigit((unsigned char)byteHex[1])) return false;
+        rom[i] = (uint8_t)strtoul(byteHex, nullptr, 16);
+    }
+    return true;
+}
+
+bool historyIndexHeaderValid(const HistoryIndexHeader& hdr) {
+    return hdr.magic[0] == 0xBA && hdr.magic[1] == 0x1D && hdr.version == HISTORY_INDEX_VERSION &&
+           hdr.entry_size == sizeof(HistoryIndexEntry);
+}
+
+// Opens the index and reads its header; an unusable index leaves the File closed
+File openHistoryIndex(const char* mode, HistoryIndexHeader& hdr) {
+    File f = LittleFS.open(HISTORY_INDEX_PATH, mode);
+    if (f && (f.read((uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr) || !historyIndexHeaderValid(hdr))) f.close();
+    return f;
+}
+
+void fillIndexEntry(HistoryIndexEntry& e, const HistoryHeader& hdr, uint32_t count, const HistoryRecord& last) {
+    memcpy(e.model, hdr.model, sizeof(e.model));
+    e.cell_count = hdr.cell_count;
+    e.version = hdr.version;
+    e.count = count;
+    e.last_seen = count ? last.timestamp : 0;
+    e.last_voltage = count ? last.pack_voltage : 0;
+    e.last_cycles = count ? last.charge_cycles : 0;
+    e.last_diff = count ? last.cell_diff : 0;
+}
+
+// Summary of one /h/<rom> file (the slow path: header read, seek, last record read)
+bool readHistorySummary(File& f, HistoryIndexEntry& e) {
+    HistoryHeader hdr;
+    if (f.size() < (int)sizeof(HistoryHeader) || f.read((uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr)) return false;
+    if (hdr.magic[0] != 0xBA || hdr.magic[1] != 0x7E) return false;
+
+    // entry.name() may return full path or just filename
+    String fname = String(f.name());
+    int lastSlash = fname.lastIndexOf('/');
+    if (lastSlash >= 0) fname = fname.substring(lastSlash + 1);
+    if (!parseRomHex(fname, e.rom)) return false;
+
+    size_t recSize = historyRecordSize(hdr);
+    uint32_t count = (f.size() - sizeof(HistoryHeader)) / recSize;
+    HistoryRecord last = {};
+    if (count > 0) {
+        f.seek(sizeof(HistoryHeader) + (count - 1) * recSize);
+        f.read((uint8_t*)&last, sizeof(last));   // a v2 record's tail is not needed
+    }
+    fillIndexEntry(e, hdr, count, last);
+    return true;
+}
+
+/**
+ * Regenerates /h.idx from the history files. Written to a temporary file first, so
+ * the old index stays usable if the rebuild is interrupted.
+ */
+void rebuildHistoryIndex() {
+    unsigned long start = millis();
+    File out = LittleFS.open(HISTORY_INDEX_TMP, "w");
+    if (!out) {
+        Serial.println("History index: cannot create " + String(HISTORY_INDEX_TMP));
+        return;
+    }
+    HistoryIndexHeader hdr = {};
+    hdr.magic[0] = 0xBA;
+    hdr.magic[1] = 0x1D;
+    hdr.version = HISTORY_INDEX_VERSION;
+    hdr.entry_size = sizeof(HistoryIndexEntry);
+    out.write((uint8_t*)&hdr, sizeof(hdr));
+
+    File dir = LittleFS.open("/h");
+    if (dir && dir.isDirectory()) {
+        File entry = dir.openNextFile();
+        while (entry) {
+            HistoryIndexEntry e = {};
+            if (!entry.isDirectory() && readHistorySummary(entry, e) && hdr.count < 0xFFFF) {
+                out.write((uint8_t*)&e, sizeof(e));
+                hdr.count++;
+            }
+            entry = dir.openNextFile();
+        }
+    }
+    out.seek(0);
+    out.write((uint8_t*)&hdr, sizeof(hdr));
+    out.close();
+    LittleFS.remove(HISTORY_INDEX_PATH);
+    LittleFS.rename(HISTORY_INDEX_TMP, HISTORY_INDEX_PATH);
+    Serial.printf("History index rebuilt: %u packs in %lu ms\n", hdr.count, millis() - start);
+}
+
+/**
+ * Writes a pack's entry in place, or appends it. Falls back to a rebuild if the index
+ * is unusable (the history file is already written, so the rebuild includes it).
+ */
+void updateHistoryIndex(const HistoryIndexEntry& entry) {
+    HistoryIndexHeader hdr;
+    File f = openHistoryIndex("r+", hdr);
+    if (!f) {
+        rebuildHistoryIndex();
+        return;
+    }
+    HistoryIndexEntry e;
+    uint16_t slot = 0;
+    while (slot < hdr.count && f.read((uint8_t*)&e, sizeof(e)) == sizeof(e)) {
+        if (memcmp(e.rom, entry.rom, sizeof(e.rom)) == 0) break;
+        slot++;
+    }
+    f.seek(sizeof(hdr) + slot * sizeof(HistoryIndexEntry));
+    f.write((const uint8_t*)&entry, sizeof(entry));
+    if (slot == hdr.count) {
+        hdr.count++;
+        f.seek(0);
+        f.write((uint8_t*)&hdr, sizeof(hdr));
+    }
+    f.close();
+}
+
+// Drops a pack's entry: the last entry takes its slot (order does not matter)
+void removeHistoryIndexEntry(const uint8_t* rom) {
+    HistoryIndexHeader hdr;
+    File f = openHistoryIndex("r+", hdr);
+    if (!f) return;  // rebuilt on the next listing
+    HistoryIndexEntry e;
+    for (uint16_t slot = 0; slot < hdr.count && f.read((uint8_t*)&e, sizeof(e)) == sizeof(e); slot++) {
+        if (memcmp(e.rom, rom, sizeof(e.rom)) != 0) continue;
+        HistoryIndexEntry last;
+        f.seek(sizeof(hdr) + (hdr.count - 1) * sizeof(HistoryIndexEntry));
+        if (f.read((uint8_t*)&last, sizeof(last)) == sizeof(last)) {
+            f.seek(sizeof(hdr) + slot * sizeof(HistoryIndexEntry));
+            f.write((uint8_t*)&last, sizeof(last));
+        }
+        hdr.count--;
+        f.seek(0);
+        f.write((uint8_t*)&hdr, sizeof(hdr));
+        break;
+    }
+    f.close();
+}
+
 void appendHistoryRecord(const BatteryData& data) {
-    if (data.rom_id.length() == 0) {
+    if (!data.has_rom) {
         logToClients("History: empty ROM ID, skipping", LOG_LEVEL_INFO);
         return;
     }
 
     // Sanity gate: reject snapshots with obviously bad readings
     for (int i = 0; i < data.cell_count; i++) {
-        if (data.cell_voltages[i] < 2.0f || data.cell_voltages[i] > 4.5f) {
+        if (data.cell_mv[i] < 2000 || data.cell_mv[i] > 4500) {
             logToClients("History: cell " + String(i+1) + " out of range (" +
-                         String(data.cell_voltages[i], 3) + "V), skipping", LOG_LEVEL_INFO);
+                         String(data.cell_mv[i]) + " mV), skipping", LOG_LEVEL_INFO);
             return;
         }
     }
-    if (data.pack_voltage < 8.0f || data.pack_voltage > 23.0f) {
+    if (data.pack_mv < 8000 || data.pack_mv > 23000) {
         logToClients("History: pack voltage out of range (" +
-                     String(data.pack_voltage, 2) + "V), skipping", LOG_LEVEL_INFO);
+                     String(data.pack_mv) + " mV), skipping", LOG_LEVEL_INFO);
         return;
     }
 
     String path = romIdToFilename(data.rom_id);
     logToClients("History: writing to " + path, LOG_LEVEL_INFO);
 
+    size_t recSize = sizeof(HistoryRecord);
+    HistoryHeader fileHdr = {};
+    bool haveHdr = false;
+    if (LittleFS.exists(path)) {
+        File existing = LittleFS.open(path, "r");
+        haveHdr = existing && existing.read((uint8_t*)&fileHdr, sizeof(fileHdr)) == sizeof(fileHdr);
+        if (haveHdr) recSize = historyRecordSize(fileHdr);
+        existing.close();
+    }
+
     File f = LittleFS.open(path, "a");
     if (!f) {
         logToClients("History: failed to open " + path, LOG_LEVEL_INFO);
@@ -211,87 +791,130 @@ void appendHistoryRecord(const BatteryData& data) {
         HistoryHeader hdr = {};
         hdr.magic[0] = 0xBA;
         hdr.magic[1] = 0x7E;
-        hdr.version = 1;
+        hdr.version = HISTORY_VERSION;
         hdr.cell_count = (uint8_t)data.cell_count;
-        strncpy(hdr.model, data.model.c_str(), sizeof(hdr.model));
+        strncpy(hdr.model, data.model, sizeof(hdr.model));
         f.write((uint8_t*)&hdr, sizeof(hdr));
+        fileHdr = hdr;
+        haveHdr = true;
     }
 
     HistoryRecord rec = {};
     rec.timestamp = getTimestamp();
     rec.charge_cycles = (uint16_t)data.charge_cycles;
-    rec.pack_voltage = (uint16_t)(data.pack_voltage * 1000.0f);
+    rec.pack_voltage = data.pack_mv;
     for (int i = 0; i < 5; i++) {
-        rec.cell_voltages[i] = (i < data.cell_count)
-            ? (uint16_t)(data.cell_voltages[i] * 1000.0f) : 0;
+        rec.cell_voltages[i] = (i < data.cell_count) ? data.cell_mv[i] : 0;
     }
-    rec.cell_diff = (uint16_t)(data.cell_diff * 10000.0f);
-    rec.temp1 = (int16_t)(data.temp1 * 100.0f);
-    rec.temp2 = (int16_t)(data.temp2 * 100.0f);
-    size_t written = f.write((uint8_t*)&rec, sizeof(rec));
+    rec.cell_diff = data.cell_diff_mv * 10;  // file format keeps 0.1 mV units
+    rec.temp1 = data.temp1_cC;
+    rec.temp2 = data.temp2_cC;
+    uint8_t out[HISTORY_RECORD_MAX] = {};   // a v2 file keeps its record size (zero padding)
+    memcpy(out, &rec, sizeof(rec));
+    size_t written = f.write(out, recSize);
     size_t fileSize = f.size();
     f.close();
     logToClients("History snapshot saved (" + String(written) + "B, file=" + String(fileSize) + "B)", LOG_LEVEL_INFO);
-}
 
-void sendBatteryList(AsyncWebSocketClient* client) {
-    DynamicJsonDocument doc(4096);
-    doc["type"] = "battery_list";
-    JsonArray arr = doc.createNestedArray("data");
+    if (haveHdr && written == recSize) {
+        HistoryIndexEntry entry = {};
+        memcpy(entry.rom, data.rom_id, sizeof(entry.rom));
+        fillIndexEntry(entry, fileHdr, (fileSize - sizeof(HistoryHeader)) / recSize, rec);
+        updateHistoryIndex(entry);
+    }
+}
 
-    File dir = LittleFS.open("/h");
-    if (!dir || !dir.isDirectory()) {
-        String out;
-        serializeJson(doc, out);
-        client->text(out);
+/**
+ * Lista de baterías con historial, servida desde /h.idx en páginas de HISTORY_LIST_PAGE
+ * entradas ("offset" / "total"); la interfaz las concatena. Sin cliente, a todos.
+ * Si el índice no se puede leer, loop() lo regenera y vuelve a enviar la lista.
+ */
+void sendBatteryList(AsyncWebSocketClient* client = nullptr) {
+    HistoryIndexHeader hdr;
+    File f = openHistoryIndex("r", hdr);
+    if (!f) {
+        historyIndexRebuildRequested = true;
         return;
     }
-
-    File entry = dir.openNextFile();
-    while (entry) {
-        if (!entry.isDirectory() && entry.size() >= (int)sizeof(HistoryHeader)) {
-            HistoryHeader hdr;
-            entry.read((uint8_t*)&hdr, sizeof(hdr));
-
-            if (hdr.magic[0] == 0xBA && hdr.magic[1] == 0x7E) {
-                size_t dataBytes = entry.size() - sizeof(HistoryHeader);
-                int count = dataBytes / sizeof(HistoryRecord);
-
-                JsonObject obj = arr.createNestedObject();
-                // entry.name() may return full path or just filename
-                String fname = String(entry.name());
-                int lastSlash = fname.lastIndexOf('/');
-                if (lastSlash >= 0) fname = fname.substring(lastSlash + 1);
-                obj["rom_id"] = fname;
-                char modelBuf[9] = {};
-                memcpy(modelBuf, hdr.model, 8);
-                obj["model"] = String(modelBuf);
-                obj["cell_count"] = hdr.cell_count;
-                obj["readings"] = count;
-
-                // Read last record for "last seen" timestamp
-                if (count > 0) {
-                    HistoryRecord lastRec;
-                    entry.seek(entry.size() - sizeof(HistoryRecord));
-                    entry.read((uint8_t*)&lastRec, sizeof(lastRec));
-                    obj["last_seen"] = lastRec.timestamp;
-                    obj["last_voltage"] = lastRec.pack_voltage / 1000.0f;
-                    obj["last_cycles"] = lastRec.charge_cycles;
-                    obj["last_diff"] = lastRec.cell_diff / 10000.0f;
-                }
+    uint16_t total = hdr.count;
+    uint16_t offset = 0;
+    do {
+        DynamicJsonDocument doc(512 + HISTORY_LIST_PAGE * 224);
+        doc["type"] = "battery_list";
+        doc["offset"] = offset;
+        doc["total"] = total;
+        JsonArray arr = doc.createNestedArray("data");
+        HistoryIndexEntry e;
+        for (uint8_t n = 0; n < HISTORY_LIST_PAGE && offset < total; n++, offset++) {
+            if (f.read((uint8_t*)&e, sizeof(e)) != sizeof(e)) {
+                total = offset;  // short index: the rest is lost until the next rebuild
+                break;
+            }
+            JsonObject obj = arr.createNestedObject();
+            char rom[17];
+            for (uint8_t i = 0; i < 8; i++) snprintf(rom + i * 2, 3, "%02X", e.rom[i]);
+            obj["rom_id"] = rom;
+            char modelBuf[9] = {};
+            memcpy(modelBuf, e.model, 8);
+            obj["model"] = String(modelBuf);
+            obj["cell_count"] = e.cell_count;
+            obj["readings"] = e.count;
+            if (e.count > 0) {
+                obj["last_seen"] = e.last_seen;
+                obj["last_voltage"] = e.last_voltage / 1000.0f;
+                obj["last_cycles"] = e.last_cycles;
+                obj["last_diff"] = e.last_diff / 10000.0f;
             }
         }
-        entry = dir.openNextFile();
-    }
+        String out;
+        serializeJson(doc, out);
+        if (client) wsSend(client, out);
+        else wsSendAll(out);
+    } while (offset < total);
+    f.close();
+}
 
-    String out;
-    serializeJson(doc, out);
-    client->text(out);
+// Downsampled history: at most this many points, whatever the file length
+const uint16_t HISTORY_MAX_POINTS = 100;
+const size_t HISTORY_POINT_JSON = 320;   // one bucket object in the JsonDocument
+
+// Same keys as a raw record (means), plus the bucket size and extremes
+void historyBucketJson(JsonObject obj, const HistoryBucket& b, const HistoryHeader& hdr) {
+    obj["ts"] = (uint32_t)(b.ts / b.n);
+    obj["cycles"] = b.cycles;
+    obj["pack_mv"] = b.pack / b.n;
+    JsonArray c = obj.createNestedArray("cells");
+    for (uint8_t i = 0; i < hdr.cell_count && i < 5; i++) c.add(b.cells[i] / b.n);
+    obj["diff"] = b.diff / b.n;
+    obj["t1"] = b.t1 / (int32_t)b.n;
+    obj["t2"] = b.t2 / (int32_t)b.n;
+    obj["n"] = b.n;
+    obj["pack_min"] = b.packMin;
+    obj["pack_max"] = b.packMax;
+    obj["diff_max"] = b.diffMax;
+}
+
+// Lifetime of the pack reduced to `points` buckets (bucketHistory) in a single pass
+void addHistoryBuckets(JsonArray arr, File& f, const HistoryHeader& hdr, uint32_t total, uint16_t points) {
+    HistoryBlockReader<File> reader(f, historyRecordSize(hdr));
+    bucketHistory(total, points,
+                  [&](HistoryRecord& rec) { return reader.next(rec); },
+                  [&](const HistoryBucket& b) { historyBucketJson(arr.createNestedObject(), b, hdr); });
 }
 
-void sendBatteryHistory(AsyncWebSocketClient* client, const String& rom_id) {
+/**
+ * Historial de una batería. points = 0: los últimos 100 registros tal cual;
+ * points > 0: toda la vida del pack reducida a ese número de puntos (máx. HISTORY_MAX_POINTS).
+ * Recorre el fichero entero: solo desde loop() (get_history pasa por requestHistory()).
+ */
+void sendBatteryHistory(AsyncWebSocketClient* client, const String& rom_id, uint16_t points = 0) {
     String path = romIdToFilename(rom_id);
-    DynamicJsonDocument doc(24576);
+    if (points > HISTORY_MAX_POINTS) points = HISTORY_MAX_POINTS;
+    DynamicJsonDocument doc(points ? 1024 + points * HISTORY_POINT_JSON : 24576);
+    if (doc.capacity() == 0) {
+        wsSend(client, "{\"type\":\"error\",\"message\":\"History: out of memory\"}");
+        return;
+    }
     doc["type"] = "battery_history";
     doc["rom_id"] = rom_id;
     JsonArray arr = doc.createNestedArray("data");
@@ -300,7 +923,7 @@ void sendBatteryHistory(AsyncWebSocketClient* client, const String& rom_id) {
     if (!f || f.size() < (int)sizeof(HistoryHeader)) {
         String out;
         serializeJson(doc, out);
-        client->text(out);
+        wsSend(client, out);
         return;
     }
 
@@ -311,16 +934,27 @@ void sendBatteryHistory(AsyncWebSocketClient* client, const String& rom_id) {
     doc["model"] = String(modelBuf);
     doc["cell_count"] = hdr.cell_count;
 
+    size_t recSize = historyRecordSize(hdr);
     size_t dataBytes = f.size() - sizeof(HistoryHeader);
-    int total = dataBytes / sizeof(HistoryRecord);
+    int total = dataBytes / recSize;
+    doc["total"] = total;
+    if (points) {
+        addHistoryBuckets(arr, f, hdr, total, points);
+        f.close();
+        String out;
+        serializeJson(doc, out);
+        wsSend(client, out);
+        return;
+    }
     int cap = 100;
     int skip = (total > cap) ? total - cap : 0;
-    if (skip > 0) f.seek(sizeof(HistoryHeader) + skip * sizeof(HistoryRecord));
+    if (skip > 0) f.seek(sizeof(HistoryHeader) + skip * recSize);
 
+    HistoryBlockReader<File> reader(f, recSize);
     HistoryRecord rec;
     int count = (total > cap) ? cap : total;
     for (int i = 0; i < count; i++) {
-        if (f.read((uint8_t*)&rec, sizeof(rec)) != sizeof(rec)) break;
+        if (!reader.next(rec)) break;
         JsonObject obj = arr.createNestedObject();
         obj["ts"] = rec.timestamp;
         obj["cycles"] = rec.charge_cycles;
@@ -337,15 +971,178 @@ void sendBatteryHistory(AsyncWebSocketClient* client, const String& rom_id) {
 
     String out;
     serializeJson(doc, out);
-    client->text(out);
+    wsSend(client, out);
 }
 
-void deleteHistory(const String& rom_id) {
-    String path = romIdToFilename(rom_id);
+/**
+ * Streaming export of a whole history file: GET /history?rom=<id>&format=csv|ndjson.
+ * The chunk filler pulls records from a HistoryBlockReader (one LittleFS read per
+ * HISTORY_READ_BLOCK records) and formats them into a line buffer, so memory use is
+ * the same for ten records or ten thousand.
+ */
+struct HistoryExport {
+    File file;
+    HistoryHeader hdr;
+    HistoryBlockReader<File> reader{file, sizeof(HistoryRecord)};  // recSize set from hdr
+    bool csv = true;
+    char line[192];
+    size_t lineLen = 0;
+    size_t linePos = 0;                   // bytes of line already handed out
+};
+
+// First line: CSV column names, or an NDJSON object describing the pack
+size_t formatHistoryHeaderLine(const HistoryExport& x, const String& rom, char* out, size_t cap) {
+    char model[9] = {};
+    for (uint8_t i = 0; i < 8 && x.hdr.model[i]; i++) {
+        model[i] = (isalnum((unsigned char)x.hdr.model[i]) || x.hdr.model[i] == '-') ? x.hdr.model[i] : '?';
+    }
+    if (!x.csv) {
+        return snprintf(out, cap, "{\"rom_id\":\"%s\",\"model\":\"%s\",\"cell_count\":%u,\"version\":%u}\n",
+                        rom.c_str(), model, x.hdr.cell_count, x.hdr.version);
+    }
+    size_t n = snprintf(out, cap, "timestamp,cycles,pack_mv");
+    for (uint8_t c = 0; c < x.hdr.cell_count && c < 5; c++) n += snprintf(out + n, cap - n, ",cell%u_mv", c + 1);
+    n += snprintf(out + n, cap - n, ",diff_mv,temp1_c,temp2_c\n");
+    return n;
+}
+
+// One record per line; CSV in display units (°C, mV), NDJSON with the battery_history keys
+size_t formatHistoryLine(const HistoryExport& x, const HistoryRecord& rec, char* out, size_t cap) {
+    const uint8_t cells = x.hdr.cell_count < 5 ? x.hdr.cell_count : 5;
+    size_t n;
+    if (x.csv) {
+        n = snprintf(out, cap, "%u,%u,%u", (unsigned)rec.timestamp, rec.charge_cycles, rec.pack_voltage);
+        for (uint8_t c = 0; c < cells; c++) n += snprintf(out + n, cap - n, ",%u", rec.cell_voltages[c]);
+        int t1 = rec.temp1, t2 = rec.temp2;
+        n += snprintf(out + n, cap - n, ",%u.%u,%s%d.%02d,%s%d.%02d", rec.cell_diff / 10, rec.cell_diff % 10,
+                      t1 < 0 ? "-" : "", abs(t1) / 100, abs(t1) % 100, t2 < 0 ? "-" : "", abs(t2) / 100, abs(t2) % 100);
+    } else {
+        n = snprintf(out, cap, "{\"ts\":%u,\"cycles\":%u,\"pack_mv\":%u,\"cells\":[", (unsigned)rec.timestamp,
+                     rec.charge_cycles, rec.pack_voltage);
+        for (uint8_t c = 0; c < cells; c++) n += snprintf(out + n, cap - n, c ? ",%u" : "%u", rec.cell_voltages[c]);
+        n += snprintf(out + n, cap - n, "],\"diff\":%u,\"t1\":%d,\"t2\":%d", rec.cell_diff, rec.temp1, rec.temp2);
+        n += snprintf(out + n, cap - n, "}");
+    }
+    n += snprintf(out + n, cap - n, "\n");
+    return n;
+}
+
+void handleHistoryExport(AsyncWebServerRequest* request) {
+    String rom = request->hasParam("rom") ? request->getParam("rom")->value() : String();
+    String path = romIdToFilename(rom);
+    // Only "/h/" + 16 hex digits: the parameter never reaches the filesystem otherwise
+    bool valid = path.length() == 19;
+    for (unsigned int i = 3; valid && i < path.length(); i++) valid = isxdigit((unsigned char)path[i]);
+    if (!valid) {
+        request->send(400, "text/plain", "Bad ROM ID");
+        return;
+    }
+
+    std::shared_ptr<HistoryExport> x = std::make_shared<HistoryExport>();
+    x->csv = !(request->hasParam("format") && request->getParam("format")->value() == "ndjson");
+    x->file = LittleFS.open(path, "r");
+    if (!x->file || x->file.read((uint8_t*)&x->hdr, sizeof(x->hdr)) != sizeof(x->hdr) ||
+        x->hdr.magic[0] != 0xBA || x->hdr.magic[1] != 0x7E) {
+        request->send(404, "text/plain", "No history");
+        return;
+    }
+    x->reader.recSize = historyRecordSize(x->hdr);
+    x->lineLen = formatHistoryHeaderLine(*x, path.substring(3), x->line, sizeof(x->line));
+
+    AsyncWebServerResponse* response = request->beginChunkedResponse(x->csv ? "text/csv" : "application/x-ndjson",
+        [x](uint8_t* out, size_t maxLen, size_t) -> size_t {
+            size_t n = 0;
+            while (n < maxLen) {
+                if (x->linePos == x->lineLen) {
+                    HistoryRecord rec;
+                    if (!x->reader.next(rec)) break;  // end of file
+                    x->lineLen = formatHistoryLine(*x, rec, x->line, sizeof(x->line));
+                    x->linePos = 0;
+                }
+                size_t chunk = min(maxLen - n, x->lineLen - x->linePos);
+                memcpy(out + n, x->line + x->linePos, chunk);
+                n += chunk;
+                x->linePos += chunk;
+            }
+            return n;
+        });
+    response->addHeader("Content-Disposition",
+                        "attachment; filename=\"" + path.substring(3) + (x->csv ? ".csv\"" : ".ndjson\""));
+    request->send(response);
+}
+
+void deleteHistory(const uint8_t* rom) {
+    String path = romIdToFilename(rom);
     if (LittleFS.exists(path)) {
         LittleFS.remove(path);
         Serial.println("History deleted: " + path);
     }
+    removeHistoryIndexEntry(rom);
+}
+
+/**
+ * Queues a clear_history for loop(); false if the ROM ID is malformed or the queue is full.
+ */
+bool requestHistoryClear(const String& rom_id) {
+    uint8_t rom[8];
+    if (!parseRomHex(romIdToFilename(rom_id).substring(3), rom)) return false;
+    portENTER_CRITICAL(&historyRequestMux);
+    bool queued = historyClearCount < HISTORY_CLEAR_SLOTS;
+    if (queued) memcpy(historyClearRoms[historyClearCount++], rom, sizeof(rom));
+    portEXIT_CRITICAL(&historyRequestMux);
+    return queued;
+}
+
+/**
+ * Queues a get_history for loop(); a newer request from the same client replaces its
+ * pending one. False if the queue is full.
+ */
+bool requestHistory(uint32_t client_id, const String& rom_id, uint16_t points) {
+    HistoryGetRequest req = {client_id, points, {}};
+    strncpy(req.rom_id, rom_id.c_str(), sizeof(req.rom_id) - 1);
+    portENTER_CRITICAL(&historyRequestMux);
+    uint8_t i = 0;
+    while (i < historyGetCount && historyGets[i].client_id != client_id) i++;
+    bool queued = i < HISTORY_GET_SLOTS;
+    if (queued) {
+        historyGets[i] = req;
+        if (i == historyGetCount) historyGetCount++;
+    }
+    portEXIT_CRITICAL(&historyRequestMux);
+    return queued;
+}
+
+/**
+ * History file work requested from the WebSocket handler (loop() only). Clients get
+ * the refreshed battery list afterwards.
+ */
+void serviceHistoryRequests() {
+    uint8_t roms[HISTORY_CLEAR_SLOTS][8];
+    HistoryGetRequest gets[HISTORY_GET_SLOTS];
+    portENTER_CRITICAL(&historyRequestMux);
+    uint8_t clears = historyClearCount;
+    memcpy(roms, historyClearRoms, clears * sizeof(roms[0]));
+    historyClearCount = 0;
+    uint8_t getCount = historyGetCount;
+    memcpy(gets, historyGets, getCount * sizeof(gets[0]));
+    historyGetCount = 0;
+    portEXIT_CRITICAL(&historyRequestMux);
+
+    for (uint8_t i = 0; i < clears; i++) {
+        deleteHistory(roms[i]);
+        logToClients("History cleared for " + romIdToFilename(roms[i]).substring(3), LOG_LEVEL_INFO);
+    }
+    bool rebuild = historyIndexRebuildRequested;
+    if (rebuild) {
+        historyIndexRebuildRequested = false;
+        rebuildHistoryIndex();
+    }
+    if (clears > 0 || rebuild) sendBatteryList();
+
+    for (uint8_t i = 0; i < getCount; i++) {
+        AsyncWebSocketClient* client = ws.client(gets[i].client_id);
+        if (client) sendBatteryHistory(client, gets[i].rom_id, gets[i].points);
+    }
 }
 
 void sendWifiStatus(AsyncWebSocketClient* client) {
@@ -363,7 +1160,344 @@ void sendWifiStatus(AsyncWebSocketClient* client) {
     doc["has_time"] = (getTimestamp() > 1700000000);
     String out;
     serializeJson(doc, out);
-    client->text(out);
+    wsSend(client, out);
+}
+
+/**
+ * Queues a bus command for a bay on the worker; the result is handled in loop().
+ */
+void submitCommand(BMSCommand cmd, uint8_t bay, AsyncWebSocketClient* client, uint16_t param = 0) {
+    if (!worker.submit(cmd, bay, client ? client->id() : 0, param)) {
+        String msg = String("BMS busy (") + worker.pending() + " queued), " + commandName(cmd) + " dropped.";
+        if (client) {
+            DynamicJsonDocument doc(256);
+            doc["type"] = "error";
+            doc["message"] = msg;
+            String out;
+            serializeJson(doc, out);
+            wsSend(client, out);
+        }
+    }
+}
+
+/**
+ * Live session state of a bay, broadcast on every change (and to new clients).
+ */
+void sendLiveStatus(uint8_t bay, const char* reason, AsyncWebSocketClient* client = nullptr) {
+    DynamicJsonDocument doc(128);
+    doc["type"] = "live_status";
+    doc["bay"] = bay;
+    doc["active"] = bays[bay].liveActive;
+    doc["rate_hz"] = bays[bay].liveRateHz;
+    if (reason) doc["reason"] = reason;
+    String out;
+    serializeJson(doc, out);
+    if (client) wsSend(client, out);
+    else wsSendAll(out);
+}
+
+/**
+ * Worker queue depth and per-command latency (enqueue -> result), plus heap figures:
+ * a largest free block that shrinks while free heap stays flat means fragmentation.
+ */
+void sendWorkerStats(AsyncWebSocketClient* client) {
+    const BMSWorker::Stats& st = worker.stats();
+    DynamicJsonDocument doc(2560);
+    doc["type"] = "worker_stats";
+    doc["bays"] = worker.bayCount();
+    doc["pending"] = worker.pending();
+    doc["max_depth"] = st.max_depth;
+    doc["submitted"] = st.submitted;
+    doc["rejected"] = st.rejected;
+    doc["merged"] = st.merged;
+    doc["cache_hits"] = st.cache_hits;
+    doc["fresh_ms"] = worker.freshness();
+    doc["heap_free"] = ESP.getFreeHeap();
+    doc["heap_min_free"] = ESP.getMinFreeHeap();
+    doc["heap_max_alloc"] = ESP.getMaxAllocHeap();
+    JsonObject cmds = doc.createNestedObject("commands");
+    for (size_t i = 0; i < (size_t)BMSCommand::COUNT; i++) {
+        const BMSWorker::CommandStats& c = st.commands[i];
+        if (c.count == 0) continue;
+        JsonObject o = cmds.createNestedObject(commandName((BMSCommand)i));
+        o["count"] = c.count;
+        o["last_ms"] = c.last_ms;
+        o["avg_ms"] = c.total_ms / c.count;
+        o["max_ms"] = c.max_ms;
+        o["last_wait_ms"] = c.last_wait_ms;
+    }
+    // Per-client outbox: queued now, high-water mark, and what was coalesced or dropped
+    JsonArray clients = doc.createNestedArray("clients");
+    for (const WsClientSlot& slot : wsClients) {
+        if (!slot.id) continue;
+        const WsOutbox::Stats& os = slot.outbox.stats();
+        JsonObject o = clients.createNestedObject();
+        o["id"] = slot.id;
+        o["binary"] = slot.binary;
+        o["queued"] = slot.outbox.size();
+        o["max_queued"] = os.max_queued;
+        o["sent"] = os.sent;
+        o["coalesced"] = os.coalesced;
+        o["dropped"] = os.dropped;
+    }
+    String out;
+    serializeJson(doc, out);
+    wsSend(client, out);
+}
+
+static void histogramToJson(JsonObject o, const LatencyHistogram& h) {
+    o["count"] = h.count;
+    o["avg_us"] = h.avgUs();
+    o["max_us"] = h.max_us;
+    JsonArray b = o.createNestedArray("buckets");
+    for (uint8_t i = 0; i < LatencyHistogram::BUCKETS; i++) b.add(h.counts[i]);
+}
+
+/**
+ * Bus timing histograms and per-operation counters of one bay (MakitaBMS::metrics()).
+ * Bucket i counts samples below bucket_limits_us[i]; the last bucket is open-ended (0).
+ */
+void sendMetrics(AsyncWebSocketClient* client, uint8_t bay) {
+    const BusMetrics& m = bms[bay]->metrics();
+    DynamicJsonDocument doc(4096);
+    doc["type"] = "metrics";
+    doc["bay"] = bay;
+    doc["uptime_ms"] = millis();
+    doc["backend"] = bms[bay]->bus().name();
+    doc["garbage"] = m.garbage;
+    doc["no_presence"] = m.no_presence;
+    JsonArray limits = doc.createNestedArray("bucket_limits_us");
+    for (uint8_t i = 0; i < LatencyHistogram::BUCKETS; i++) limits.add(LatencyHistogram::bucketLimitUs(i));
+    JsonObject phases = doc.createNestedObject("phases");
+    for (uint8_t i = 0; i < BusMetrics::PHASE_COUNT; i++) {
+        histogramToJson(phases.createNestedObject(busPhaseName(i)), m.phases[i]);
+    }
+    const LatencyHistogram* crit = bms[bay]->bus().criticalSections();
+    if (crit) histogramToJson(phases.createNestedObject("critical_section"), *crit);
+    JsonObject ops = doc.createNestedObject("operations");
+    for (size_t i = 1; i < (size_t)BMSOperation::COUNT; i++) {
+        const BusMetrics::OpCounters& c = m.ops[i];
+        if (c.ok == 0 && c.failed == 0 && c.retries == 0) continue;
+        JsonObject o = ops.createNestedObject(operationName((BMSOperation)i));
+        o["ok"] = c.ok;
+        o["failed"] = c.failed;
+        o["retries"] = c.retries;
+    }
+    String out;
+    serializeJson(doc, out);
+    wsSend(client, out);
+}
+
+/**
+ * A read answered without its own bus transaction (BMSJob::shared). The transaction it
+ * rode on was already handled and broadcast, so only the requester is answered, with the
+ * current state; failures were reported with the original. Returns false to fall back to
+ * the normal handling (e.g. no static snapshot yet).
+ */
+bool handleSharedResult(BMSJob* job) {
+    const uint8_t bay = job->bay;
+    BayState& b = bays[bay];
+    switch (job->command) {
+        case BMSCommand::AUTO_POLL:
+            b.autoJobPending = false;
+            return true;
+        case BMSCommand::READ_DYNAMIC:
+            if (job->status != BMSStatus::OK || !b.autoReadIdentified) return true;
+            b.cached_data = job->data;
+            requestKeyframe(job->client_id, bay);
+            sendDynamicData(bay, b.cached_data);  // others only get what changed, usually nothing
+            return true;
+        case BMSCommand::READ_STATIC:
+            if (job->status != BMSStatus::OK) return true;
+            return b.autoReadIdentified && sendStaticSnapshot(bay, job->client_id);
+        default:
+            return false;
+    }
+}
+
+/**
+ * Applies a finished worker job to the shared state and notifies clients.
+ * Runs on the loop() task, so it is the only writer of the bay state.
+ */
+void handleJobResult(BMSJob* job) {
+    const uint8_t bay = job->bay;
+    BayState& b = bays[bay];
+    if (job->client_id != 0 && logLevel >= LOG_LEVEL_DEBUG) {
+        char line[64];
+        snprintf(line, sizeof(line), "%s: %u ms (queued %u ms)%s", commandName(job->command),
+                 (unsigned)(job->finished_ms - job->enqueued_ms),
+                 (unsigned)(job->started_ms - job->enqueued_ms), job->shared ? " shared" : "");
+        logToClients(line, LOG_LEVEL_DEBUG);
+    }
+    if (job->shared && handleSharedResult(job)) return;
+
+    switch (job->command) {
+        case BMSCommand::PRESENCE:
+            sendPresence(bay, job->present);
+            break;
+
+        case BMSCommand::READ_STATIC:
+            if (job->status == BMSStatus::OK) {
+                b.cached_data = job->data;
+                b.cached_features = job->features;
+                b.autoReadIdentified = true;
+                b.lastPresenceState = true;
+                b.detectionFailCount = 0;
+                b.dynamicFailCount = 0;
+                b.lastDynamicRead = millis();
+                sendStaticData(bay);
+                sendPresence(bay, true);
+                if (!b.historyRecorded) {
+                    appendHistoryRecord(b.cached_data);
+                    b.historyRecorded = true;
+                }
+            } else {
+                // Reset auto-detection state so loop re-detects
+                b.autoReadIdentified = false;
+                b.lastPresenceState = false;
+                b.detectionFailCount = 0;
+                b.dynamicFailCount = 0;
+                b.historyRecorded = false;
+                sendPresence(bay, false);
+                sendFeedback("error", bayLabel(bay) + statusToString(job->status));
+            }
+            break;
+
+        case BMSCommand::READ_DYNAMIC:
+            if (job->status == BMSStatus::OK) {
+                b.cached_data = job->data;
+                b.dynamicFailCount = 0;
+                sendDynamicData(bay, b.cached_data);
+            } else {
+                b.dynamicFailCount++;
+                if (b.dynamicFailCount >= MAX_DYNAMIC_FAILS && b.autoReadIdentified) {
+                    b.autoReadIdentified = false;
+                    b.lastPresenceState = false;
+                    b.detectionFailCount = 0;
+                    b.dynamicFailCount = 0;
+                    b.historyRecorded = false;
+                    sendPresence(bay, false);
+                    logToClients(bayLabel(bay) + "Battery disconnected.", LOG_LEVEL_INFO);
+                } else {
+                    sendFeedback("error", bayLabel(bay) + statusToString(job->status));
+                }
+            }
+            break;
+
+        case BMSCommand::LED_ON:
+            if (job->status == BMSStatus::OK) sendFeedback("success", bayLabel(bay) + "LED ON sent.");
+            else sendFeedback("error", bayLabel(bay) + statusToString(job->status));
+            break;
+        case BMSCommand::LED_OFF:
+            if (job->status == BMSStatus::OK) sendFeedback("success", bayLabel(bay) + "LED OFF sent.");
+            else sendFeedback("error", bayLabel(bay) + statusToString(job->status));
+            break;
+        case BMSCommand::CLEAR_ERRORS:
+            if (job->status == BMSStatus::OK) sendFeedback("success", bayLabel(bay) + "Clear errors sent.");
+            else sendFeedback("error", bayLabel(bay) + statusToString(job->status));
+            break;
+
+        case BMSCommand::AUTO_DETECT:
+            b.autoJobPending = false;
+            if (!autoDetectEnabled) break;  // toggled off while the job was running
+            if (job->status == BMSStatus::OK) {
+                b.cached_data = job->data;
+                b.cached_features = job->features;
+                b.autoReadIdentified = true;
+                b.lastPresenceState = true;
+                b.detectionFailCount = 0;
+                b.dynamicFailCount = 0;
+                sendPresence(bay, true);
+                sendStaticData(bay);
+                logToClients(bayLabel(bay) + "Battery detected: " + b.cached_data.model, LOG_LEVEL_INFO);
+
+                // The worker already ran the first dynamic read
+                if (job->dynamic_status == BMSStatus::OK) {
+                    sendDynamicData(bay, b.cached_data);
+                    logToClients(bayLabel(bay) + "Time to full dashboard: " + String(millis() - job->started_ms) + " ms",
+                                 LOG_LEVEL_INFO);
+
+                    // Record history snapshot once per insertion
+                    if (!b.historyRecorded) {
+                        appendHistoryRecord(b.cached_data);
+                        b.historyRecorded = true;
+                    }
+                }
+                b.lastDynamicRead = millis();
+            } else if (job->present || job->status != BMSStatus::ERROR_NOT_PRESENT) {
+                // A pack is there but cannot be identified; an empty bay costs nothing
+                b.detectionFailCount++;
+                if (b.detectionFailCount == MAX_DETECTION_ATTEMPTS) {
+                    logToClients(bayLabel(bay) + "Identification failed " + String(MAX_DETECTION_ATTEMPTS) +
+                                 " times, backing off to " + String(BACKOFF_INTERVAL / 1000) + "s",
+                                 LOG_LEVEL_INFO);
+                }
+            }
+            break;
+
+        case BMSCommand::LIVE_START:
+            if (job->status == BMSStatus::OK) {
+                bool started = !b.liveActive;
+                b.liveActive = true;
+                b.liveRateHz = job->param;
+                b.liveLastKeepalive = millis();
+                if (started) {
+                    b.cached_data = job->data;
+                    sendDynamicData(bay, b.cached_data);
+                }
+                sendLiveStatus(bay, nullptr);
+                logToClients(bayLabel(bay) + "Live session: " + String(b.liveRateHz) + " Hz", LOG_LEVEL_INFO);
+            } else {
+                sendFeedback("error", bayLabel(bay) + statusToString(job->status));
+            }
+            break;
+
+        case BMSCommand::LIVE_STOP:
+            b.liveStopPending = false;
+            if (b.liveActive) {
+                b.liveActive = false;
+                b.lastDynamicRead = millis();  // resume the normal poll schedule
+                sendLiveStatus(bay, liveStopReasonName((LiveStopReason)job->param));
+                logToClients(bayLabel(bay) + "Live session ended (" + liveStopReasonName((LiveStopReason)job->param) + ")",
+                             LOG_LEVEL_INFO);
+            }
+            break;
+
+        case BMSCommand::LIVE_SAMPLE:
+            // Failed samples are counted by the worker, which closes the session itself
+            if (job->status == BMSStatus::OK && b.autoReadIdentified) {
+                b.cached_data = job->data;
+                sendDynamicData(bay, b.cached_data);
+            }
+            break;
+
+        case BMSCommand::AUTO_POLL:
+            b.autoJobPending = false;
+            if (!autoDetectEnabled || !b.autoReadIdentified) break;
+            if (job->status == BMSStatus::OK) {
+                b.cached_data = job->data;
+                b.dynamicFailCount = 0;
+                sendDynamicData(bay, b.cached_data);
+            } else {
+                b.dynamicFailCount++;
+                Serial.printf("[DBG] Dynamic read fail %d/%d\n", b.dynamicFailCount, MAX_DYNAMIC_FAILS);
+
+                if (b.dynamicFailCount >= MAX_DYNAMIC_FAILS) {
+                    // Battery truly gone
+                    b.autoReadIdentified = false;
+                    b.lastPresenceState = false;
+                    b.detectionFailCount = 0;
+                    b.dynamicFailCount = 0;
+                    b.historyRecorded = false;
+                    sendPresence(bay, false);
+                    logToClients(bayLabel(bay) + "Battery disconnected.", LOG_LEVEL_INFO);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
 }
 
 /**
@@ -372,88 +1506,86 @@ void sendWifiStatus(AsyncWebSocketClient* client) {
 void onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
     if (type == WS_EVT_CONNECT) {
         Serial.printf("WS client #%u connected\n", client->id());
-        sendPresence(lastPresenceState);
-        // If battery already identified, send cached data to new client
-        if (autoReadIdentified) {
-            sendJsonResponse("static_data", cached_data, &cached_features);
+        if (!trackClient(client->id(), true)) {
+            Serial.printf("WS client #%u refused: %u clients connected\n", client->id(), MAX_TRACKED_CLIENTS);
+            client->close();
+            return;
+        }
+        wsSend(client, String("{\"type\":\"bays\",\"count\":") + BAY_COUNT + "}");
+        // Current state goes to the new client only
+        for (uint8_t i = 0; i < BAY_COUNT; i++) {
+            sendPresence(i, bays[i].lastPresenceState, client);
+            // If battery already identified, send the pre-serialized static data
+            if (bays[i].autoReadIdentified) sendStaticSnapshot(i, client->id());
+            if (bays[i].liveActive) sendLiveStatus(i, nullptr, client);
         }
     } else if (type == WS_EVT_DISCONNECT) {
         Serial.printf("WS client #%u disconnected\n", client->id());
+        trackClient(client->id(), false);
     } else if (type == WS_EVT_DATA) {
         DynamicJsonDocument doc(256);
         if (deserializeJson(doc, (char*)data) != DeserializationError::Ok) return;
         
         String command = doc["command"];
+        // Bay-addressed commands take "bay" (default 0)
+        int bayArg = doc["bay"] | 0;
+        if (bayArg < 0 || bayArg >= BAY_COUNT) {
+            wsSend(client, "{\"type\":\"error\",\"message\":\"Unknown bay\"}");
+            return;
+        }
+        const uint8_t bay = (uint8_t)bayArg;
+        BayState& b = bays[bay];
 
         if (command == "presence") {
-            sendPresence(bms.isPresent());
+            submitCommand(BMSCommand::PRESENCE, bay, client);
         } else if (command == "read_static") {
             // Lectura única de datos maestros de la batería
-            BatteryData fresh_data;
-            SupportedFeatures fresh_features;
-            BMSStatus status = bms.readStaticData(fresh_data, fresh_features);
-            if (status == BMSStatus::OK) {
-                cached_data = fresh_data;
-                cached_features = fresh_features;
-                autoReadIdentified = true;
-                lastPresenceState = true;
-                detectionFailCount = 0;
-                dynamicFailCount = 0;
-                lastDynamicRead = millis();
-                sendJsonResponse("static_data", cached_data, &cached_features);
-                sendPresence(true);
-                if (!historyRecorded) {
-                    appendHistoryRecord(cached_data);
-                    historyRecorded = true;
-                }
-            } else {
-                // Reset auto-detection state so loop re-detects
-                autoReadIdentified = false;
-                lastPresenceState = false;
-                detectionFailCount = 0;
-                dynamicFailCount = 0;
-                historyRecorded = false;
-                sendPresence(false);
-                sendFeedback("error", statusToString(status));
-            }
+            submitCommand(BMSCommand::READ_STATIC, bay, client);
         } else if (command == "read_dynamic") {
             // Lectura de voltajes y temperaturas actuales
-            BMSStatus status = bms.readDynamicData(cached_data);
-            if (status == BMSStatus::OK) {
-                dynamicFailCount = 0;
-                sendJsonResponse("dynamic_data", cached_data, nullptr);
-            } else {
-                dynamicFailCount++;
-                if (dynamicFailCount >= MAX_DYNAMIC_FAILS && autoReadIdentified) {
-                    autoReadIdentified = false;
-                    lastPresenceState = false;
-                    detectionFailCount = 0;
-                    dynamicFailCount = 0;
-                    historyRecorded = false;
-                    sendPresence(false);
-                    logToClients("Battery disconnected.", LOG_LEVEL_INFO);
-                } else {
-                    sendFeedback("error", statusToString(status));
-                }
-            }
+            submitCommand(BMSCommand::READ_DYNAMIC, bay, client);
         } else if (command == "led_on") {
             // Enciende los LEDs de la batería (solo modelos STANDARD)
-            BMSStatus status = bms.ledTest(true);
-            if (status == BMSStatus::OK) sendFeedback("success", "LED ON sent.");
-            else sendFeedback("error", statusToString(status));
+            submitCommand(BMSCommand::LED_ON, bay, client);
         } else if (command == "led_off") {
-            BMSStatus status = bms.ledTest(false);
-            if (status == BMSStatus::OK) sendFeedback("success", "LED OFF sent.");
-            else sendFeedback("error", statusToString(status));
+            submitCommand(BMSCommand::LED_OFF, bay, client);
         } else if (command == "clear_errors") {
             // Intenta resetear contadores de error del controlador
-            BMSStatus status = bms.clearErrors();
-            if (status == BMSStatus::OK) sendFeedback("success", "Clear errors sent.");
-            else sendFeedback("error", statusToString(status));
+            submitCommand(BMSCommand::CLEAR_ERRORS, bay, client);
+        } else if (command == "live_start") {
+            // Sesión en vivo: BMS alimentado y lecturas continuas a rate_hz
+            b.liveLastKeepalive = millis();
+            submitCommand(BMSCommand::LIVE_START, bay, client, doc["rate_hz"] | 5);
+        } else if (command == "live_stop") {
+            submitCommand(BMSCommand::LIVE_STOP, bay, client, (uint16_t)LiveStopReason::REQUESTED);
+        } else if (command == "live_keepalive") {
+            b.liveLastKeepalive = millis();
+        } else if (command == "set_binary") {
+            // Dynamic updates as binary TelemetryFrames for this client
+            setBinaryTelemetry(client->id(), doc["enabled"] | false);
+        } else if (command == "set_delta") {
+            // Delta thresholds: {"mv": 2, "centi_c": 10, "keyframe_s": 10}; mv 0 = full updates only
+            deltaMv = doc["mv"] | deltaMv;
+            deltaCentiC = doc["centi_c"] | deltaCentiC;
+            deltaKeyframeMs = (doc["keyframe_s"] | (deltaKeyframeMs / 1000)) * 1000UL;
+            if (deltaKeyframeMs == 0) deltaKeyframeMs = 1000;
+            for (DeltaState& d : deltas) d.keyframeDue = true;
+            logToClients("Delta updates: " + String(deltaMv) + " mV, " + String(deltaCentiC / 100.0f, 2) + " °C, keyframe " +
+                         String(deltaKeyframeMs / 1000) + " s", LOG_LEVEL_INFO);
+        } else if (command == "set_freshness") {
+            // read_static / read_dynamic answered from the last result for this long: {"ms": 1000}, 0 = off
+            worker.setFreshness(doc["ms"] | worker.freshness());
+            logToClients("Read freshness: " + String(worker.freshness()) + " ms", LOG_LEVEL_INFO);
+        } else if (command == "get_worker_stats") {
+            sendWorkerStats(client);
+        } else if (command == "get_metrics") {
+            sendMetrics(client, bay);
+            if (doc["reset"] | false) bms[bay]->clearMetrics();
         } else if (command == "set_logging") {
             // Activa o desactiva la depuración detallada
             bool enabled = doc["enabled"];
-            bms.setLogLevel(enabled ? LOG_LEVEL_DEBUG : LOG_LEVEL_INFO);
+            logLevel = enabled ? LOG_LEVEL_DEBUG : LOG_LEVEL_INFO;
+            for (uint8_t i = 0; i < BAY_COUNT; i++) bms[i]->setLogLevel(logLevel);
             logToClients(String("Log level: ") + (enabled ? "DEBUG" : "INFO"), LOG_LEVEL_INFO);
         } else if (command == "get_config") {
             DynamicJsonDocument configDoc(256);
@@ -462,7 +1594,7 @@ void onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsE
             configDoc["theme"] = current_theme;
             String out;
             serializeJson(configDoc, out);
-            client->text(out);
+            wsSend(client, out);
         } else if (command == "save_config") {
             current_lang = doc["lang"].as<String>();
             current_theme = doc["theme"].as<String>();
@@ -487,30 +1619,50 @@ void onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsE
             sendWifiStatus(client);
         } else if (command == "list_batteries") {
             sendBatteryList(client);
+        } else if (command == "rebuild_history_index") {
+            // Repair: loop() regenerates /h.idx from the history files, then resends the list
+            historyIndexRebuildRequested = true;
         } else if (command == "get_history") {
-            String rid = doc["rom_id"].as<String>();
-            sendBatteryHistory(client, rid);
+            // "points": N = whole history downsampled to N chart points; read by loop()
+            if (!requestHistory(client->id(), doc["rom_id"].as<String>(), doc["points"] | 0)) {
+                wsSend(client, "{\"type\":\"error\",\"message\":\"History busy, try again\"}");
+            }
         } else if (command == "clear_history") {
-            String rid = doc["rom_id"].as<String>();
-            deleteHistory(rid);
-            sendBatteryList(client);  // refresh list for requester
-            logToClients("History cleared for " + rid, LOG_LEVEL_INFO);
+            // Deleted by loop(), which then sends the refreshed list
+            if (!requestHistoryClear(doc["rom_id"].as<String>())) {
+                wsSend(client, "{\"type\":\"error\",\"message\":\"Cannot clear history now\"}");
+            }
         } else if (command == "scan_wifi") {
             wifiScanRequested = true;
         } else if (command == "set_auto_detect") {
-            autoDetectEnabled = doc["enabled"];
-            logToClients(String("Auto-detect: ") + (autoDetectEnabled ? "ON" : "OFF"), LOG_LEVEL_INFO);
-            if (!autoDetectEnabled) {
-                // If turning off while battery was identified, send disconnect
-                if (autoReadIdentified) {
-                    autoReadIdentified = false;
-                    lastPresenceState = false;
-                    detectionFailCount = 0;
-                    dynamicFailCount = 0;
-                    historyRecorded = false;
-                    sendPresence(false);
+            // Applied by loop(): it owns the bay state this touches
+            autoDetectRequest = (doc["enabled"] | false) ? 1 : 0;
+#ifdef MAKITA_SIMULATED_BMS
+        } else if (command == "sim") {
+            // Simulated pack control: {"bay": n, "pack": idx | -1 (remove), "fault": "none|ff|00|disconnect", "after": bytes}
+            if (doc.containsKey("pack")) {
+                int pack = doc["pack"];
+                if (pack < 0 || pack >= MakitaSim::PACK_COUNT) {
+                    buses[bay]->remove();
+                    logToClients(bayLabel(bay) + "Sim: pack removed", LOG_LEVEL_INFO);
+                } else {
+                    buses[bay]->insert((uint8_t)pack);
+                    logToClients(bayLabel(bay) + "Sim: inserted " + MakitaSim::PACKS[pack].label, LOG_LEVEL_INFO);
                 }
             }
+            if (doc.containsKey("fault")) {
+                String f = doc["fault"].as<String>();
+                MakitaSim::Fault fault = f == "ff" ? MakitaSim::Fault::BUS_FF
+                                       : f == "00" ? MakitaSim::Fault::BUS_00
+                                       : f == "disconnect" ? MakitaSim::Fault::DISCONNECT
+                                       : MakitaSim::Fault::NONE;
+                buses[bay]->setFault(fault, doc["after"] | 0);
+                logToClients(bayLabel(bay) + "Sim: fault " + f, LOG_LEVEL_INFO);
+            }
+        } else if (command == "soak") {
+            // Heap soak on bay 0: {"cycles": N} identification + dynamic read pairs
+            soakRequest = doc["cycles"] | 1000;
+#endif
         }
     }
 }
@@ -554,6 +1706,120 @@ void loadConfig(String& lang, String& theme, String& wifi_ssid, String& wifi_pas
     file.close();
 }
 
+/**
+ * Applies a set_auto_detect request. Turning detection off stops live sessions and
+ * reports identified packs as removed, so the page does not keep stale readings.
+ */
+void applyAutoDetect(bool enabled) {
+    autoDetectEnabled = enabled;
+    logToClients(String("Auto-detect: ") + (autoDetectEnabled ? "ON" : "OFF"), LOG_LEVEL_INFO);
+    for (uint8_t i = 0; !autoDetectEnabled && i < BAY_COUNT; i++) {
+        BayState& st = bays[i];
+        if (st.liveActive && !st.liveStopPending) {
+            st.liveStopPending = worker.submit(BMSCommand::LIVE_STOP, i, 0, (uint16_t)LiveStopReason::REQUESTED);
+        }
+        // If turning off while battery was identified, send disconnect
+        if (st.autoReadIdentified) {
+            st.autoReadIdentified = false;
+            st.lastPresenceState = false;
+            st.detectionFailCount = 0;
+            st.dynamicFailCount = 0;
+            st.historyRecorded = false;
+            sendPresence(i, false);
+        }
+    }
+}
+
+/**
+ * Auto-detection, live-session limits and auto-poll for one bay. The worker runs the
+ * bus work; loop() only decides when to queue it.
+ */
+void scheduleBay(uint8_t bay, unsigned long now) {
+    BayState& b = bays[bay];
+
+    // --- Auto-detect battery ---
+    if (autoDetectEnabled && !b.autoReadIdentified && !b.autoJobPending) {
+        bool backoff = (b.detectionFailCount >= MAX_DETECTION_ATTEMPTS);
+        bool edge = false;
+#ifdef MAKITA_INSERT_IRQ
+        edge = b.insertEdge;
+        b.insertEdge = false;
+#endif
+        if (now - b.lastDetectionAttempt > (backoff ? BACKOFF_INTERVAL : DETECTION_INTERVAL)) {
+            b.lastDetectionAttempt = now;
+            b.lastPresenceProbe = now;
+            b.autoJobPending = worker.submit(BMSCommand::AUTO_DETECT, bay);
+        } else if (edge || now - b.lastPresenceProbe > (backoff ? BACKOFF_INTERVAL : PROBE_INTERVAL)) {
+            b.lastPresenceProbe = now;
+            b.autoJobPending = worker.submit(BMSCommand::AUTO_DETECT, bay, 0, BMSWorker::DETECT_GATED);
+        }
+    }
+
+    // --- Live session idle timeout: nobody is watching, power the BMS down ---
+    if (b.liveActive && !b.liveStopPending && (ws.count() == 0 || now - b.liveLastKeepalive > LIVE_IDLE_TIMEOUT)) {
+        b.liveStopPending = worker.submit(BMSCommand::LIVE_STOP, bay, 0, (uint16_t)LiveStopReason::IDLE_TIMEOUT);
+    }
+
+    // --- Auto-poll dynamic data while battery is identified (live sessions sample on their own) ---
+    if (autoDetectEnabled && b.autoReadIdentified && !b.autoJobPending && !b.liveActive &&
+        (now - b.lastDynamicRead > DYNAMIC_READ_INTERVAL)) {
+        b.lastDynamicRead = now;
+        b.autoJobPending = worker.submit(BMSCommand::AUTO_POLL, bay);
+    }
+}
+
+#ifdef MAKITA_SIMULATED_BMS
+// --- Heap soak (simulated builds) ---
+//
+// Runs read_static / read_dynamic pairs on bay 0 back to back through the normal result
+// path (worker jobs, BatteryData copies, JSON, outboxes, history) and reports the free
+// heap and the largest free block before and after. A largest block that keeps shrinking
+// while the free total holds is fragmentation. Freshness is off during the run so every
+// read goes through the simulated bus.
+// No board figures are recorded yet, for this BatteryData or the String-based one before
+// it; test_bench (bench_read_cycle_heap) has the host allocation counts for both.
+
+struct SoakRun {
+    bool active = false;
+    uint32_t cycles = 0;
+    uint32_t jobs = 0;          // still to submit, two per cycle
+    uint32_t freshMs = 0;
+    uint32_t free0 = 0, block0 = 0;
+    unsigned long started = 0;
+};
+SoakRun soak;
+
+void serviceSoak() {
+    uint32_t requested = soakRequest;
+    if (requested && !soak.active) {
+        soakRequest = 0;
+        soak.active = true;
+        soak.cycles = requested;
+        soak.jobs = requested * 2;
+        soak.freshMs = worker.freshness();
+        soak.free0 = ESP.getFreeHeap();
+        soak.block0 = ESP.getMaxAllocHeap();
+        soak.started = millis();
+        worker.setFreshness(0);
+        Serial.printf("Soak: %u cycles, heap free %u, largest block %u\n", soak.cycles, soak.free0, soak.block0);
+    }
+    if (!soak.active || worker.pending() > 0) return;
+
+    if (soak.jobs == 0) {
+        soak.active = false;
+        worker.setFreshness(soak.freshMs);
+        char line[128];
+        snprintf(line, sizeof(line), "Soak: %u cycles in %lu s, heap free %u -> %u (min %u), largest block %u -> %u",
+                 soak.cycles, (millis() - soak.started) / 1000, soak.free0, ESP.getFreeHeap(),
+                 ESP.getMinFreeHeap(), soak.block0, ESP.getMaxAllocHeap());
+        logToClients(line, LOG_LEVEL_INFO);
+        return;
+    }
+    BMSCommand cmd = (soak.jobs % 2 == 0) ? BMSCommand::READ_STATIC : BMSCommand::READ_DYNAMIC;
+    if (worker.submit(cmd, 0)) soak.jobs--;
+}
+#endif
+
 void setup() {
     Serial.begin(115200);
     Serial.println("\nStarting Makita BMS Tool...");
@@ -569,24 +1835,62 @@ void setup() {
     loadConfig(current_lang, current_theme, current_wifi_ssid, current_wifi_pass);
     Serial.printf("Config loaded: Lang=%s, Theme=%s\n", current_lang.c_str(), current_theme.c_str());
 
-    bms.setLogCallback(logToClients);
+    controllerCache.begin();
+    Serial.printf("Controller cache: %u entries\n", controllerCache.size());
+
+    for (uint8_t i = 0; i < BAY_COUNT; i++) {
+#ifdef MAKITA_SIMULATED_BMS
+        buses[i] = new MakitaSim(i % MakitaSim::PACK_COUNT);
+        Serial.printf("Bay %u: simulated BMS (%s)\n", i, MakitaSim::PACKS[i % MakitaSim::PACK_COUNT].label);
+#else
+        // The C3 has two RMT TX and two RX channels: bays 0-1 get a pair, the rest bit-bang
+        rmt_channel_t tx = (i < 2) ? (rmt_channel_t)(RMT_CHANNEL_0 + i) : RMT_CHANNEL_MAX;
+        rmt_channel_t rx = (i < 2) ? (rmt_channel_t)(RMT_CHANNEL_2 + i) : RMT_CHANNEL_MAX;
+        buses[i] = new OneWireMakita(BAY_PINS[i].data, BAY_PINS[i].enable, tx, rx);
+#endif
+        bms[i] = new MakitaBMS(*buses[i]);
+        bms[i]->begin();
+        bms[i]->setControllerCache(&controllerCache);
+        worker.addBay(*bms[i]);
+    }
 
+#ifndef MAKITA_SIMULATED_BMS
     // Pin diagnostics
-    Serial.printf("ONEWIRE_PIN=%d, ENABLE_PIN=%d\n", ONEWIRE_PIN, ENABLE_PIN);
-    pinMode(ENABLE_PIN, OUTPUT);
-    digitalWrite(ENABLE_PIN, HIGH);
-    delay(500);
-    Serial.printf("Enable=HIGH -> OneWire reads: %d\n", digitalRead(ONEWIRE_PIN));
-    bool resetOk = bms.isPresent();
-    Serial.printf("Presence check: %s\n", resetOk ? "DETECTED" : "EMPTY");
-    digitalWrite(ENABLE_PIN, LOW);
-    delay(100);
-    Serial.printf("Enable=LOW  -> OneWire reads: %d\n", digitalRead(ONEWIRE_PIN));
-    digitalWrite(ENABLE_PIN, HIGH);
-    delay(500);
-    Serial.printf("Enable=HIGH -> OneWire reads: %d\n", digitalRead(ONEWIRE_PIN));
-    resetOk = bms.isPresent();
-    Serial.printf("Presence check: %s\n", resetOk ? "DETECTED" : "EMPTY");
+    for (uint8_t i = 0; i < BAY_COUNT; i++) {
+        const BayPins& pins = BAY_PINS[i];
+        Serial.printf("Bay %u: ONEWIRE_PIN=%d, ENABLE_PIN=%d\n", i, pins.data, pins.enable);
+        buses[i]->setPower(true);
+        delay(500);
+        Serial.printf("Enable=HIGH -> OneWire reads: %d\n", digitalRead(pins.data));
+        bool resetOk = bms[i]->isPresent();
+        Serial.printf("Presence check: %s\n", resetOk ? "DETECTED" : "EMPTY");
+        buses[i]->setPower(false);
+        delay(100);
+        Serial.printf("Enable=LOW  -> OneWire reads: %d\n", digitalRead(pins.data));
+        buses[i]->setPower(true);
+        delay(500);
+        Serial.printf("Enable=HIGH -> OneWire reads: %d\n", digitalRead(pins.data));
+        resetOk = bms[i]->isPresent();
+        Serial.printf("Presence check: %s\n", resetOk ? "DETECTED" : "EMPTY");
+    }
+#endif
+
+    drainBmsLogs();
+    serviceHistoryRequests();
+
+    // From here on the buses belong to the worker task
+#ifdef MAKITA_INSERT_IRQ
+    for (uint8_t i = 0; i < BAY_COUNT; i++) {
+        attachInterruptArg(digitalPinToInterrupt(insertIrqPin(i)), onInsertEdge, (void*)(uintptr_t)i, CHANGE);
+        Serial.printf("Bay %u: insertion IRQ on GPIO%d\n", i, insertIrqPin(i));
+    }
+#endif
+    if (!worker.begin()) {
+        Serial.println("BMS worker task failed to start");
+    }
+#if defined(MAKITA_SIMULATED_BMS) && defined(MAKITA_SOAK_CYCLES)
+    soakRequest = MAKITA_SOAK_CYCLES;
+#endif
 
     // Modo WiFi Dual: SoftAP + Station
     WiFi.mode(WIFI_AP_STA);
@@ -604,6 +1908,10 @@ void setup() {
 
     // Create history directory and log filesystem usage
     if (!LittleFS.exists("/h")) LittleFS.mkdir("/h");
+    HistoryIndexHeader indexHdr;
+    File index = openHistoryIndex("r", indexHdr);
+    if (index) index.close();
+    else rebuildHistoryIndex();
     Serial.printf("LittleFS used: %u / %u bytes\n", LittleFS.usedBytes(), LittleFS.totalBytes());
     
     ws.onEvent(onWebSocketEvent);
@@ -637,6 +1945,36 @@ void setup() {
         }
     });
 
+    // Raw bus capture of one bay (format in src/BusCapture.h, decode with tools/capture_replay).
+    // /capture.bin?bay=N; add &clear=1 to empty the ring once it has been copied.
+    server.on("/capture.bin", HTTP_GET, [](AsyncWebServerRequest *request){
+        uint8_t bay = request->hasParam("bay") ? request->getParam("bay")->value().toInt() : 0;
+        if (bay >= BAY_COUNT) {
+            request->send(404, "text/plain", "Unknown bay");
+            return;
+        }
+        BusRecorder& recorder = bms[bay]->recorder();
+        const size_t cap = sizeof(BusCapture::Header) + BusRecorder::DEPTH * sizeof(BusCapture::Entry);
+        std::shared_ptr<uint8_t> buf(new (std::nothrow) uint8_t[cap], std::default_delete<uint8_t[]>());
+        if (!buf) {
+            request->send(503, "text/plain", "Out of memory");
+            return;
+        }
+        size_t len = recorder.writeFile(buf.get(), cap, bay);
+        if (request->hasParam("clear")) recorder.clear();
+        AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", len,
+            [buf, len](uint8_t *out, size_t maxLen, size_t index) -> size_t {
+                size_t n = min(maxLen, len - index);
+                memcpy(out, buf.get() + index, n);
+                return n;
+            });
+        response->addHeader("Content-Disposition", "attachment; filename=\"capture.bin\"");
+        request->send(response);
+    });
+
+    // Full history of one pack, streamed: /history?rom=<ROM ID>&format=csv|ndjson
+    server.on("/history", HTTP_GET, handleHistoryExport);
+
     // Servir archivos estáticos
     server.serveStatic("/", LittleFS, "/").setDefaultFile("index.html");
 
@@ -696,7 +2034,7 @@ void loop() {
         }
         String out;
         serializeJson(scanDoc, out);
-        ws.textAll(out);
+        wsSendAll(out);
         WiFi.scanDelete();
         logToClients("WiFi scan: " + String(n > 0 ? n : 0) + " networks found", LOG_LEVEL_INFO);
 
@@ -708,74 +2046,25 @@ void loop() {
 
     unsigned long now = millis();
 
-    // --- Auto-detect battery ---
-    if (autoDetectEnabled && !autoReadIdentified) {
-        unsigned long interval = (detectionFailCount >= MAX_DETECTION_ATTEMPTS)
-                                 ? BACKOFF_INTERVAL : DETECTION_INTERVAL;
-
-        if (now - lastDetectionAttempt > interval) {
-            lastDetectionAttempt = now;
-
-            BatteryData fresh_data;
-            SupportedFeatures fresh_features;
-            BMSStatus status = bms.readStaticData(fresh_data, fresh_features);
-
-            if (status == BMSStatus::OK) {
-                cached_data = fresh_data;
-                cached_features = fresh_features;
-                autoReadIdentified = true;
-                lastPresenceState = true;
-                detectionFailCount = 0;
-                dynamicFailCount = 0;
-                sendPresence(true);
-                sendJsonResponse("static_data", cached_data, &cached_features);
-                logToClients("Battery detected: " + cached_data.model, LOG_LEVEL_INFO);
-
-                // Immediately read dynamic data too
-                status = bms.readDynamicData(cached_data);
-                if (status == BMSStatus::OK) {
-                    sendJsonResponse("dynamic_data", cached_data, nullptr);
-
-                    // Record history snapshot once per insertion
-                    if (!historyRecorded) {
-                        appendHistoryRecord(cached_data);
-                        historyRecorded = true;
-                    }
-                }
-                lastDynamicRead = millis();
-            } else {
-                detectionFailCount++;
-                if (detectionFailCount == MAX_DETECTION_ATTEMPTS) {
-                    logToClients("No battery after " + String(MAX_DETECTION_ATTEMPTS) +
-                                 " attempts, backing off to " + String(BACKOFF_INTERVAL / 1000) + "s",
-                                 LOG_LEVEL_INFO);
-                }
-            }
-        }
+    // --- Results from the bus worker ---
+    drainBmsLogs();
+    serviceHistoryRequests();
+    while (BMSJob* job = worker.poll()) {
+        handleJobResult(job);
+        delete job;
     }
+    drainBmsLogs();
+    serviceHistoryRequests();
 
-    // --- Auto-poll dynamic data while battery is identified ---
-    if (autoDetectEnabled && autoReadIdentified && (now - lastDynamicRead > DYNAMIC_READ_INTERVAL)) {
-        lastDynamicRead = now;
-        BMSStatus status = bms.readDynamicData(cached_data);
-
-        if (status == BMSStatus::OK) {
-            dynamicFailCount = 0;
-            sendJsonResponse("dynamic_data", cached_data, nullptr);
-        } else {
-            dynamicFailCount++;
-            Serial.printf("[DBG] Dynamic read fail %d/%d\n", dynamicFailCount, MAX_DYNAMIC_FAILS);
-
-            if (dynamicFailCount >= MAX_DYNAMIC_FAILS) {
-                // Battery truly gone
-                autoReadIdentified = false;
-                lastPresenceState = false;
-                detectionFailCount = 0;
-                dynamicFailCount = 0;
-                historyRecorded = false;
-                sendPresence(false);
-                logToClients("Battery disconnected.", LOG_LEVEL_INFO);
-            }
-        }
+    int8_t autoDetect = autoDetectRequest;
+    if (autoDetect >= 0) {
+        autoDetectRequest = -1;
+        applyAutoDetect(autoDetect == 1);
     }
+    for (uint8_t i = 0; i < BAY_COUNT; i++) scheduleBay(i, now);
+#ifdef MAKITA_SIMULATED_BMS
+    serviceSoak();
+#endif
+
+    flushOutboxes();
 }
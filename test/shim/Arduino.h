@@ -0,0 +1,68 @@
+// test/shim/Arduino.h - HOST STAND-IN FOR THE ARDUINO CORE (env:native)
+
+#ifndef ARDUINO_SHIM_H
+#define ARDUINO_SHIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+#define IRAM_ATTR
+
+// Print.h radix macros, so a shared header that reuses these names fails here too
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+/**
+ * Only what the host-built modules use. Time is a fake clock: delay() and
+ * delayMicroseconds() advance it instead of sleeping, so a MakitaBMS run is
+ * deterministic and the elapsed millis() are the modelled bus and power-window time.
+ */
+namespace shim {
+inline uint64_t& nowUs() { static uint64_t t = 0; return t; }
+inline void advanceUs(uint64_t us) { nowUs() += us; }
+inline void resetClock() { nowUs() = 0; }
+}
+
+inline unsigned long millis() { return (unsigned long)(shim::nowUs() / 1000); }
+inline unsigned long micros() { return (unsigned long)shim::nowUs(); }
+inline void delay(unsigned long ms) { shim::advanceUs((uint64_t)ms * 1000); }
+inline void delayMicroseconds(unsigned int us) { shim::advanceUs(us); }
+
+// CPU cycle counter at 160 MHz, derived from the fake clock
+struct EspClass {
+    uint32_t getCpuFreqMHz() { return 160; }
+    uint32_t getCycleCount() { return (uint32_t)(shim::nowUs() * 160); }
+};
+inline EspClass& shimEsp() { static EspClass esp; return esp; }
+#define ESP (shimEsp())
+
+// FreeRTOS spinlocks: the host tests are single-threaded
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+// Arduino String, reduced to what the shared modules call
+class String {
+public:
+    String(const char* s = "") : _s(s ? s : "") {}
+    const char* c_str() const { return _s.c_str(); }
+    unsigned length() const { return (unsigned)_s.size(); }
+    bool operator==(const char* s) const { return _s == s; }
+
+private:
+    std::string _s;
+};
+
+#endif
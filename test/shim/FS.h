@@ -0,0 +1,32 @@
+// test/shim/FS.h - HOST STAND-IN FOR THE ARDUINO FILESYSTEM API (env:native)
+
+#ifndef FS_SHIM_H
+#define FS_SHIM_H
+
+#include "Arduino.h"
+
+// No filesystem on the host: every open() fails, so ControllerCache stays in RAM
+namespace fs {
+
+class File {
+public:
+    explicit operator bool() const { return false; }
+    size_t read(uint8_t*, size_t) { return 0; }
+    size_t write(const uint8_t*, size_t) { return 0; }
+    size_t size() const { return 0; }
+    void close() {}
+};
+
+class FS {
+public:
+    File open(const char*, const char* = "r") { return File(); }
+    bool exists(const char*) { return false; }
+    bool remove(const char*) { return false; }
+};
+
+}
+
+using fs::File;
+using fs::FS;
+
+#endif
@@ -0,0 +1,11 @@
+// test/shim/LittleFS.h - HOST STAND-IN FOR LITTLEFS (env:native)
+
+#ifndef LITTLEFS_SHIM_H
+#define LITTLEFS_SHIM_H
+
+#include "FS.h"
+
+inline fs::FS& shimLittleFS() { static fs::FS littlefs; return littlefs; }
+#define LittleFS (shimLittleFS())
+
+#endif
@@ -0,0 +1,29 @@
+// test/shim/esp_timer.h - HOST STAND-IN FOR THE ESP-IDF TIMER API (env:native)
+
+#ifndef ESP_TIMER_SHIM_H
+#define ESP_TIMER_SHIM_H
+
+#include <stdint.h>
+
+// Timers are created and armed but never fire: the host tests do not run live sessions
+typedef int esp_err_t;
+#define ESP_OK 0
+
+typedef void* esp_timer_handle_t;
+typedef struct {
+    void (*callback)(void*);
+    void* arg;
+    int dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t*, esp_timer_handle_t* out) {
+    static int timer;
+    *out = &timer;
+    return ESP_OK;
+}
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t, uint64_t) { return ESP_OK; }
+inline esp_err_t esp_timer_stop(esp_timer_handle_t) { return ESP_OK; }
+
+#endif
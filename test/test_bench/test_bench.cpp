@@ -0,0 +1,240 @@
+// test/test_bench/test_bench.cpp - HOST MICROBENCHMARKS (decode, history, telemetry, queues)
+//
+// Run with `pio test -e native -f test_bench -v` to see the numbers. They are host CPU
+// times, useful to compare changes to the same code, not to predict timings on the C3.
+// The MakitaBMS runs also report the modelled bus time (fake clock, see test/shim).
+
+#include <unity.h>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "MakitaBMS.h"
+#include "MakitaSim.h"
+#include "Telemetry.h"
+#include "HistoryFile.h"
+#include "WsOutbox.h"
+
+using namespace MakitaProtocol;
+
+static volatile uint32_t sink;
+
+// Heap use of the code under test: every operator new in this binary is counted
+static uint32_t heapAllocs = 0;
+static size_t heapBytes = 0;
+void* operator new(size_t n) {
+    heapAllocs++;
+    heapBytes += n;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+template <class F>
+static double nsPerOp(uint32_t iterations, F f) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) f(i);
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+}
+
+static void report(const char* name, double ns, const char* extra = "") {
+    char line[160];
+    if (ns >= 100000) snprintf(line, sizeof(line), "%-28s %10.1f us/op %s", name, ns / 1000, extra);
+    else snprintf(line, sizeof(line), "%-28s %10.1f ns/op %s", name, ns, extra);
+    TEST_MESSAGE(line);
+}
+
+static void drain(MakitaBMS& bms) {
+    LogRecord rec;
+    while (bms.logs().pop(rec)) {}
+}
+
+void setUp(void) { shim::resetClock(); }
+void tearDown(void) {}
+
+void bench_decode_static(void) {
+    uint8_t frame[StaticRead::FRAME_LEN];
+    for (uint8_t i = 0; i < sizeof(frame); i++) frame[i] = (uint8_t)(i * 37 + 5);
+    double ns = nsPerOp(2000000, [&](uint32_t i) {
+        frame[35] = (uint8_t)i;
+        uint32_t acc = readField(frame, Static::CYCLES) + readField(frame, Static::LOCK) +
+                       readField(frame, Static::STATUS) + readField(frame, Static::CAPACITY) +
+                       readField(frame, Static::TYPE) + readField(frame, Static::DATE_YEAR);
+        sink = acc;
+    });
+    report("decode static frame", ns);
+}
+
+void bench_decode_dynamic(void) {
+    uint8_t frame[DynamicRead::FRAME_LEN] = {0};
+    for (uint8_t c = 0; c < 5; c++) {
+        frame[2 + c * 2] = (uint8_t)(0xA0 + c);
+        frame[3 + c * 2] = 0x0F;
+    }
+    double ns = nsPerOp(2000000, [&](uint32_t i) {
+        frame[2] = (uint8_t)i;
+        Dynamic::Cells cells = Dynamic::readCells(frame, 5);
+        sink = readField(frame, Dynamic::PACK_MV) + cells.diff_mv + cells.max_mv +
+               readField(frame, Dynamic::TEMP1_CC) + readField(frame, Dynamic::TEMP2_CC);
+    });
+    report("decode dynamic frame", ns);
+}
+
+void bench_sim_reads(void) {
+    static const struct { uint8_t pack; const char* name; } runs[] = {
+        {0, "identify STANDARD 5S"}, {3, "identify F0513 5S"},
+    };
+    for (const auto& run : runs) {
+        MakitaSim sim(run.pack);
+        MakitaBMS bms(sim);
+        bms.setLogLevel(LOG_LEVEL_INFO);
+        BatteryData data;
+        SupportedFeatures features;
+        const uint32_t n = 2000;
+        uint64_t bus0 = shim::nowUs();
+        double ns = nsPerOp(n, [&](uint32_t) {
+            TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+            drain(bms);
+        });
+        char extra[64];
+        snprintf(extra, sizeof(extra), "(modelled %.0f ms)", (shim::nowUs() - bus0) / 1000.0 / n);
+        report(run.name, ns, extra);
+
+        bus0 = shim::nowUs();
+        ns = nsPerOp(n, [&](uint32_t) {
+            TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+            drain(bms);
+        });
+        snprintf(extra, sizeof(extra), "(modelled %.0f ms)", (shim::nowUs() - bus0) / 1000.0 / n);
+        report(run.pack == 0 ? "dynamic read STANDARD 5S" : "dynamic read F0513 5S", ns, extra);
+    }
+}
+
+// The soak run (main.cpp, serviceSoak) on the host, reduced to the BMS side: a fresh
+// BatteryData per cycle, a static and a dynamic read, a copy into the kept reading.
+// With the String members BatteryData had before it became POD (272 bytes on the host),
+// the same loop did 3 allocations (108 bytes) per cycle for STANDARD packs and 5 (197
+// bytes) for F0513. It now does none.
+void bench_read_cycle_heap(void) {
+    static const uint8_t packs[] = {0, 1, 2, 3, 4};
+    for (uint8_t pack : packs) {
+        MakitaSim sim(pack);
+        MakitaBMS bms(sim);
+        BatteryData kept;
+        SupportedFeatures features;
+        bms.readStaticData(kept, features);    // warm-up: controller cache, log ring
+        drain(bms);
+        const uint32_t n = 1000;
+        uint32_t allocs0 = heapAllocs;
+        size_t bytes0 = heapBytes;
+        for (uint32_t i = 0; i < n; i++) {
+            BatteryData data;
+            bms.readStaticData(data, features);
+            bms.readDynamicData(data);
+            kept = data;
+            drain(bms);
+        }
+        char line[96];
+        snprintf(line, sizeof(line), "read cycle heap, pack %u      %6.2f allocs %7.1f bytes (sizeof %u)", pack,
+                 (double)(heapAllocs - allocs0) / n, (double)(heapBytes - bytes0) / n, (unsigned)sizeof(BatteryData));
+        TEST_MESSAGE(line);
+        TEST_ASSERT_EQUAL_UINT32(allocs0, heapAllocs);
+    }
+}
+
+struct MemFile {
+    const std::vector<uint8_t>* bytes;
+    size_t pos;
+    size_t read(uint8_t* out, size_t n) {
+        if (n > bytes->size() - pos) n = bytes->size() - pos;
+        memcpy(out, bytes->data() + pos, n);
+        pos += n;
+        return n;
+    }
+};
+
+void bench_history_buckets(void) {
+    const uint32_t total = 100000;
+    std::vector<uint8_t> bytes(total * sizeof(HistoryRecord));
+    for (uint32_t i = 0; i < total; i++) {
+        HistoryRecord r = {};
+        r.timestamp = 1700000000 + i * 60;
+        r.pack_voltage = (uint16_t)(18000 + i % 1000);
+        for (uint8_t c = 0; c < 5; c++) r.cell_voltages[c] = (uint16_t)(3600 + i % 200);
+        memcpy(&bytes[i * sizeof(r)], &r, sizeof(r));
+    }
+    uint32_t buckets = 0;
+    double ns = nsPerOp(20, [&](uint32_t) {
+        MemFile f = {&bytes, 0};
+        HistoryBlockReader<MemFile> reader(f, sizeof(HistoryRecord));
+        buckets = 0;
+        bucketHistory(total, 100, [&](HistoryRecord& r) { return reader.next(r); },
+                      [&](const HistoryBucket& b) { buckets++; sink = b.pack; });
+    });
+    TEST_ASSERT_EQUAL_UINT32(100, buckets);
+    char extra[64];
+    snprintf(extra, sizeof(extra), "(%.1f ns/record)", ns / total);
+    report("history 100k -> 100 points", ns, extra);
+}
+
+void bench_delta_encode(void) {
+    TelemetryFrame sent = {}, now = {};
+    sent.cell_count = now.cell_count = 5;
+    uint8_t out[TELEMETRY_DELTA_MAX];
+    size_t bytes = 0;
+    double ns = nsPerOp(2000000, [&](uint32_t i) {
+        now.pack_mv = (uint16_t)(20000 + (i & 7));
+        now.cell_mv[i % 5] = (uint16_t)(4000 + (i & 3));
+        now.temp1_cC = (int16_t)(2300 + (i & 31));
+        uint8_t fields = changedFields(sent, now, 2, 10);
+        bytes += encodeDelta(now, fields, out);
+        applyFields(sent, now, fields);
+    });
+    char extra[64];
+    snprintf(extra, sizeof(extra), "(avg %.1f bytes vs %u full)", (double)bytes / 2000000,
+             (unsigned)sizeof(TelemetryFrame));
+    report("delta changedFields+encode", ns, extra);
+}
+
+void bench_ws_outbox(void) {
+    WsOutbox box;
+    WsMessage dyn;
+    dyn.payload = std::make_shared<const std::string>(22, 'x');
+    dyn.kind = WsMessage::DYNAMIC;
+    WsMessage out;
+    double ns = nsPerOp(1000000, [&](uint32_t i) {
+        dyn.bay = (uint8_t)(i & 1);
+        box.push(dyn);
+        if (i & 1) box.pop(out);
+    });
+    report("ws outbox push (+pop/2)", ns);
+}
+
+void bench_log_ring(void) {
+    LogRing ring;
+    LogRecord rec;
+    char line[LogRecord::PAYLOAD + 1];
+    const uint8_t hex[] = {0xD7, 0x00, 0x00, 0xFF};
+    double ns = nsPerOp(1000000, [&](uint32_t i) {
+        if (i & 1) ring.pushText(1, "Dynamic read complete.");
+        else ring.pushHex(2, ">> CC (cmd): ", hex, sizeof(hex));
+        ring.pop(rec);
+        sink = (uint32_t)LogRing::format(rec, line, sizeof(line));
+    });
+    report("log ring push+pop+format", ns);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_decode_static);
+    RUN_TEST(bench_decode_dynamic);
+    RUN_TEST(bench_sim_reads);
+    RUN_TEST(bench_read_cycle_heap);
+    RUN_TEST(bench_history_buckets);
+    RUN_TEST(bench_delta_encode);
+    RUN_TEST(bench_ws_outbox);
+    RUN_TEST(bench_log_ring);
+    return UNITY_END();
+}
@@ -0,0 +1,96 @@
+// test/test_bench_json/test_bench_json.cpp - JSON PAYLOAD MICROBENCHMARKS (ArduinoJson)
+//
+// Builds the dynamic_data messages with the firmware's buildDynamicJson() (keyframe and
+// delta) and compares time and size with the binary TelemetryFrame / TELEMETRY_DELTA
+// encodings. Host CPU times; run with -v to see them.
+
+#include <unity.h>
+#include <chrono>
+#include <ArduinoJson.h>
+#include "TelemetryJson.h"
+
+static volatile size_t sink;
+
+template <class F>
+static double nsPerOp(uint32_t iterations, F f) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) f(i);
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+}
+
+static void report(const char* name, double ns, size_t bytes) {
+    char line[160];
+    snprintf(line, sizeof(line), "%-28s %10.1f ns/op %4u bytes", name, ns, (unsigned)bytes);
+    TEST_MESSAGE(line);
+}
+
+static TelemetryFrame sample(uint32_t i) {
+    TelemetryFrame f = {};
+    f.type = TELEMETRY_DYNAMIC;
+    f.version = TELEMETRY_VERSION;
+    f.cell_count = 5;
+    f.pack_mv = (uint16_t)(20050 + (i & 7));
+    for (uint8_t c = 0; c < 5; c++) f.cell_mv[c] = (uint16_t)(4010 + ((i + c) & 3));
+    f.cell_diff_mv = 3;
+    f.temp1_cC = 2310;
+    f.temp2_cC = 2290;
+    return f;
+}
+
+static size_t dynamicJson(const TelemetryFrame& f, uint8_t fields, char* out, size_t cap) {
+    StaticJsonDocument<512> doc;
+    buildDynamicJson(doc, f, fields);
+    return serializeJson(doc, out, cap);
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void bench_json_full(void) {
+    char out[512];
+    size_t bytes = 0;
+    double ns = nsPerOp(200000, [&](uint32_t i) { bytes = dynamicJson(sample(i), DYN_ALL, out, sizeof(out)); });
+    TEST_ASSERT_GREATER_THAN(0, bytes);
+    report("json dynamic_data full", ns, bytes);
+}
+
+void bench_json_delta(void) {
+    char out[512];
+    size_t bytes = 0;
+    double ns = nsPerOp(200000, [&](uint32_t i) {
+        bytes = dynamicJson(sample(i), DYN_PACK | DYN_CELLS, out, sizeof(out));
+    });
+    TEST_ASSERT_GREATER_THAN(0, bytes);
+    report("json dynamic_data delta", ns, bytes);
+}
+
+void bench_json_parse_command(void) {
+    const char cmd[] = "{\"command\":\"read_dynamic\",\"bay\":1}";
+    double ns = nsPerOp(200000, [&](uint32_t) {
+        StaticJsonDocument<128> doc;
+        TEST_ASSERT_FALSE(deserializeJson(doc, cmd, sizeof(cmd) - 1));
+        const char* command = doc["command"];
+        sink = (doc["bay"] | 0) + (command ? strlen(command) : 0);
+    });
+    report("json parse WS command", ns, sizeof(cmd) - 1);
+}
+
+void bench_binary_for_comparison(void) {
+    uint8_t out[TELEMETRY_DELTA_MAX];
+    size_t bytes = 0;
+    double ns = nsPerOp(2000000, [&](uint32_t i) {
+        bytes = encodeDelta(sample(i), DYN_PACK | DYN_CELLS, out);
+        sink = out[5];
+    });
+    report("binary delta (pack+cells)", ns, bytes);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_json_full);
+    RUN_TEST(bench_json_delta);
+    RUN_TEST(bench_json_parse_command);
+    RUN_TEST(bench_binary_for_comparison);
+    return UNITY_END();
+}
@@ -0,0 +1,149 @@
+// test/test_encoder/test_encoder.cpp - RMT SYMBOL ENCODING AND DECODING (OneWireMakitaEncoder.h)
+
+#include <unity.h>
+#include "OneWireMakitaEncoder.h"
+
+typedef OneWireMakitaEncoder Enc;
+
+static void assertSymbol(uint16_t low, uint16_t high, const OneWireMakitaSymbol& s) {
+    TEST_ASSERT_EQUAL_UINT16(low, s.low_us);
+    TEST_ASSERT_EQUAL_UINT16(high, s.high_us);
+}
+
+// Slot of one written bit, straight from the timing table
+static void assertBit(bool one, const OneWireMakitaSymbol& s, uint16_t gap_us = 0) {
+    if (one) assertSymbol(Enc::TIME_WRITE1_LOW, Enc::TIME_WRITE1_HIGH + gap_us, s);
+    else assertSymbol(Enc::TIME_WRITE0_LOW, Enc::TIME_WRITE0_HIGH + gap_us, s);
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_timing_table(void) {
+    // Guards the values the whole encoder is checked against
+    TEST_ASSERT_EQUAL_UINT16(750, Enc::TIME_RESET_PULSE);
+    TEST_ASSERT_EQUAL_UINT16(70, Enc::TIME_RESET_WAIT);
+    TEST_ASSERT_EQUAL_UINT16(410, Enc::TIME_RESET_SLOT);
+    TEST_ASSERT_EQUAL_UINT16(12, Enc::TIME_WRITE1_LOW);
+    TEST_ASSERT_EQUAL_UINT16(120, Enc::TIME_WRITE1_HIGH);
+    TEST_ASSERT_EQUAL_UINT16(100, Enc::TIME_WRITE0_LOW);
+    TEST_ASSERT_EQUAL_UINT16(30, Enc::TIME_WRITE0_HIGH);
+    TEST_ASSERT_EQUAL_UINT16(10, Enc::TIME_READ_PULSE);
+    TEST_ASSERT_EQUAL_UINT16(10, Enc::TIME_READ_SAMPLE);
+    TEST_ASSERT_EQUAL_UINT16(53, Enc::TIME_READ_SLOT);
+}
+
+void test_reset_and_presence_window(void) {
+    OneWireMakitaSymbol s[2] = {};
+    TEST_ASSERT_EQUAL_size_t(1, Enc::encodeReset(s, 2));
+    assertSymbol(750, 70 + 410, s[0]);      // the presence pulse falls inside the high phase
+    TEST_ASSERT_EQUAL_size_t(0, Enc::encodeReset(s, 0));
+}
+
+void test_write_zero_and_one_bits(void) {
+    OneWireMakitaSymbol s[8];
+    const uint8_t zero = 0x00, one = 0xFF;
+    TEST_ASSERT_EQUAL_size_t(8, Enc::encodeWrite(&zero, 1, 0, s, 8));
+    for (uint8_t b = 0; b < 8; b++) assertSymbol(100, 30, s[b]);
+    TEST_ASSERT_EQUAL_size_t(8, Enc::encodeWrite(&one, 1, 0, s, 8));
+    for (uint8_t b = 0; b < 8; b++) assertSymbol(12, 120, s[b]);
+}
+
+void test_write_full_byte_lsb_first(void) {
+    OneWireMakitaSymbol s[8];
+    const uint8_t cmd = 0xCC;               // 1100 1100 -> sent as 0,0,1,1,0,0,1,1
+    TEST_ASSERT_EQUAL_size_t(8, Enc::encodeWrite(&cmd, 1, 90, s, 8));
+    const bool bits[8] = {false, false, true, true, false, false, true, true};
+    for (uint8_t b = 0; b < 7; b++) assertBit(bits[b], s[b]);
+    assertBit(bits[7], s[7], 90);           // inter-byte gap goes on the last high phase only
+}
+
+void test_write_gap_after_every_byte(void) {
+    OneWireMakitaSymbol s[16];
+    const uint8_t data[2] = {0x01, 0x80};
+    TEST_ASSERT_EQUAL_size_t(16, Enc::encodeWrite(data, 2, 50, s, 16));
+    assertBit(true, s[0]);
+    assertBit(false, s[7], 50);
+    assertBit(false, s[8]);
+    assertBit(true, s[15], 50);
+}
+
+void test_read_slots(void) {
+    OneWireMakitaSymbol s[16];
+    TEST_ASSERT_EQUAL_size_t(16, Enc::encodeRead(2, 40, s, 16));
+    for (uint8_t i = 0; i < 16; i++) {
+        uint16_t gap = (i % 8 == 7) ? 40 : 0;
+        assertSymbol(10, 10 + 53 + gap, s[i]);
+    }
+    TEST_ASSERT_EQUAL_size_t(0, Enc::encodeRead(3, 0, s, 16));
+}
+
+void test_decode_read_bit_threshold(void) {
+    // Sampled at TIME_READ_PULSE + TIME_READ_SAMPLE: still low there means '0'
+    TEST_ASSERT_TRUE(Enc::decodeReadBit(10));
+    TEST_ASSERT_TRUE(Enc::decodeReadBit(19));
+    TEST_ASSERT_FALSE(Enc::decodeReadBit(20));
+    TEST_ASSERT_FALSE(Enc::decodeReadBit(60));
+}
+
+void test_decode_read_bytes(void) {
+    // 0xA5 then 0x3C, LSB first; a '0' is a stretched low pulse
+    const uint8_t want[2] = {0xA5, 0x3C};
+    uint16_t lows[16];
+    for (uint8_t i = 0; i < 16; i++) lows[i] = (want[i / 8] >> (i % 8)) & 1 ? 11 : 45;
+    uint8_t out[2] = {0, 0};
+    TEST_ASSERT_EQUAL_size_t(2, Enc::decodeRead(lows, 16, out, 2));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(want, out, 2);
+
+    // A short capture decodes only the complete bytes
+    uint8_t partial[2] = {0xFF, 0xFF};
+    TEST_ASSERT_EQUAL_size_t(1, Enc::decodeRead(lows, 13, partial, 2));
+    TEST_ASSERT_EQUAL_HEX8(0xA5, partial[0]);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, partial[1]);
+}
+
+void test_tx_chunk_fills_exactly_64_symbols(void) {
+    TEST_ASSERT_EQUAL_size_t(64, Enc::TX_CHUNK_SYMBOLS);
+    TEST_ASSERT_EQUAL_size_t(32, Enc::RX_CHUNK_SYMBOLS);
+    TEST_ASSERT_TRUE(Enc::RX_CHUNK_SYMBOLS <= 48);  // one C3 RMT block (mem_block_num = 1)
+
+    uint8_t data[Enc::TX_CHUNK_BYTES + 1];
+    for (uint8_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(0x11 * i);
+    OneWireMakitaSymbol s[Enc::TX_CHUNK_SYMBOLS];
+    TEST_ASSERT_EQUAL_size_t(64, Enc::encodeWrite(data, Enc::TX_CHUNK_BYTES, 0, s, Enc::TX_CHUNK_SYMBOLS));
+    TEST_ASSERT_EQUAL_size_t(0, Enc::encodeWrite(data, Enc::TX_CHUNK_BYTES + 1, 0, s, Enc::TX_CHUNK_SYMBOLS));
+    TEST_ASSERT_EQUAL_size_t(0, Enc::encodeRead(Enc::TX_CHUNK_BYTES + 1, 0, s, Enc::TX_CHUNK_SYMBOLS));
+}
+
+void test_chunked_write_matches_single_encode(void) {
+    // OneWireMakita::rmtWrite() splits 12 bytes as 8 + 4; the symbols must not change
+    uint8_t data[12];
+    for (uint8_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(0x5A ^ (i * 29));
+    OneWireMakitaSymbol whole[96], chunked[96];
+    TEST_ASSERT_EQUAL_size_t(96, Enc::encodeWrite(data, 12, 90, whole, 96));
+
+    size_t n = 0;
+    for (size_t off = 0; off < sizeof(data); off += Enc::TX_CHUNK_BYTES) {
+        size_t len = sizeof(data) - off < Enc::TX_CHUNK_BYTES ? sizeof(data) - off : Enc::TX_CHUNK_BYTES;
+        size_t got = Enc::encodeWrite(data + off, len, 90, chunked + n, Enc::TX_CHUNK_SYMBOLS);
+        TEST_ASSERT_EQUAL_size_t(len * 8, got);
+        n += got;
+    }
+    TEST_ASSERT_EQUAL_size_t(96, n);
+    TEST_ASSERT_EQUAL_MEMORY(whole, chunked, sizeof(whole));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_timing_table);
+    RUN_TEST(test_reset_and_presence_window);
+    RUN_TEST(test_write_zero_and_one_bits);
+    RUN_TEST(test_write_full_byte_lsb_first);
+    RUN_TEST(test_write_gap_after_every_byte);
+    RUN_TEST(test_read_slots);
+    RUN_TEST(test_decode_read_bit_threshold);
+    RUN_TEST(test_decode_read_bytes);
+    RUN_TEST(test_tx_chunk_fills_exactly_64_symbols);
+    RUN_TEST(test_chunked_write_matches_single_encode);
+    return UNITY_END();
+}
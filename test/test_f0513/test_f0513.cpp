@@ -0,0 +1,231 @@
+// test/test_f0513/test_f0513.cpp - F0513 BUS TRANSCRIPTS AND REFRESH TIMES (MakitaBMS + MakitaSim)
+//
+// Runs the two F0513 sim packs through the MakitaBMS state machine and checks every
+// power, reset, TX and RX event on the bus. Times come from the fake clock (test/shim),
+// so they are the modelled bus times: power-on waits, gaps and byte slots.
+
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "MakitaBMS.h"
+#include "MakitaSim.h"
+
+// Sim presets (lib/MakitaSim/MakitaSim.cpp)
+static const uint8_t F0513_5S = 3, F0513_4S = 4;
+
+// Wraps the sim and records the bus traffic, one line per event. Consecutive bytes in
+// the same direction share a line; power events carry the time since mark(), in ms.
+class TranscriptBus : public MakitaBus
+{
+  public:
+    explicit TranscriptBus(uint8_t pack) : _sim(pack) {}
+
+    std::vector<std::string> lines;
+
+    void mark() {
+        lines.clear();
+        _dir = 0;
+        _t0 = shim::nowUs();
+    }
+
+    bool begin() override { return true; }
+    const char* name() const override { return "transcript"; }
+    bool reset() override {
+        bool presence = _sim.reset();
+        event(presence ? "reset" : "reset (no presence)");
+        return presence;
+    }
+    void write(uint8_t v) override {
+        byte('w', v);
+        _sim.write(v);
+    }
+    uint8_t read() override {
+        uint8_t v = _sim.read();
+        byte('r', v);
+        return v;
+    }
+    void writeBytes(const uint8_t* data, uint8_t len, uint16_t gap_us) override {
+        for (uint8_t i = 0; i < len; i++) byte('w', data[i]);
+        _sim.writeBytes(data, len, gap_us);
+    }
+    void readBytes(uint8_t* data, uint8_t len, uint16_t gap_us) override {
+        _sim.readBytes(data, len, gap_us);
+        for (uint8_t i = 0; i < len; i++) byte('r', data[i]);
+    }
+    void setPower(bool on) override {
+        char line[32];
+        snprintf(line, sizeof(line), "%s %.1f", on ? "on" : "off", (shim::nowUs() - _t0) / 1000.0);
+        event(line);
+        _sim.setPower(on);
+    }
+
+  private:
+    MakitaSim _sim;
+    uint64_t _t0 = 0;
+    char _dir = 0;
+
+    void event(const char* text) {
+        lines.push_back(text);
+        _dir = 0;
+    }
+    void byte(char dir, uint8_t v) {
+        if (dir != _dir) lines.push_back(dir == 'w' ? "tx" : "rx");
+        _dir = dir;
+        char hex[4];
+        snprintf(hex, sizeof(hex), " %02X", v);
+        lines.back() += hex;
+    }
+};
+
+template <size_t N>
+static void assertTranscript(const char* const (&expected)[N], const std::vector<std::string>& actual) {
+    char msg[32];
+    for (size_t i = 0; i < N && i < actual.size(); i++) {
+        snprintf(msg, sizeof(msg), "line %u", (unsigned)i);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(expected[i], actual[i].c_str(), msg);
+    }
+    TEST_ASSERT_EQUAL_size_t(N, actual.size());
+}
+
+static uint32_t retries(const MakitaBMS& bms) {
+    return bms.metrics().ops[(size_t)BMSOperation::READ_DYNAMIC].retries;
+}
+
+static BatteryData data;
+static SupportedFeatures features;
+
+void setUp(void) {
+    shim::resetClock();
+    data = BatteryData();
+    features = SupportedFeatures();
+}
+void tearDown(void) {}
+
+void test_identify_5s(void) {
+    TranscriptBus bus(F0513_5S);
+    MakitaBMS bms(bus);
+    bus.mark();
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_STRING("BL1815", data.model);
+    TEST_ASSERT_EQUAL_UINT8(5, data.cell_count);
+
+    static const char* const expected[] = {
+        "on 0.0",
+        // Static frame: answered by both controllers
+        "reset", "tx 33", "rx 12 09 30 04 B2 41 10 6D", "tx AA 00",
+        "rx 00 00 00 00 00 00 00 00 00 00 00 D0 00 00 00 00 F0 00 00 00 00 00 00 00 00 00 00 AF 00 00 00 00",
+        "off 300.4", "on 400.4",
+        // STANDARD model query: no answer
+        "reset", "tx CC DC 0C", "rx FF FF FF FF FF FF FF FF FF FF FF FF FF FF FF FF",
+        "off 700.8", "on 800.8",
+        // F0513 model query: 0x99, then 0x31 100 ms later answers 0x1815, then a clear
+        "reset", "tx CC 99",
+        "reset", "tx 31", "rx 15 18",
+        "reset", "tx CC F0 00",
+        "off 1202.2",
+    };
+    assertTranscript(expected, bus.lines);
+}
+
+void test_dynamic_5s_batched(void) {
+    TranscriptBus bus(F0513_5S);
+    MakitaBMS bms(bus);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+
+    // All eight commands share one power window, 5 ms apart: 300 + 7 * 5 + 3.2 ms on the bus
+    bus.mark();
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+    static const char* const expected[] = {
+        "on 0.0",
+        "reset", "tx CC F0 00",
+        "reset", "tx CC F0 00",
+        "reset", "tx CC 31", "rx 2F 0F",
+        "reset", "tx CC 32", "rx 2A 0F",
+        "reset", "tx CC 33", "rx 3B 0F",
+        "reset", "tx CC 34", "rx 24 0F",
+        "reset", "tx CC 35", "rx 30 0F",
+        "reset", "tx CC 52", "rx C4 09",
+        "off 338.2",
+    };
+    assertTranscript(expected, bus.lines);
+    const uint16_t cells[5] = {3887, 3882, 3899, 3876, 3888};
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(cells, data.cell_mv, 5);
+    TEST_ASSERT_EQUAL_UINT16(3887 + 3882 + 3899 + 3876 + 3888, data.pack_mv);
+    TEST_ASSERT_EQUAL_UINT16(3899 - 3876, data.cell_diff_mv);
+    TEST_ASSERT_EQUAL_INT16(2500, data.temp1_cC);
+    TEST_ASSERT_EQUAL_UINT32(0, retries(bms));
+
+    // The next refresh stays batched and takes the same time
+    uint64_t t0 = shim::nowUs();
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+    TEST_ASSERT_EQUAL_UINT32(338200, (uint32_t)(shim::nowUs() - t0));
+    TEST_ASSERT_EQUAL_UINT32(0, retries(bms));
+}
+
+void test_dynamic_4s_falls_back_to_per_command(void) {
+    TranscriptBus bus(F0513_4S);
+    MakitaBMS bms(bus);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_STRING("BL1415", data.model);
+    TEST_ASSERT_EQUAL_UINT8(4, data.cell_count);
+
+    // The batch is abandoned after the last cell comes back as 0xFFFF. The read then
+    // restarts with one power window per command: 50 ms off, 300 ms wake, the command.
+    bus.mark();
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+    static const char* const expected[] = {
+        "on 0.0",
+        "reset", "tx CC F0 00",
+        "reset", "tx CC F0 00",
+        "reset", "tx CC 31", "rx FF FF",
+        "reset", "tx CC 32", "rx FF FF",
+        "reset", "tx CC 33", "rx FF FF",
+        "reset", "tx CC 34", "rx FF FF",
+        "off 327.4",
+        "on 377.4", "reset", "tx CC F0 00", "off 677.8",
+        "on 727.8", "reset", "tx CC F0 00", "off 1028.2",
+        "on 1078.2", "reset", "tx CC 31", "rx 0D 0E", "off 1378.6",
+        "on 1428.6", "reset", "tx CC 32", "rx 17 0E", "off 1729.0",
+        "on 1779.0", "reset", "tx CC 33", "rx 03 0E", "off 2079.4",
+        "on 2129.4", "reset", "tx CC 34", "rx 12 0E", "off 2429.8",
+        "on 2479.8", "reset", "tx CC 52", "rx A2 08", "off 2780.2",
+    };
+    assertTranscript(expected, bus.lines);
+    const uint16_t cells[5] = {3597, 3607, 3587, 3602, 0};
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(cells, data.cell_mv, 5);
+    TEST_ASSERT_EQUAL_UINT16(3597 + 3607 + 3587 + 3602, data.pack_mv);
+    TEST_ASSERT_EQUAL_INT16(2210, data.temp1_cC);
+    TEST_ASSERT_EQUAL_UINT32(1, retries(bms));
+}
+
+void test_dynamic_4s_remembers_per_command(void) {
+    TranscriptBus bus(F0513_4S);
+    MakitaBMS bms(bus);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+
+    // Second refresh: no batch attempt, 7 windows of 300.4 ms with 50 ms between them
+    bus.mark();
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+    static const char* const expected[] = {
+        "on 0.0", "reset", "tx CC F0 00", "off 300.4",
+        "on 350.4", "reset", "tx CC F0 00", "off 650.8",
+        "on 700.8", "reset", "tx CC 31", "rx 0E 0E", "off 1001.2",
+        "on 1051.2", "reset", "tx CC 32", "rx 18 0E", "off 1351.6",
+        "on 1401.6", "reset", "tx CC 33", "rx 04 0E", "off 1702.0",
+        "on 1752.0", "reset", "tx CC 34", "rx 13 0E", "off 2052.4",
+        "on 2102.4", "reset", "tx CC 52", "rx A2 08", "off 2402.8",
+    };
+    assertTranscript(expected, bus.lines);
+    TEST_ASSERT_EQUAL_UINT16(3598, data.cell_mv[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, retries(bms));   // no second fallback
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_identify_5s);
+    RUN_TEST(test_dynamic_5s_batched);
+    RUN_TEST(test_dynamic_4s_falls_back_to_per_command);
+    RUN_TEST(test_dynamic_4s_remembers_per_command);
+    return UNITY_END();
+}
@@ -0,0 +1,159 @@
+// test/test_history/test_history.cpp - HISTORY FILE READING AND DOWNSAMPLING (HistoryFile.h)
+
+#include <unity.h>
+#include <vector>
+#include "HistoryFile.h"
+
+// In-memory stand-in for fs::File: read() returns at most `limit` bytes per call
+struct MemFile {
+    std::vector<uint8_t> bytes;
+    size_t pos = 0;
+    size_t limit = SIZE_MAX;
+    uint32_t reads = 0;
+
+    size_t read(uint8_t* out, size_t n) {
+        reads++;
+        if (n > limit) n = limit;
+        if (n > bytes.size() - pos) n = bytes.size() - pos;
+        memcpy(out, bytes.data() + pos, n);
+        pos += n;
+        return n;
+    }
+};
+
+static HistoryRecord record(uint32_t i) {
+    HistoryRecord r = {};
+    r.timestamp = 1700000000 + i * 60;
+    r.charge_cycles = (uint16_t)(100 + i / 10);
+    r.pack_voltage = (uint16_t)(18000 + i % 100);
+    for (uint8_t c = 0; c < 5; c++) r.cell_voltages[c] = (uint16_t)(3600 + i % 100);
+    r.cell_diff = (uint16_t)(i % 50);
+    r.temp1 = (int16_t)(2000 + i % 7);
+    r.temp2 = -100;
+    return r;
+}
+
+// Records of recSize bytes; the tail of a v2 record holds bytes the reader must skip
+static MemFile fileOf(uint32_t count, size_t recSize) {
+    MemFile f;
+    for (uint32_t i = 0; i < count; i++) {
+        HistoryRecord r = record(i);
+        const uint8_t* b = (const uint8_t*)&r;
+        f.bytes.insert(f.bytes.end(), b, b + sizeof(r));
+        f.bytes.insert(f.bytes.end(), recSize - sizeof(r), 0xEE);
+    }
+    return f;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_layout(void) {
+    TEST_ASSERT_EQUAL_size_t(12, sizeof(HistoryHeader));
+    TEST_ASSERT_EQUAL_size_t(24, sizeof(HistoryRecord));
+    HistoryHeader v1 = {{0xBA, 0x7E}, HISTORY_VERSION, 5, {0}};
+    HistoryHeader v2 = {{0xBA, 0x7E}, 2, 5, {0}};
+    TEST_ASSERT_EQUAL_size_t(sizeof(HistoryRecord), historyRecordSize(v1));
+    TEST_ASSERT_EQUAL_size_t(HISTORY_RECORD_V2_SIZE, historyRecordSize(v2));
+}
+
+void test_block_reader(void) {
+    const uint32_t count = HISTORY_READ_BLOCK * 2 + 5;  // crosses two block boundaries
+    MemFile f = fileOf(count, sizeof(HistoryRecord));
+    HistoryBlockReader<MemFile> reader(f, sizeof(HistoryRecord));
+    HistoryRecord rec;
+    for (uint32_t i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(reader.next(rec));
+        HistoryRecord want = record(i);
+        TEST_ASSERT_EQUAL_MEMORY(&want, &rec, sizeof(rec));
+    }
+    TEST_ASSERT_FALSE(reader.next(rec));
+    TEST_ASSERT_EQUAL_UINT32(4, f.reads);                // 3 blocks + the one that hits the end
+}
+
+void test_block_reader_v2_skips_tail(void) {
+    const uint32_t count = HISTORY_READ_BLOCK + 8;
+    MemFile f = fileOf(count, HISTORY_RECORD_V2_SIZE);
+    HistoryBlockReader<MemFile> reader(f, HISTORY_RECORD_V2_SIZE);
+    HistoryRecord rec;
+    for (uint32_t i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(reader.next(rec));
+        HistoryRecord want = record(i);
+        TEST_ASSERT_EQUAL_MEMORY(&want, &rec, sizeof(rec));
+    }
+    TEST_ASSERT_FALSE(reader.next(rec));
+}
+
+void test_block_reader_drops_partial_record(void) {
+    MemFile f = fileOf(3, sizeof(HistoryRecord));
+    f.bytes.resize(f.bytes.size() - 4);                 // power lost mid-append
+    HistoryBlockReader<MemFile> reader(f, sizeof(HistoryRecord));
+    HistoryRecord rec;
+    TEST_ASSERT_TRUE(reader.next(rec));
+    TEST_ASSERT_TRUE(reader.next(rec));
+    TEST_ASSERT_FALSE(reader.next(rec));
+}
+
+void test_buckets_cover_whole_file(void) {
+    const uint32_t total = 1234;
+    const uint16_t points = 100;
+    MemFile f = fileOf(total, sizeof(HistoryRecord));
+    HistoryBlockReader<MemFile> reader(f, sizeof(HistoryRecord));
+    std::vector<HistoryBucket> buckets;
+    bucketHistory(total, points, [&](HistoryRecord& r) { return reader.next(r); },
+                  [&](const HistoryBucket& b) { buckets.push_back(b); });
+    TEST_ASSERT_EQUAL_size_t(points, buckets.size());
+    uint32_t n = 0;
+    for (const HistoryBucket& b : buckets) {
+        TEST_ASSERT_TRUE(b.n == 12 || b.n == 13);       // 1234 / 100, spread evenly
+        n += b.n;
+    }
+    TEST_ASSERT_EQUAL_UINT32(total, n);
+    // The last bucket ends with the last record
+    TEST_ASSERT_EQUAL_UINT16(record(total - 1).charge_cycles, buckets.back().cycles);
+}
+
+void test_bucket_statistics(void) {
+    HistoryBucket b;
+    for (uint32_t i = 10; i < 20; i++) b.add(record(i));
+    TEST_ASSERT_EQUAL_UINT32(10, b.n);
+    TEST_ASSERT_EQUAL_UINT32(record(10).timestamp + 270, (uint32_t)(b.ts / b.n));
+    TEST_ASSERT_EQUAL_UINT32(18014, b.pack / b.n);
+    TEST_ASSERT_EQUAL_UINT16(18010, b.packMin);
+    TEST_ASSERT_EQUAL_UINT16(18019, b.packMax);
+    TEST_ASSERT_EQUAL_UINT16(19, b.diffMax);
+    TEST_ASSERT_EQUAL_INT(-100, b.t2 / (int32_t)b.n);
+}
+
+void test_fewer_records_than_points(void) {
+    const uint32_t total = 7;
+    MemFile f = fileOf(total, sizeof(HistoryRecord));
+    HistoryBlockReader<MemFile> reader(f, sizeof(HistoryRecord));
+    uint32_t emitted = 0;
+    bucketHistory(total, 100, [&](HistoryRecord& r) { return reader.next(r); },
+                  [&](const HistoryBucket& b) { TEST_ASSERT_EQUAL_UINT32(1, b.n); emitted++; });
+    TEST_ASSERT_EQUAL_UINT32(total, emitted);
+}
+
+void test_short_file_stops_early(void) {
+    // The index says 50 records but the file holds 20: the 20 are still bucketed
+    MemFile f = fileOf(20, sizeof(HistoryRecord));
+    HistoryBlockReader<MemFile> reader(f, sizeof(HistoryRecord));
+    uint32_t n = 0;
+    bucketHistory(50, 10, [&](HistoryRecord& r) { return reader.next(r); },
+                  [&](const HistoryBucket& b) { n += b.n; });
+    TEST_ASSERT_EQUAL_UINT32(20, n);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_layout);
+    RUN_TEST(test_block_reader);
+    RUN_TEST(test_block_reader_v2_skips_tail);
+    RUN_TEST(test_block_reader_drops_partial_record);
+    RUN_TEST(test_buckets_cover_whole_file);
+    RUN_TEST(test_bucket_statistics);
+    RUN_TEST(test_fewer_records_than_points);
+    RUN_TEST(test_short_file_stops_early);
+    return UNITY_END();
+}
@@ -0,0 +1,100 @@
+// test/test_log_ring/test_log_ring.cpp - DEFERRED BMS LOGGING (LogRing)
+
+#include <unity.h>
+#include "LogRing.h"
+
+static LogRing* ring;
+
+void setUp(void) {
+    shim::resetClock();
+    ring = new LogRing();
+}
+void tearDown(void) { delete ring; }
+
+void test_text_round_trip(void) {
+    delay(42);
+    ring->pushText(1, "Identification complete: BL1850B");
+    LogRecord rec;
+    TEST_ASSERT_TRUE(ring->pop(rec));
+    TEST_ASSERT_EQUAL_UINT32(42, rec.ms);
+    TEST_ASSERT_EQUAL_UINT8(1, rec.level);
+    TEST_ASSERT_EQUAL_UINT8(LogRecord::TEXT, rec.kind);
+    char line[LogRecord::PAYLOAD + 1];
+    LogRing::format(rec, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("Identification complete: BL1850B", line);
+    TEST_ASSERT_FALSE(ring->pop(rec));
+    TEST_ASSERT_TRUE(ring->empty());
+}
+
+void test_text_truncated_to_payload(void) {
+    char longText[200];
+    memset(longText, 'x', sizeof(longText) - 1);
+    longText[sizeof(longText) - 1] = '\0';
+    ring->pushText(1, longText);
+    LogRecord rec;
+    TEST_ASSERT_TRUE(ring->pop(rec));
+    TEST_ASSERT_EQUAL_UINT8(LogRecord::PAYLOAD, rec.len);
+    char line[256];
+    TEST_ASSERT_EQUAL_size_t(LogRecord::PAYLOAD, LogRing::format(rec, line, sizeof(line)));
+}
+
+void test_hex_formatted_on_drain(void) {
+    const uint8_t bytes[] = {0xD7, 0x00, 0x00, 0xFF};
+    ring->pushHex(2, ">> CC (cmd): ", bytes, sizeof(bytes));
+    LogRecord rec;
+    TEST_ASSERT_TRUE(ring->pop(rec));
+    char line[64];
+    LogRing::format(rec, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING(">> CC (cmd): D7 00 00 FF ", line);
+}
+
+void test_format_respects_capacity(void) {
+    const uint8_t bytes[] = {0x01, 0x02, 0x03, 0x04, 0x05};
+    ring->pushHex(2, "rx: ", bytes, sizeof(bytes));
+    LogRecord rec;
+    ring->pop(rec);
+    char line[12];
+    size_t n = LogRing::format(rec, line, sizeof(line));
+    TEST_ASSERT_LESS_THAN(sizeof(line), n);
+    TEST_ASSERT_EQUAL_STRING("rx: 01 02 ", line);
+}
+
+void test_full_ring_drops_and_counts(void) {
+    for (uint8_t i = 0; i < LogRing::CAPACITY + 3; i++) ring->pushText(1, "line");
+    TEST_ASSERT_EQUAL_UINT32(3, ring->droppedTotal());
+    LogRecord rec;
+    uint8_t popped = 0;
+    while (ring->pop(rec)) {
+        TEST_ASSERT_EQUAL_UINT8(0, rec.dropped);
+        popped++;
+    }
+    TEST_ASSERT_EQUAL_UINT8(LogRing::CAPACITY, popped);
+    // The loss is reported on the next record that fits
+    ring->pushText(1, "after");
+    TEST_ASSERT_TRUE(ring->pop(rec));
+    TEST_ASSERT_EQUAL_UINT8(3, rec.dropped);
+}
+
+void test_fifo_order_across_wrap(void) {
+    char text[8];
+    LogRecord rec;
+    for (uint16_t i = 0; i < LogRing::CAPACITY * 3; i++) {
+        snprintf(text, sizeof(text), "%u", i);
+        ring->pushText(1, text);
+        TEST_ASSERT_TRUE(ring->pop(rec));
+        char line[16];
+        LogRing::format(rec, line, sizeof(line));
+        TEST_ASSERT_EQUAL_STRING(text, line);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_text_round_trip);
+    RUN_TEST(test_text_truncated_to_payload);
+    RUN_TEST(test_hex_formatted_on_drain);
+    RUN_TEST(test_format_respects_capacity);
+    RUN_TEST(test_full_ring_drops_and_counts);
+    RUN_TEST(test_fifo_order_across_wrap);
+    return UNITY_END();
+}
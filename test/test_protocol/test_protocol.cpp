@@ -0,0 +1,131 @@
+// test/test_protocol/test_protocol.cpp - FRAME DECODING (MakitaProtocol.h)
+
+#include <unity.h>
+#include "MakitaProtocol.h"
+
+using namespace MakitaProtocol;
+
+// Static read of the sim's "BL1850B 5S" pack: ROM ID + 32-byte table
+static const uint8_t STATIC_FRAME[StaticRead::FRAME_LEN] = {
+    0x21, 0x06, 0x15, 0x3A, 0x91, 0x0C, 0x42, 0x07,   // ROM ID (yy mm dd ...)
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0xB0,                                             // 19: type 0x0B, nibble-swapped
+    0, 0, 0, 0,
+    0x23,                                             // 24: capacity 50 (0x32), nibble-swapped
+    0, 0,
+    0x5A,                                             // 27: status
+    0x31,                                             // 28: lock (low nibble)
+    0, 0, 0, 0, 0,
+    0x00, 0x07,                                       // 34, 35: cycles 112 (0x070 -> swapped 0x00 0x07)
+    0, 0, 0, 0
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_static_fields(void) {
+    TEST_ASSERT_EQUAL_UINT8(0x21, readField(STATIC_FRAME, Static::DATE_YEAR));
+    TEST_ASSERT_EQUAL_UINT8(0x06, readField(STATIC_FRAME, Static::DATE_MONTH));
+    TEST_ASSERT_EQUAL_UINT8(0x15, readField(STATIC_FRAME, Static::DATE_DAY));
+    TEST_ASSERT_EQUAL_UINT8(0xB0, readField(STATIC_FRAME, Static::TYPE_CODE));
+    TEST_ASSERT_EQUAL_UINT8(0x0B, readField(STATIC_FRAME, Static::TYPE));
+    TEST_ASSERT_EQUAL_UINT8(50, readField(STATIC_FRAME, Static::CAPACITY));
+    TEST_ASSERT_EQUAL_UINT8(0x5A, readField(STATIC_FRAME, Static::STATUS));
+    TEST_ASSERT_EQUAL_UINT8(0x01, readField(STATIC_FRAME, Static::LOCK));
+    TEST_ASSERT_EQUAL_UINT16(112, readField(STATIC_FRAME, Static::CYCLES));
+}
+
+void test_cycles_mask_and_byte_order(void) {
+    // Big-endian after the nibble swap, top nibble masked off: 0xF123 -> 0x123
+    uint8_t frame[StaticRead::FRAME_LEN] = {0};
+    frame[34] = 0x1F;
+    frame[35] = 0x32;
+    TEST_ASSERT_EQUAL_UINT16(0x123, readField(frame, Static::CYCLES));
+}
+
+void test_read_field_is_constexpr(void) {
+    static constexpr uint8_t frame[] = {0x34, 0x12};
+    static_assert(readField(frame, le16(0)) == 0x1234, "le16 folds at compile time");
+    static_assert(readField(frame, byteAt(1, 0x0F)) == 0x02, "masked byte folds at compile time");
+    TEST_ASSERT_EQUAL_HEX16(0x1234, readField(frame, le16(0)));
+}
+
+void test_dynamic_cells_5s(void) {
+    uint8_t frame[DynamicRead::FRAME_LEN] = {0};
+    const uint16_t mv[5] = {4012, 4008, 4015, 4010, 4011};
+    for (uint8_t i = 0; i < 5; i++) {
+        frame[2 + i * 2] = mv[i] & 0xFF;
+        frame[3 + i * 2] = mv[i] >> 8;
+    }
+    Dynamic::Cells c = Dynamic::readCells(frame, 5);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(mv, c.mv, 5);
+    TEST_ASSERT_EQUAL_UINT16(7, c.diff_mv);
+    TEST_ASSERT_EQUAL_UINT16(4015, c.max_mv);
+}
+
+void test_dynamic_cells_4s_ignores_fifth(void) {
+    uint8_t frame[DynamicRead::FRAME_LEN] = {0};
+    const uint16_t mv[5] = {3720, 3710, 3735, 3702, 0x5555};
+    for (uint8_t i = 0; i < 5; i++) {
+        frame[2 + i * 2] = mv[i] & 0xFF;
+        frame[3 + i * 2] = mv[i] >> 8;
+    }
+    Dynamic::Cells c = Dynamic::readCells(frame, 4);
+    TEST_ASSERT_EQUAL_UINT16(0, c.mv[4]);
+    TEST_ASSERT_EQUAL_UINT16(33, c.diff_mv);
+    TEST_ASSERT_EQUAL_UINT16(3735, c.max_mv);
+}
+
+void test_dynamic_cells_low_reading_not_minimum(void) {
+    // A cell under 500 mV is a bad reading, not the weakest cell
+    uint8_t frame[DynamicRead::FRAME_LEN] = {0};
+    const uint16_t mv[5] = {3900, 120, 3910, 3905, 3902};
+    for (uint8_t i = 0; i < 5; i++) {
+        frame[2 + i * 2] = mv[i] & 0xFF;
+        frame[3 + i * 2] = mv[i] >> 8;
+    }
+    TEST_ASSERT_EQUAL_UINT16(10, Dynamic::readCells(frame, 5).diff_mv);
+}
+
+void test_garbage_rule(void) {
+    const uint8_t ff[] = {0xFF, 0xFF, 0xFF, 0x12};
+    const uint8_t zero[] = {0x00, 0x00, 0x00, 0x12};
+    const uint8_t mixed[] = {0xFF, 0x00, 0xFF};
+    const uint8_t answer[] = {0xFF, 0xFF, 0x01};
+    TEST_ASSERT_TRUE(isGarbage(ff, sizeof(ff)));          // only the first 3 bytes count
+    TEST_ASSERT_TRUE(isGarbage(zero, sizeof(zero)));
+    TEST_ASSERT_FALSE(isGarbage(mixed, sizeof(mixed)));
+    TEST_ASSERT_FALSE(isGarbage(answer, sizeof(answer)));
+    TEST_ASSERT_TRUE(isGarbage(ff, 1));
+    TEST_ASSERT_TRUE(isGarbage(answer, 0));               // nothing read
+    TEST_ASSERT_TRUE(isGarbage(nullptr, 4));
+}
+
+void test_cell_count_for_model(void) {
+    TEST_ASSERT_EQUAL_UINT8(4, cellCountForModel("BL1430"));
+    TEST_ASSERT_EQUAL_UINT8(4, cellCountForModel("BL1415"));
+    TEST_ASSERT_EQUAL_UINT8(5, cellCountForModel("BL1850B"));
+    TEST_ASSERT_EQUAL_UINT8(5, cellCountForModel("N/A"));
+}
+
+void test_command_layout(void) {
+    TEST_ASSERT_EQUAL_UINT8(40, StaticRead::FRAME_LEN);
+    TEST_ASSERT_EQUAL_UINT8(8, StaticRead::RX_OFFSET);
+    TEST_ASSERT_EQUAL_UINT8(29, DynamicRead::FRAME_LEN);
+    TEST_ASSERT_EQUAL_UINT8(0, DynamicRead::RX_OFFSET);
+    TEST_ASSERT_EQUAL_HEX8(0xD7, READ_DYNAMIC.tx[0]);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_static_fields);
+    RUN_TEST(test_cycles_mask_and_byte_order);
+    RUN_TEST(test_read_field_is_constexpr);
+    RUN_TEST(test_dynamic_cells_5s);
+    RUN_TEST(test_dynamic_cells_4s_ignores_fifth);
+    RUN_TEST(test_dynamic_cells_low_reading_not_minimum);
+    RUN_TEST(test_garbage_rule);
+    RUN_TEST(test_cell_count_for_model);
+    RUN_TEST(test_command_layout);
+    return UNITY_END();
+}
@@ -0,0 +1,213 @@
+// test/test_sim/test_sim.cpp - MakitaBMS AGAINST THE SIMULATED BATTERY (MakitaSim)
+
+#include <unity.h>
+#include "MakitaBMS.h"
+#include "MakitaSim.h"
+#include "ControllerCache.h"
+
+// Sim presets (lib/MakitaSim/MakitaSim.cpp)
+static const uint8_t STD_5S = 0, STD_4S = 1, STD_LOCKED = 2, F0513_5S = 3, F0513_4S = 4;
+
+static BatteryData data;
+static SupportedFeatures features;
+
+void setUp(void) {
+    shim::resetClock();
+    data = BatteryData();
+    features = SupportedFeatures();
+}
+void tearDown(void) {}
+
+void test_standard_5s(void) {
+    MakitaSim sim(STD_5S);
+    MakitaBMS bms(sim);
+    TEST_ASSERT_TRUE(bms.isPresent());
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_STRING("BL1850B", data.model);
+    TEST_ASSERT_EQUAL_UINT8(5, data.cell_count);
+    TEST_ASSERT_EQUAL_UINT16(112, data.charge_cycles);
+    TEST_ASSERT_EQUAL_UINT8(50, data.capacity_dah);
+    TEST_ASSERT_EQUAL(LockState::UNLOCKED, data.lock_status);
+    TEST_ASSERT_TRUE(data.has_rom);
+    TEST_ASSERT_EQUAL_HEX8(0x21, data.rom_id[0]);
+    TEST_ASSERT_TRUE(features.led_test && features.clear_errors && features.live_session);
+
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+    // The sim moves each cell by -5..+5 mV between samples
+    for (uint8_t i = 0; i < 5; i++) {
+        TEST_ASSERT_LESS_OR_EQUAL(5, abs((int)data.cell_mv[i] - (int)MakitaSim::PACKS[STD_5S].cell_mv[i]));
+    }
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < 5; i++) sum += data.cell_mv[i];
+    TEST_ASSERT_EQUAL_UINT32(sum, data.pack_mv);
+    TEST_ASSERT_EQUAL_INT16(2310, data.temp1_cC);
+    TEST_ASSERT_EQUAL_INT16(2290, data.temp2_cC);
+}
+
+void test_standard_4s(void) {
+    MakitaSim sim(STD_4S);
+    MakitaBMS bms(sim);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_STRING("BL1430 ", data.model);        // 7-char field, space-padded on the bus
+    TEST_ASSERT_EQUAL_UINT8(4, data.cell_count);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+    TEST_ASSERT_EQUAL_UINT16(0, data.cell_mv[4]);
+    TEST_ASSERT_GREATER_THAN(3690, data.cell_mv[3]);
+}
+
+void test_standard_locked_and_cleared(void) {
+    MakitaSim sim(STD_LOCKED);
+    MakitaBMS bms(sim);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL(LockState::LOCKED, data.lock_status);
+    // This pack answers the model query only as the first command after power-on
+    TEST_ASSERT_EQUAL_STRING("BL1860B", data.model);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.clearErrors());
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL(LockState::UNLOCKED, data.lock_status);
+}
+
+void test_f0513_5s(void) {
+    MakitaSim sim(F0513_5S);
+    MakitaBMS bms(sim);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_STRING("BL1815", data.model);
+    TEST_ASSERT_EQUAL_UINT8(5, data.cell_count);
+    TEST_ASSERT_TRUE(features.read_dynamic);
+    TEST_ASSERT_FALSE(features.led_test);
+    TEST_ASSERT_EQUAL(BMSStatus::ERROR_NOT_AVAILABLE, bms.ledTest(true));
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+    TEST_ASSERT_EQUAL_INT16(2500, data.temp1_cC);
+    TEST_ASSERT_EQUAL_INT16(0, data.temp2_cC);
+}
+
+void test_f0513_4s(void) {
+    MakitaSim sim(F0513_4S);
+    MakitaBMS bms(sim);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_STRING("BL1415", data.model);
+    TEST_ASSERT_EQUAL_UINT8(4, data.cell_count);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readDynamicData(data));
+    TEST_ASSERT_EQUAL_UINT16(0, data.cell_mv[4]);
+    for (uint8_t i = 0; i < 4; i++) TEST_ASSERT_TRUE(data.cell_mv[i] > 3500 && data.cell_mv[i] < 3700);
+}
+
+void test_empty_bay(void) {
+    MakitaSim sim(-1);
+    MakitaBMS bms(sim);
+    TEST_ASSERT_FALSE(bms.isPresent());
+    TEST_ASSERT_EQUAL(BMSStatus::ERROR_NOT_PRESENT, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL(BMSStatus::ERROR_NOT_IDENTIFIED, bms.readDynamicData(data));
+}
+
+void test_open_bus_reads_ff(void) {
+    MakitaSim sim(STD_5S);
+    MakitaBMS bms(sim);
+    sim.setFault(MakitaSim::Fault::BUS_FF);
+    TEST_ASSERT_FALSE(bms.isPresent());
+    TEST_ASSERT_EQUAL(BMSStatus::ERROR_NOT_PRESENT, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_UINT32(2, bms.metrics().garbage);          // first try + power-cycled retry
+    TEST_ASSERT_EQUAL_UINT32(1, bms.metrics().ops[(size_t)BMSOperation::READ_STATIC].retries);
+}
+
+void test_shorted_bus_reads_00(void) {
+    MakitaSim sim(STD_5S);
+    MakitaBMS bms(sim);
+    sim.setFault(MakitaSim::Fault::BUS_00);
+    // A line held low passes for a presence pulse; the all-zero frame gives it away
+    TEST_ASSERT_TRUE(bms.isPresent());
+    TEST_ASSERT_EQUAL(BMSStatus::ERROR_NOT_PRESENT, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_UINT32(2, bms.metrics().garbage);
+}
+
+void test_disconnect_mid_dynamic_read(void) {
+    MakitaSim sim(STD_5S);
+    MakitaBMS bms(sim);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    // Pulled out after pack + 4 cells: the 5th cell reads 0xFFFF
+    sim.setFault(MakitaSim::Fault::DISCONNECT, 10);
+    TEST_ASSERT_EQUAL(BMSStatus::ERROR_COMMUNICATION, bms.readDynamicData(data));
+    TEST_ASSERT_FALSE(sim.inserted());
+    TEST_ASSERT_EQUAL(BMSStatus::ERROR_COMMUNICATION, bms.readDynamicData(data));
+}
+
+void test_disconnect_mid_static_read(void) {
+    MakitaSim sim(STD_5S);
+    MakitaBMS bms(sim);
+    // Gone after the ROM ID: the frame starts with real bytes, so it is parsed, and the
+    // model probes that follow find an empty bus
+    sim.setFault(MakitaSim::Fault::DISCONNECT, 8);
+    TEST_ASSERT_EQUAL(BMSStatus::ERROR_MODEL_NOT_SUPPORTED, bms.readStaticData(data, features));
+    TEST_ASSERT_FALSE(sim.inserted());
+}
+
+void test_controller_cache_hit(void) {
+    MakitaSim sim(F0513_4S);
+    MakitaBMS bms(sim);
+    ControllerCache cache;                                       // RAM only on the host
+    bms.setControllerCache(&cache);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    ControllerCache::Entry entry;
+    TEST_ASSERT_TRUE(cache.lookup(data.rom_id, entry));
+    TEST_ASSERT_EQUAL_STRING("BL1415", entry.model);
+    TEST_ASSERT_EQUAL_UINT8(4, entry.cell_count);
+
+    // A hit skips the model probes: one power window for the static frame
+    uint64_t t0 = shim::nowUs();
+    data = BatteryData();
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_LESS_THAN(400000, (uint32_t)(shim::nowUs() - t0));
+    TEST_ASSERT_EQUAL_STRING("BL1415", data.model);
+    TEST_ASSERT_EQUAL_UINT8(4, data.cell_count);
+
+    // The stored cell count is used as is, not derived from the model again
+    entry.cell_count = 5;
+    cache.store(entry);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_UINT8(5, data.cell_count);
+
+    // An impossible count drops the entry and the full probe runs
+    entry.cell_count = 9;
+    cache.store(entry);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    TEST_ASSERT_EQUAL_UINT8(4, data.cell_count);
+    TEST_ASSERT_TRUE(cache.lookup(data.rom_id, entry));
+    TEST_ASSERT_EQUAL_UINT8(4, entry.cell_count);
+}
+
+void test_async_api_and_deadlines(void) {
+    MakitaSim sim(STD_5S);
+    MakitaBMS bms(sim);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.readStaticData(data, features));
+    BMSOperation doneOp = BMSOperation::NONE;
+    BMSStatus doneStatus = BMSStatus::ERROR_BUSY;
+    bms.setCompletionCallback([&](BMSOperation op, BMSStatus status, const BatteryData&) {
+        doneOp = op;
+        doneStatus = status;
+    });
+    TEST_ASSERT_EQUAL(BMSStatus::OK, bms.beginDynamicRead(data));
+    TEST_ASSERT_EQUAL(BMSStatus::ERROR_BUSY, bms.beginDynamicRead(data));
+    TEST_ASSERT_FALSE(bms.poll());                                 // still waking up
+    TEST_ASSERT_EQUAL_UINT32(MakitaBMS::POWER_ON_MS, bms.msUntilNextStep());
+    delay(MakitaBMS::POWER_ON_MS);
+    TEST_ASSERT_TRUE(bms.poll());
+    TEST_ASSERT_EQUAL(BMSOperation::READ_DYNAMIC, doneOp);
+    TEST_ASSERT_EQUAL(BMSStatus::OK, doneStatus);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_standard_5s);
+    RUN_TEST(test_standard_4s);
+    RUN_TEST(test_standard_locked_and_cleared);
+    RUN_TEST(test_f0513_5s);
+    RUN_TEST(test_f0513_4s);
+    RUN_TEST(test_empty_bay);
+    RUN_TEST(test_open_bus_reads_ff);
+    RUN_TEST(test_shorted_bus_reads_00);
+    RUN_TEST(test_disconnect_mid_dynamic_read);
+    RUN_TEST(test_disconnect_mid_static_read);
+    RUN_TEST(test_controller_cache_hit);
+    RUN_TEST(test_async_api_and_deadlines);
+    return UNITY_END();
+}
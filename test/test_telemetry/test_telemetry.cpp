@@ -0,0 +1,93 @@
+// test/test_telemetry/test_telemetry.cpp - BINARY TELEMETRY AND DELTA ENCODING (Telemetry.h)
+
+#include <unity.h>
+#include "Telemetry.h"
+
+static TelemetryFrame frame(uint8_t cells) {
+    TelemetryFrame f = {};
+    f.type = TELEMETRY_DYNAMIC;
+    f.version = TELEMETRY_VERSION;
+    f.bay = 1;
+    f.cell_count = cells;
+    f.pack_mv = 20056;
+    const uint16_t mv[5] = {4012, 4008, 4015, 4010, 4011};
+    for (uint8_t i = 0; i < cells; i++) f.cell_mv[i] = mv[i];
+    f.cell_diff_mv = 7;
+    f.temp1_cC = 2310;
+    f.temp2_cC = -150;
+    return f;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_frame_layout(void) {
+    TelemetryFrame f = frame(5);
+    const uint8_t* b = (const uint8_t*)&f;
+    TEST_ASSERT_EQUAL_size_t(22, sizeof(f));
+    TEST_ASSERT_EQUAL_HEX8(TELEMETRY_DYNAMIC, b[0]);
+    TEST_ASSERT_EQUAL_HEX8(1, b[2]);
+    TEST_ASSERT_EQUAL_HEX8(5, b[3]);
+    TEST_ASSERT_EQUAL_HEX8(20056 & 0xFF, b[4]);       // little-endian, as data/app.js reads it
+    TEST_ASSERT_EQUAL_HEX8(20056 >> 8, b[5]);
+    TEST_ASSERT_EQUAL_HEX8(0x6A, b[20]);              // -150 = 0xFF6A
+    TEST_ASSERT_EQUAL_HEX8(0xFF, b[21]);
+}
+
+void test_changed_fields_thresholds(void) {
+    TelemetryFrame sent = frame(5), now = frame(5);
+    TEST_ASSERT_EQUAL_HEX8(0, changedFields(sent, now, 2, 10));
+    now.pack_mv += 1;                                 // under the threshold
+    now.temp1_cC += 9;
+    TEST_ASSERT_EQUAL_HEX8(0, changedFields(sent, now, 2, 10));
+    now.pack_mv -= 3;                                 // moved down by 2
+    now.cell_mv[4] += 2;
+    now.temp2_cC -= 10;
+    TEST_ASSERT_EQUAL_HEX8(DYN_PACK | DYN_CELLS | DYN_TEMP2, changedFields(sent, now, 2, 10));
+}
+
+void test_changed_fields_ignores_unused_cells(void) {
+    TelemetryFrame sent = frame(4), now = frame(4);
+    now.cell_mv[4] = 999;
+    TEST_ASSERT_EQUAL_HEX8(0, changedFields(sent, now, 2, 10));
+}
+
+void test_apply_fields_updates_only_sent_groups(void) {
+    TelemetryFrame sent = frame(5), now = frame(5);
+    now.pack_mv = 19000;
+    now.cell_mv[0] = 3800;
+    now.temp1_cC = 3000;
+    applyFields(sent, now, DYN_PACK | DYN_TEMP1);
+    TEST_ASSERT_EQUAL_UINT16(19000, sent.pack_mv);
+    TEST_ASSERT_EQUAL_INT16(3000, sent.temp1_cC);
+    TEST_ASSERT_EQUAL_UINT16(4012, sent.cell_mv[0]);  // cells not sent: baseline kept
+}
+
+void test_encode_delta_layout(void) {
+    TelemetryFrame now = frame(5);
+    uint8_t out[TELEMETRY_DELTA_MAX];
+    size_t n = encodeDelta(now, DYN_PACK | DYN_TEMP2, out);
+    const uint8_t expected[] = {TELEMETRY_DELTA, TELEMETRY_VERSION, 1, DYN_PACK | DYN_TEMP2, 5,
+                                20056 & 0xFF, 20056 >> 8, 0x6A, 0xFF};
+    TEST_ASSERT_EQUAL_size_t(sizeof(expected), n);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, n);
+}
+
+void test_encode_delta_cells_follow_cell_count(void) {
+    uint8_t out[TELEMETRY_DELTA_MAX];
+    TEST_ASSERT_EQUAL_size_t(5 + 2 * 5, encodeDelta(frame(5), DYN_CELLS, out));
+    TEST_ASSERT_EQUAL_size_t(5 + 2 * 4, encodeDelta(frame(4), DYN_CELLS, out));
+    TEST_ASSERT_EQUAL_HEX8(4015 & 0xFF, out[5 + 2 * 2]);
+    TEST_ASSERT_EQUAL_size_t(TELEMETRY_DELTA_MAX, encodeDelta(frame(5), DYN_ALL, out));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_layout);
+    RUN_TEST(test_changed_fields_thresholds);
+    RUN_TEST(test_changed_fields_ignores_unused_cells);
+    RUN_TEST(test_apply_fields_updates_only_sent_groups);
+    RUN_TEST(test_encode_delta_layout);
+    RUN_TEST(test_encode_delta_cells_follow_cell_count);
+    return UNITY_END();
+}
@@ -0,0 +1,97 @@
+// test/test_telemetry_json/test_telemetry_json.cpp - dynamic_data JSON (TelemetryJson.h)
+
+#include <unity.h>
+#include <ArduinoJson.h>
+#include "TelemetryJson.h"
+
+static TelemetryFrame frame(uint8_t cells) {
+    TelemetryFrame f = {};
+    f.type = TELEMETRY_DYNAMIC;
+    f.version = TELEMETRY_VERSION;
+    f.bay = 1;
+    f.cell_count = cells;
+    f.pack_mv = 20056;
+    const uint16_t mv[5] = {4012, 4008, 4015, 4010, 4011};
+    for (uint8_t i = 0; i < cells; i++) f.cell_mv[i] = mv[i];
+    f.cell_diff_mv = 7;
+    f.temp1_cC = 2310;
+    f.temp2_cC = -150;
+    return f;
+}
+
+// What data/app.js holds after static_data: the static keys and an older reading
+static void staticData(JsonDocument& last) {
+    JsonObject data = last.createNestedObject("data");
+    data["model"] = "BL1850B";
+    data["charge_cycles"] = 112;
+    data["lock_status"] = "UNLOCKED";
+    data["capacity"] = "5.0Ah";
+    data["mfg_date"] = "14/03/2021";
+    data["rom_id"] = "21 03 14 8C 00 5A 10 B2";
+    data["pack_voltage"] = 19.5f;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_keyframe_carries_only_dynamic_keys(void) {
+    StaticJsonDocument<512> doc;
+    buildDynamicJson(doc, frame(5), DYN_ALL);
+    TEST_ASSERT_EQUAL_STRING("dynamic_data", doc["type"]);
+    TEST_ASSERT_EQUAL_UINT8(1, doc["bay"].as<uint8_t>());
+    TEST_ASSERT_FALSE(doc.containsKey("delta"));
+    JsonObject data = doc["data"];
+    TEST_ASSERT_EQUAL_size_t(5, data.size());
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, 20.056f, data["pack_voltage"].as<float>());
+    TEST_ASSERT_EQUAL_size_t(5, data["cell_voltages"].size());
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, 4.015f, data["cell_voltages"][2].as<float>());
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, 0.007f, data["cell_diff"].as<float>());
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 23.1f, data["temp1"].as<float>());
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, -1.5f, data["temp2"].as<float>());
+    TEST_ASSERT_FALSE(data.containsKey("model"));
+    TEST_ASSERT_FALSE(data.containsKey("rom_id"));
+}
+
+void test_keyframe_leaves_static_fields_alone(void) {
+    StaticJsonDocument<1024> last;
+    staticData(last);
+    StaticJsonDocument<512> doc;
+    buildDynamicJson(doc, frame(5), DYN_ALL);
+
+    // Object.assign(lastData, msg.data), as data/app.js does for dynamic_data
+    JsonObject lastData = last["data"];
+    for (JsonPair kv : doc["data"].as<JsonObject>()) lastData[kv.key().c_str()] = kv.value();
+
+    TEST_ASSERT_EQUAL_STRING("BL1850B", lastData["model"]);
+    TEST_ASSERT_EQUAL_UINT16(112, lastData["charge_cycles"].as<uint16_t>());
+    TEST_ASSERT_EQUAL_STRING("UNLOCKED", lastData["lock_status"]);
+    TEST_ASSERT_EQUAL_STRING("5.0Ah", lastData["capacity"]);
+    TEST_ASSERT_EQUAL_STRING("14/03/2021", lastData["mfg_date"]);
+    TEST_ASSERT_EQUAL_STRING("21 03 14 8C 00 5A 10 B2", lastData["rom_id"]);
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, 20.056f, lastData["pack_voltage"].as<float>());
+}
+
+void test_delta_carries_changed_groups(void) {
+    StaticJsonDocument<512> doc;
+    buildDynamicJson(doc, frame(5), DYN_PACK | DYN_TEMP2);
+    TEST_ASSERT_TRUE(doc["delta"].as<bool>());
+    JsonObject data = doc["data"];
+    TEST_ASSERT_EQUAL_size_t(2, data.size());
+    TEST_ASSERT_TRUE(data.containsKey("pack_voltage"));
+    TEST_ASSERT_TRUE(data.containsKey("temp2"));
+}
+
+void test_cells_follow_cell_count(void) {
+    StaticJsonDocument<512> doc;
+    buildDynamicJson(doc, frame(4), DYN_CELLS);
+    TEST_ASSERT_EQUAL_size_t(4, doc["data"]["cell_voltages"].size());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_keyframe_carries_only_dynamic_keys);
+    RUN_TEST(test_keyframe_leaves_static_fields_alone);
+    RUN_TEST(test_delta_carries_changed_groups);
+    RUN_TEST(test_cells_follow_cell_count);
+    return UNITY_END();
+}
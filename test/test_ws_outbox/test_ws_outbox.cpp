@@ -0,0 +1,99 @@
+// test/test_ws_outbox/test_ws_outbox.cpp - PER-CLIENT WEBSOCKET SEND QUEUE (WsOutbox)
+
+#include <unity.h>
+#include "WsOutbox.h"
+
+static WsOutbox* box;
+
+static WsMessage message(WsMessage::Kind kind, const char* text, uint8_t bay = 0) {
+    WsMessage m;
+    m.payload = std::make_shared<const std::string>(text);
+    m.kind = kind;
+    m.bay = bay;
+    return m;
+}
+
+void setUp(void) { box = new WsOutbox(); }
+void tearDown(void) { delete box; }
+
+void test_fifo_order(void) {
+    TEST_ASSERT_EQUAL(WsOutbox::QUEUED, box->push(message(WsMessage::CONTROL, "a")));
+    TEST_ASSERT_EQUAL(WsOutbox::QUEUED, box->push(message(WsMessage::DEBUG, "b")));
+    TEST_ASSERT_EQUAL(WsOutbox::QUEUED, box->push(message(WsMessage::DYNAMIC, "c")));
+    WsMessage out;
+    const char* expected[] = {"a", "b", "c"};
+    for (const char* e : expected) {
+        TEST_ASSERT_TRUE(box->pop(out));
+        TEST_ASSERT_EQUAL_STRING(e, out.payload->c_str());
+    }
+    TEST_ASSERT_FALSE(box->pop(out));
+    TEST_ASSERT_EQUAL_UINT32(3, box->stats().sent);
+}
+
+void test_dynamic_coalesced_per_bay(void) {
+    box->push(message(WsMessage::DYNAMIC, "bay0-old", 0));
+    box->push(message(WsMessage::DYNAMIC, "bay1", 1));
+    TEST_ASSERT_EQUAL(WsOutbox::COALESCED, box->push(message(WsMessage::DYNAMIC, "bay0-new", 0)));
+    TEST_ASSERT_EQUAL_UINT8(2, box->size());
+    TEST_ASSERT_TRUE(box->hasDynamic(0));
+    TEST_ASSERT_FALSE(box->hasDynamic(2));
+    WsMessage out;
+    box->pop(out);
+    TEST_ASSERT_EQUAL_STRING("bay0-new", out.payload->c_str());   // keeps its place in the queue
+    TEST_ASSERT_EQUAL_UINT32(1, box->stats().coalesced);
+}
+
+void test_full_queue_evicts_oldest_debug(void) {
+    box->push(message(WsMessage::DEBUG, "debug-0"));
+    box->push(message(WsMessage::DEBUG, "debug-1"));
+    for (uint8_t i = 2; i < WsOutbox::DEPTH; i++) box->push(message(WsMessage::CONTROL, "control"));
+    TEST_ASSERT_EQUAL(WsOutbox::QUEUED, box->push(message(WsMessage::CONTROL, "last")));
+    TEST_ASSERT_EQUAL_UINT8(WsOutbox::DEPTH, box->size());
+    TEST_ASSERT_EQUAL_UINT32(1, box->stats().dropped);
+    WsMessage out;
+    box->pop(out);
+    TEST_ASSERT_EQUAL_STRING("debug-1", out.payload->c_str());
+}
+
+void test_full_of_control_drops_dynamic_and_overflows_control(void) {
+    for (uint8_t i = 0; i < WsOutbox::DEPTH; i++) box->push(message(WsMessage::CONTROL, "control"));
+    TEST_ASSERT_EQUAL(WsOutbox::DROPPED, box->push(message(WsMessage::DYNAMIC, "dyn")));
+    TEST_ASSERT_EQUAL(WsOutbox::DROPPED, box->push(message(WsMessage::DEBUG, "dbg")));
+    TEST_ASSERT_EQUAL(WsOutbox::OVERFLOW, box->push(message(WsMessage::CONTROL, "one too many")));
+    TEST_ASSERT_EQUAL_UINT32(2, box->stats().dropped);
+    TEST_ASSERT_EQUAL_UINT8(WsOutbox::DEPTH, box->stats().max_queued);
+}
+
+void test_shared_payload_released(void) {
+    std::weak_ptr<const std::string> watch;
+    {
+        WsMessage m = message(WsMessage::CONTROL, "broadcast");
+        watch = m.payload;
+        box->push(m);
+    }
+    TEST_ASSERT_FALSE(watch.expired());
+    WsMessage out;
+    box->pop(out);
+    out = WsMessage();
+    TEST_ASSERT_TRUE(watch.expired());
+}
+
+void test_clear_resets_queue_and_stats(void) {
+    for (uint8_t i = 0; i < 5; i++) box->push(message(WsMessage::DEBUG, "x"));
+    box->clear();
+    TEST_ASSERT_EQUAL_UINT8(0, box->size());
+    TEST_ASSERT_EQUAL_UINT8(0, box->stats().max_queued);
+    WsMessage out;
+    TEST_ASSERT_FALSE(box->pop(out));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_order);
+    RUN_TEST(test_dynamic_coalesced_per_bay);
+    RUN_TEST(test_full_queue_evicts_oldest_debug);
+    RUN_TEST(test_full_of_control_drops_dynamic_and_overflows_control);
+    RUN_TEST(test_shared_payload_released);
+    RUN_TEST(test_clear_resets_queue_and_stats);
+    return UNITY_END();
+}
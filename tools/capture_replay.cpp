@@ -0,0 +1,228 @@
+// tools/capture_replay.cpp - OFFLINE REPLAY OF A BUS CAPTURE
+//
+// Feeds a /capture.bin downloaded from the device through the firmware's protocol
+// table (src/MakitaProtocol.h) and prints every transaction decoded, with its timing,
+// followed by per-command statistics.
+//
+// Build (host):  g++ -std=c++14 -O2 -Isrc tools/capture_replay.cpp -o capture_replay
+// Usage:         ./capture_replay capture.bin [-q]     (-q: statistics only)
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "BusCapture.h"
+#include "MakitaProtocol.h"
+
+using namespace MakitaProtocol;
+
+namespace {
+
+enum class Decoder { NONE, STATIC, DYNAMIC, MODEL, F0513_CELL, F0513_TEMP, F0513_MODEL };
+
+struct KnownCommand {
+    const char* name;
+    uint8_t control;
+    const uint8_t* tx;
+    uint8_t tx_len;
+    Decoder decoder;
+};
+
+template <class C>
+KnownCommand known(const char* name, const C& cmd, Decoder decoder) {
+    return KnownCommand{name, (uint8_t)C::TRANSPORT, cmd.tx, C::TX_LEN, decoder};
+}
+
+// Same descriptors the firmware sends; a capture entry is matched on control byte + TX bytes
+std::vector<KnownCommand> knownCommands() {
+    std::vector<KnownCommand> table = {
+        known("read_static", READ_STATIC, Decoder::STATIC),
+        known("read_dynamic", READ_DYNAMIC, Decoder::DYNAMIC),
+        known("read_model", READ_MODEL, Decoder::MODEL),
+        known("service_enter", SERVICE_ENTER, Decoder::NONE),
+        known("led_on", LED_ON, Decoder::NONE),
+        known("led_off", LED_OFF, Decoder::NONE),
+        known("clear_errors", CLEAR_ERRORS, Decoder::NONE),
+        known("f0513_model_request", F0513_MODEL_REQUEST, Decoder::NONE),
+        known("f0513_clear", F0513_CLEAR, Decoder::NONE),
+        known("f0513_temp", F0513_TEMP, Decoder::F0513_TEMP),
+    };
+    static const char* cellNames[5] = {"f0513_cell1", "f0513_cell2", "f0513_cell3", "f0513_cell4", "f0513_cell5"};
+    for (uint8_t i = 0; i < 5; i++) table.push_back(known(cellNames[i], F0513_CELL[i], Decoder::F0513_CELL));
+    return table;
+}
+
+struct Stats {
+    const char* name;
+    uint32_t count = 0;
+    uint32_t no_presence = 0;
+    uint32_t garbage = 0;
+    uint64_t total_us = 0;
+    uint32_t max_us = 0;
+};
+
+void printHex(const uint8_t* data, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) printf("%s%02X", i ? " " : "", data[i]);
+}
+
+// Cell count of the pack, learned from the model answers in the capture as the firmware
+// does (cellCountForModel); 5S until a model is seen
+uint8_t cellCount = 5;
+
+void decode(Decoder decoder, const BusCapture::Entry& e) {
+    const uint8_t* f = e.rx;
+    switch (decoder) {
+        case Decoder::STATIC:
+            if (e.rx_len < StaticRead::FRAME_LEN) break;
+            printf("    rom ");
+            printHex(f + Static::ROM_ID_FIRST.offset, Static::ROM_ID_LEN);
+            printf("\n    date %02u/%02u/20%02u  cycles %u  %s  status %02X  capacity %u.%uAh  type %u\n",
+                   readField(f, Static::DATE_DAY), readField(f, Static::DATE_MONTH), readField(f, Static::DATE_YEAR),
+                   readField(f, Static::CYCLES), readField(f, Static::LOCK) ? "LOCKED" : "UNLOCKED",
+                   readField(f, Static::STATUS), readField(f, Static::CAPACITY) / 10,
+                   readField(f, Static::CAPACITY) % 10, readField(f, Static::TYPE));
+            printf("    table ");
+            printHex(f + Static::TABLE_OFFSET, Static::TABLE_LEN);
+            printf("\n");
+            break;
+        case Decoder::DYNAMIC: {
+            if (e.rx_len < DynamicRead::FRAME_LEN) break;
+            Dynamic::Cells cells = Dynamic::readCells(f, cellCount);
+            printf("    pack %u mV  %uS cells", readField(f, Dynamic::PACK_MV), cellCount);
+            for (uint8_t i = 0; i < cellCount; i++) printf(" %u", cells.mv[i]);
+            printf("  diff %u mV  t1 %.2f C  t2 %.2f C\n", cells.diff_mv,
+                   (int16_t)readField(f, Dynamic::TEMP1_CC) / 100.0, (int16_t)readField(f, Dynamic::TEMP2_CC) / 100.0);
+            break;
+        }
+        case Decoder::MODEL: {
+            if (e.rx_len < ModelRead::FRAME_LEN) break;
+            char model[Model::TEXT_LEN + 1] = {0};
+            memcpy(model, f + Model::TEXT_OFFSET, Model::TEXT_LEN);
+            uint8_t first = readField(f, Model::FIRST);
+            bool answered = first != 0x00 && first != 0xFF;
+            if (answered) cellCount = cellCountForModel(model);
+            printf("    model %s\n", answered ? model : "(no answer)");
+            break;
+        }
+        case Decoder::F0513_CELL:
+            if (e.rx_len >= F0513Read::FRAME_LEN) printf("    cell %u mV\n", readField(f, F0513::CELL_MV));
+            break;
+        case Decoder::F0513_TEMP:
+            if (e.rx_len >= F0513Read::FRAME_LEN) printf("    temp %.2f C\n", (int16_t)readField(f, F0513::TEMP_CC) / 100.0);
+            break;
+        case Decoder::F0513_MODEL:
+            if (e.rx_len >= 2) {
+                uint16_t model = readField(f, F0513::MODEL);
+                if (model == 0xFFFF) {
+                    printf("    model (no answer)\n");
+                } else {
+                    char name[8];
+                    snprintf(name, sizeof(name), "BL%04X", model);
+                    cellCount = cellCountForModel(name);
+                    printf("    model %s\n", name);
+                }
+            }
+            break;
+        case Decoder::NONE:
+            break;
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s capture.bin [-q]\n", argv[0]);
+        return 2;
+    }
+    bool quiet = argc > 2 && strcmp(argv[2], "-q") == 0;
+
+    FILE* fp = fopen(argv[1], "rb");
+    if (!fp) {
+        perror(argv[1]);
+        return 1;
+    }
+    BusCapture::Header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, BusCapture::MAGIC, sizeof(hdr.magic)) != 0) {
+        fprintf(stderr, "%s: not a bus capture\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+    if (hdr.version > BusCapture::VERSION || hdr.entry_size < sizeof(BusCapture::Entry)) {
+        fprintf(stderr, "%s: unsupported capture version %u (entry size %u)\n", argv[1], hdr.version, hdr.entry_size);
+        fclose(fp);
+        return 1;
+    }
+    printf("bay %u: %u transactions (%u recorded since boot/clear)\n", hdr.bay, hdr.count, hdr.total);
+
+    std::vector<KnownCommand> table = knownCommands();
+    std::vector<Stats> stats(table.size() + 3);
+    for (size_t i = 0; i < table.size(); i++) stats[i].name = table[i].name;
+    Stats& resetStats = stats[table.size()];
+    Stats& f0513ModelStats = stats[table.size() + 1];
+    Stats& unknownStats = stats[table.size() + 2];
+    resetStats.name = "presence_probe";
+    f0513ModelStats.name = "f0513_model_answer";
+    unknownStats.name = "unknown";
+
+    std::vector<uint8_t> raw(hdr.entry_size);
+    uint32_t first_us = 0, prev_end_us = 0;
+    for (uint16_t n = 0; n < hdr.count; n++) {
+        if (fread(raw.data(), hdr.entry_size, 1, fp) != 1) {
+            fprintf(stderr, "truncated capture after %u entries\n", n);
+            break;
+        }
+        BusCapture::Entry e;
+        memcpy(&e, raw.data(), sizeof(e));
+        if (e.tx_len > BusCapture::MAX_TX) e.tx_len = BusCapture::MAX_TX;
+        if (e.rx_len > BusCapture::MAX_RX) e.rx_len = BusCapture::MAX_RX;
+
+        Stats* st = &unknownStats;
+        Decoder decoder = Decoder::NONE;
+        if (e.kind == BusCapture::RESET) {
+            st = &resetStats;
+        } else if (e.kind == BusCapture::RAW && e.control == F0513::MODEL_CONTROL) {
+            st = &f0513ModelStats;
+            decoder = Decoder::F0513_MODEL;
+        } else {
+            for (size_t i = 0; i < table.size(); i++) {
+                const KnownCommand& k = table[i];
+                if (k.control == e.control && k.tx_len == e.tx_len && memcmp(k.tx, e.tx, e.tx_len) == 0) {
+                    st = &stats[i];
+                    decoder = k.decoder;
+                    break;
+                }
+            }
+        }
+
+        bool present = e.flags & BusCapture::PRESENT;
+        // Only frames the firmware validates: decoded reads, and anything that returned bytes
+        bool garbage = (decoder != Decoder::NONE || e.rx_len > 0) && isGarbage(e.rx, e.rx_len);
+        st->count++;
+        st->total_us += e.dur_us;
+        if (e.dur_us > st->max_us) st->max_us = e.dur_us;
+        if (!present) st->no_presence++;
+        if (garbage) st->garbage++;
+
+        if (n == 0) first_us = prev_end_us = e.t_us;
+        if (!quiet) {
+            printf("%10.3f ms  +%8.3f ms  %5u us  %-20s %s%s", (e.t_us - first_us) / 1000.0,
+                   (int32_t)(e.t_us - prev_end_us) / 1000.0, e.dur_us, st->name,
+                   present ? "presence" : "no-presence", garbage ? "  GARBAGE" : "");
+            if (e.control) printf("  [%02X]", e.control);
+            if (e.tx_len) { printf(" >> "); printHex(e.tx, e.tx_len); }
+            if (e.rx_len) { printf(" << "); printHex(e.rx, e.rx_len); }
+            printf("\n");
+            if (!garbage) decode(decoder, e);
+        }
+        prev_end_us = e.t_us + e.dur_us;
+    }
+    fclose(fp);
+
+    printf("\n%-20s %6s %8s %8s %8s %8s\n", "command", "count", "avg_us", "max_us", "no_pres", "garbage");
+    for (const Stats& st : stats) {
+        if (!st.count) continue;
+        printf("%-20s %6u %8u %8u %8u %8u\n", st.name, st.count, (uint32_t)(st.total_us / st.count),
+               st.max_us, st.no_presence, st.garbage);
+    }
+    return 0;
+}